@@ -0,0 +1,594 @@
+/*
+ * rsxgl-drawbench - CPU cost of draw calls, measured on the host against src/hostgcm.
+ *
+ * The scene is the one from rsxgltest's manycubes and manycubestream samples: a cube, drawn
+ * over and over with a new transformation each time. Each sweep varies one thing about the
+ * draws - how many there are, whether the geometry is streamed in by mapping its buffer
+ * (as manycubestream does), or how many vertex attributes, vertex program uniforms or
+ * textures they use - and reports the time each draw took, the number of command buffer
+ * words it produced, and, if the library was configured with --enable-draw-profile, the time
+ * it spent in each of its validation steps.
+ */
+
+#include <EGL/egl.h>
+#define GL3_PROTOTYPES
+#include <GL3/gl3.h>
+#include <GL3/gl3ext.h>
+#include "GL3/rsxgl.h"
+#include "GL3/rsxgl3ext.h"
+
+#include <hostgcm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+static const float geometry[] = {
+  // -X
+  -0.5,-0.5,-0.5,
+  1,0,0,
+
+  -0.5,0.5,-0.5,
+  1,0,0,
+
+  -0.5,0.5,0.5,
+  1,0,0,
+
+  -0.5,-0.5,0.5,
+  1,0,0,
+
+  // +X
+  0.5,-0.5,-0.5,
+  1,0,0,
+
+  0.5,-0.5,0.5,
+  1,0,0,
+
+  0.5,0.5,0.5,
+  1,0,0,
+
+  0.5,0.5,-0.5,
+  1,0,0,
+
+  // -Y
+  -0.5,-0.5,-0.5,
+  0,1,0,
+
+  -0.5,-0.5,0.5,
+  0,1,0,
+
+  0.5,-0.5,0.5,
+  0,1,0,
+
+  0.5,-0.5,-0.5,
+  0,1,0,
+
+  // +Y
+  -0.5,0.5,-0.5,
+  0,1,0,
+
+  0.5,0.5,-0.5,
+  0,1,0,
+
+  0.5,0.5,0.5,
+  0,1,0,
+
+  -0.5,0.5,0.5,
+  0,1,0,
+
+  // -Z
+  -0.5,-0.5,-0.5,
+  0,0,1,
+
+  -0.5,0.5,-0.5,
+  0,0,1,
+
+  0.5,0.5,-0.5,
+  0,0,1,
+
+  0.5,-0.5,-0.5,
+  0,0,1,
+
+  // +Z
+  -0.5,-0.5,0.5,
+  0,0,1,
+
+  -0.5,0.5,0.5,
+  0,0,1,
+
+  0.5,0.5,0.5,
+  0,0,1,
+
+  0.5,-0.5,0.5,
+  0,0,1
+};
+
+static const GLuint indices[] = {
+  // -X
+  0, 1, 2,
+  2, 3, 0,
+
+  // +X
+  4, 5, 6,
+  6, 7, 4,
+
+  // -Y
+  8, 9, 10,
+  10, 11, 8,
+
+  // +Y
+  12, 13, 14,
+  14, 15, 12,
+
+  // -Z
+  16, 17, 18,
+  18, 19, 16,
+
+  // +Z
+  20, 21, 22,
+  22, 23, 20
+};
+
+static const size_t nvertices = 24, vertex_stride = sizeof(float) * 6;
+
+// What each sweep varies:
+enum sweep_type {
+  SWEEP_DRAWS = 0,
+  SWEEP_STREAM,
+  SWEEP_ATTRIBS,
+  SWEEP_UNIFORMS,
+  SWEEP_TEXTURES,
+  MAX_SWEEPS
+};
+
+static const struct sweep_t {
+  const char * name;
+  unsigned int values[8];
+} sweeps[MAX_SWEEPS] = {
+  { "draws", { 1, 10, 100, 1000, 10000, 0 } },
+  { "stream", { 1, 10, 100, 1000, 0 } },
+  { "attribs", { 1, 2, 4, 8, 16, 0 } },
+  { "uniforms", { 1, 4, 16, 64, 256, 0 } },
+  { "textures", { 1, 2, 4, 8, 16, 0 } }
+};
+
+struct options_t {
+  unsigned int frames, warmup, draws;
+  bool sweep[MAX_SWEEPS];
+};
+
+static EGLDisplay dpy = EGL_NO_DISPLAY;
+static EGLSurface surface = EGL_NO_SURFACE;
+
+// A program, and the objects that its draws use:
+struct scene_t {
+  GLuint shaders[2], program;
+  GLuint buffers[2], textures[2];
+  GLint ProjMatrix_location, TransMatrix_location, u_location;
+  std::vector< GLint > attrib_locations;
+  unsigned int nattribs, nuniforms, ntextures;
+  std::vector< float > uniforms;
+};
+
+static GLuint
+compile_shader(GLenum type,const std::string & source)
+{
+  GLuint shader = glCreateShader(type);
+  const GLchar * src = source.c_str();
+  const GLint length = source.length();
+  glShaderSource(shader,1,&src,&length);
+  glCompileShader(shader);
+
+  GLint compiled = 0;
+  glGetShaderiv(shader,GL_COMPILE_STATUS,&compiled);
+  if(!compiled) {
+    char info[2048];
+    glGetShaderInfoLog(shader,sizeof(info),0,info);
+    fprintf(stderr,"shader failed to compile:\n%s\n%s\n",source.c_str(),info);
+    exit(1);
+  }
+
+  return shader;
+}
+
+// Vertex attributes other than position, vertex program uniforms, and textures are all added
+// to the output, so that the compiler can't drop any of them:
+static void
+scene_create(scene_t & scene,unsigned int nattribs,unsigned int nuniforms,unsigned int ntextures)
+{
+  scene.nattribs = nattribs;
+  scene.nuniforms = nuniforms;
+  scene.ntextures = ntextures;
+
+  std::ostringstream vert, frag;
+
+  vert << "#version 130\n"
+       << "attribute vec3 position;\n";
+  for(unsigned int i = 1;i < nattribs;++i) {
+    vert << "attribute vec3 a" << i << ";\n";
+  }
+  vert << "uniform mat4 ProjMatrix;\n"
+       << "uniform mat4 TransMatrix;\n";
+  if(nuniforms > 0) {
+    vert << "uniform vec4 u[" << nuniforms << "];\n";
+  }
+  vert << "varying vec3 c;\n"
+       << "void\nmain(void)\n{\n"
+       << "  vec4 extra = vec4(0,0,0,0);\n";
+  for(unsigned int i = 1;i < nattribs;++i) {
+    vert << "  extra.xyz += a" << i << ";\n";
+  }
+  for(unsigned int i = 0;i < nuniforms;++i) {
+    vert << "  extra += u[" << i << "];\n";
+  }
+  vert << "  gl_Position = ProjMatrix * (TransMatrix * vec4(position,1)) + extra * 0.001;\n"
+       << "  c = vec3(0.5,0.5,0.5) + extra.xyz;\n"
+       << "}\n";
+
+  frag << "#version 130\n"
+       << "varying vec3 c;\n";
+  for(unsigned int i = 0;i < ntextures;++i) {
+    frag << "uniform sampler2D t" << i << ";\n";
+  }
+  frag << "void\nmain(void)\n{\n"
+       << "  vec4 color = vec4(c,1);\n";
+  for(unsigned int i = 0;i < ntextures;++i) {
+    frag << "  color += texture2D(t" << i << ",c.xy);\n";
+  }
+  frag << "  gl_FragColor = color;\n"
+       << "}\n";
+
+  scene.shaders[0] = compile_shader(GL_VERTEX_SHADER,vert.str());
+  scene.shaders[1] = compile_shader(GL_FRAGMENT_SHADER,frag.str());
+
+  scene.program = glCreateProgram();
+  glAttachShader(scene.program,scene.shaders[0]);
+  glAttachShader(scene.program,scene.shaders[1]);
+  glLinkProgram(scene.program);
+
+  GLint linked = 0;
+  glGetProgramiv(scene.program,GL_LINK_STATUS,&linked);
+  if(!linked) {
+    char info[2048];
+    glGetProgramInfoLog(scene.program,sizeof(info),0,info);
+    fprintf(stderr,"program failed to link:\n%s\n",info);
+    exit(1);
+  }
+
+  glUseProgram(scene.program);
+
+  scene.ProjMatrix_location = glGetUniformLocation(scene.program,"ProjMatrix");
+  scene.TransMatrix_location = glGetUniformLocation(scene.program,"TransMatrix");
+  scene.u_location = (nuniforms > 0) ? glGetUniformLocation(scene.program,"u") : -1;
+
+  static const float ProjMatrix[16] = {
+    1.8,0,0,0,
+    0,3.2,0,0,
+    0,0,-1,-1,
+    0,0,-0.2,0
+  };
+  glUniformMatrix4fv(scene.ProjMatrix_location,1,GL_FALSE,ProjMatrix);
+
+  scene.uniforms.assign(nuniforms * 4,0.0f);
+
+  for(unsigned int i = 0;i < ntextures;++i) {
+    std::ostringstream name;
+    name << "t" << i;
+    glUniform1i(glGetUniformLocation(scene.program,name.str().c_str()),i);
+  }
+
+  // Geometry; every attribute after the first reads the cube's colors:
+  glGenBuffers(2,scene.buffers);
+
+  glBindBuffer(GL_ARRAY_BUFFER,scene.buffers[0]);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(geometry),geometry,GL_STATIC_DRAW);
+
+  scene.attrib_locations.resize(nattribs);
+  for(unsigned int i = 0;i < nattribs;++i) {
+    std::ostringstream name;
+    if(i == 0) {
+      name << "position";
+    }
+    else {
+      name << "a" << i;
+    }
+    const GLint location = glGetAttribLocation(scene.program,name.str().c_str());
+    scene.attrib_locations[i] = location;
+
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location,3,GL_FLOAT,GL_FALSE,vertex_stride,(const GLvoid *)((i == 0) ? 0 : (sizeof(float) * 3)));
+  }
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,scene.buffers[1]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(indices),indices,GL_STATIC_DRAW);
+
+  // Two textures, which draws alternate between:
+  glGenTextures(2,scene.textures);
+  for(unsigned int i = 0;i < 2;++i) {
+    uint32_t texels[16];
+    for(unsigned int j = 0;j < 16;++j) {
+      texels[j] = (i == 0) ? 0xff0000ff : 0xffff0000;
+    }
+
+    glBindTexture(GL_TEXTURE_2D,scene.textures[i]);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,4,4,0,GL_RGBA,GL_UNSIGNED_BYTE,texels);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+  }
+}
+
+static void
+scene_destroy(scene_t & scene)
+{
+  glUseProgram(0);
+  glDeleteTextures(2,scene.textures);
+  glDeleteBuffers(2,scene.buffers);
+  glDeleteProgram(scene.program);
+  glDeleteShader(scene.shaders[0]);
+  glDeleteShader(scene.shaders[1]);
+}
+
+// One draw, with whatever changes the sweep calls for beforehand:
+static inline void
+scene_draw(scene_t & scene,sweep_type sweep,unsigned int i)
+{
+  float TransMatrix[16] = {
+    1,0,0,0,
+    0,1,0,0,
+    0,0,1,0,
+    (float)(i % 10) - 5.0f,(float)((i / 10) % 10) - 5.0f,-10.0f - (float)(i % 7),1
+  };
+
+  if(sweep == SWEEP_STREAM) {
+    glBindBuffer(GL_ARRAY_BUFFER,scene.buffers[0]);
+    float * p = (float *)glMapBuffer(GL_ARRAY_BUFFER,GL_WRITE_ONLY);
+    memcpy(p,geometry,sizeof(geometry));
+    const float fcube = (float)(i & 0xff) / 255.0f;
+    for(size_t j = 0;j < nvertices;++j) {
+      p[j * 6 + 3] = fcube;
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+  else if(sweep == SWEEP_ATTRIBS) {
+    // Move the attributes back and forth by a vertex:
+    glBindBuffer(GL_ARRAY_BUFFER,scene.buffers[0]);
+    const size_t offset = (i & 1) ? vertex_stride : 0;
+    for(unsigned int j = 0;j < scene.nattribs;++j) {
+      glVertexAttribPointer(scene.attrib_locations[j],3,GL_FLOAT,GL_FALSE,vertex_stride,(const GLvoid *)(offset + ((j == 0) ? 0 : (sizeof(float) * 3))));
+    }
+  }
+  else if(sweep == SWEEP_UNIFORMS) {
+    float * p = &scene.uniforms[0];
+    for(unsigned int j = 0,n = scene.nuniforms * 4;j < n;++j) {
+      p[j] = (float)(i + j);
+    }
+    glUniform4fv(scene.u_location,scene.nuniforms,p);
+  }
+  else if(sweep == SWEEP_TEXTURES) {
+    for(unsigned int j = 0;j < scene.ntextures;++j) {
+      glActiveTexture(GL_TEXTURE0 + j);
+      glBindTexture(GL_TEXTURE_2D,scene.textures[(i + j) & 1]);
+    }
+  }
+
+  glUniformMatrix4fv(scene.TransMatrix_location,1,GL_FALSE,TransMatrix);
+  glDrawElements(GL_TRIANGLES,36,GL_UNSIGNED_INT,0);
+}
+
+static inline uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Let the stand-in catch up with everything that's been issued so far:
+static void
+drain()
+{
+  glFlush();
+  hostgcm_finish();
+}
+
+static const GLenum profile_steps[] = {
+  GL_DRAW_PROFILE_STORAGE_TIME_RSX,
+  GL_DRAW_PROFILE_PROGRAM_TIME_RSX,
+  GL_DRAW_PROFILE_STATE_TIME_RSX,
+  GL_DRAW_PROFILE_ATTRIBS_TIME_RSX,
+  GL_DRAW_PROFILE_UNIFORMS_TIME_RSX,
+  GL_DRAW_PROFILE_TEXTURES_TIME_RSX,
+  GL_DRAW_PROFILE_COMMANDS_TIME_RSX
+};
+static const size_t nprofile_steps = sizeof(profile_steps) / sizeof(profile_steps[0]);
+
+static void
+run(const options_t & options,sweep_type sweep,unsigned int value)
+{
+  const unsigned int
+    nattribs = (sweep == SWEEP_ATTRIBS) ? value : 2,
+    nuniforms = (sweep == SWEEP_UNIFORMS) ? value : 0,
+    ntextures = (sweep == SWEEP_TEXTURES) ? value : 0,
+    ndraws = (sweep == SWEEP_DRAWS || sweep == SWEEP_STREAM) ? value : options.draws;
+
+  scene_t scene;
+  scene_create(scene,nattribs,nuniforms,ntextures);
+
+  uint64_t elapsed = 0, words = 0;
+
+  for(unsigned int frame = 0,nframes = options.warmup + options.frames;frame < nframes;++frame) {
+    if(frame == options.warmup) {
+      glResetDrawProfileRSX();
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    drain();
+
+    struct hostgcm_stats_t before, after;
+    hostgcm_get_stats(&before);
+
+    const uint64_t t0 = now_ns();
+    for(unsigned int i = 0;i < ndraws;++i) {
+      scene_draw(scene,sweep,i);
+    }
+    const uint64_t t1 = now_ns();
+
+    drain();
+    hostgcm_get_stats(&after);
+
+    if(frame >= options.warmup) {
+      elapsed += t1 - t0;
+      words += after.words - before.words;
+    }
+
+    eglSwapBuffers(dpy,surface);
+  }
+
+  const double draws = (double)ndraws * options.frames;
+  printf("%-9s %6u %7u %10.1f %8.1f",sweeps[sweep].name,value,ndraws,(double)elapsed / draws,(double)words / draws);
+
+  GLuint64 enabled = 0;
+  glGetDrawProfileui64vRSX(GL_DRAW_PROFILE_ENABLED_RSX,&enabled);
+  if(enabled) {
+    GLuint64 ndrawn = 0;
+    glGetDrawProfileui64vRSX(GL_DRAW_PROFILE_DRAWS_RSX,&ndrawn);
+    for(size_t i = 0;i < nprofile_steps;++i) {
+      GLuint64 t = 0;
+      glGetDrawProfileui64vRSX(profile_steps[i],&t);
+      printf(" %8.1f",ndrawn ? (double)t / (double)ndrawn : 0.0);
+    }
+  }
+  printf("\n");
+  fflush(stdout);
+
+  scene_destroy(scene);
+
+  const GLenum e = glGetError();
+  if(e != GL_NO_ERROR) {
+    fprintf(stderr,"%s %u: GL error %x\n",sweeps[sweep].name,value,e);
+  }
+}
+
+static void
+usage(const char * argv0)
+{
+  fprintf(stderr,
+	  "usage: %s [-f frames] [-w warmup frames] [-n draws per frame] [-s sweep]...\n"
+	  "sweeps: draws stream attribs uniforms textures (default: all)\n"
+	  "-n sets the number of draws per frame for the sweeps that don't vary it (default 100)\n",
+	  argv0);
+}
+
+int
+main(int argc,char ** argv)
+{
+  options_t options;
+  options.frames = 20;
+  options.warmup = 3;
+  options.draws = 100;
+  bool any = false;
+  for(size_t i = 0;i < MAX_SWEEPS;++i) options.sweep[i] = false;
+
+  int c;
+  while((c = getopt(argc,argv,"f:w:n:s:h")) != -1) {
+    switch(c) {
+    case 'f':
+      options.frames = strtoul(optarg,0,10);
+      break;
+    case 'w':
+      options.warmup = strtoul(optarg,0,10);
+      break;
+    case 'n':
+      options.draws = strtoul(optarg,0,10);
+      break;
+    case 's':
+      {
+	size_t i = 0;
+	for(;i < MAX_SWEEPS && strcmp(optarg,sweeps[i].name) != 0;++i) {}
+	if(i == MAX_SWEEPS) {
+	  usage(argv[0]);
+	  return 1;
+	}
+	options.sweep[i] = true;
+	any = true;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(options.frames == 0 || options.draws == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(!any) {
+    for(size_t i = 0;i < MAX_SWEEPS;++i) options.sweep[i] = true;
+  }
+
+  // Same setup as the samples:
+  dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  EGLint major = 0, minor = 0;
+  if(dpy == EGL_NO_DISPLAY || !eglInitialize(dpy,&major,&minor)) {
+    fprintf(stderr,"eglInitialize failed: %x\n",eglGetError());
+    return 1;
+  }
+
+  const EGLint attribs[] = {
+    EGL_RED_SIZE,8,
+    EGL_BLUE_SIZE,8,
+    EGL_GREEN_SIZE,8,
+    EGL_ALPHA_SIZE,8,
+    EGL_DEPTH_SIZE,16,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint nconfig = 0;
+  if(!eglChooseConfig(dpy,attribs,&config,1,&nconfig) || nconfig == 0) {
+    fprintf(stderr,"eglChooseConfig failed: %x\n",eglGetError());
+    return 1;
+  }
+
+  surface = eglCreateWindowSurface(dpy,config,0,0);
+  EGLContext ctx = (surface != EGL_NO_SURFACE) ? eglCreateContext(dpy,config,0,0) : EGL_NO_CONTEXT;
+  if(ctx == EGL_NO_CONTEXT || !eglMakeCurrent(dpy,surface,surface,ctx)) {
+    fprintf(stderr,"couldn't create a context: %x\n",eglGetError());
+    return 1;
+  }
+
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+
+  printf("# %u frames (after %u warmup frames); times are in nanoseconds per draw\n",options.frames,options.warmup);
+  printf("%-9s %6s %7s %10s %8s","sweep","value","draws","ns/draw","words");
+
+  GLuint64 enabled = 0;
+  glGetDrawProfileui64vRSX(GL_DRAW_PROFILE_ENABLED_RSX,&enabled);
+  if(enabled) {
+    printf(" %8s %8s %8s %8s %8s %8s %8s","storage","program","state","attribs","uniforms","textures","commands");
+  }
+  printf("\n");
+
+  for(size_t i = 0;i < MAX_SWEEPS;++i) {
+    if(!options.sweep[i]) continue;
+    for(const unsigned int * value = sweeps[i].values;*value != 0;++value) {
+      run(options,(sweep_type)i,*value);
+    }
+  }
+
+  eglMakeCurrent(dpy,EGL_NO_SURFACE,EGL_NO_SURFACE,EGL_NO_CONTEXT);
+  eglDestroyContext(dpy,ctx);
+  eglDestroySurface(dpy,surface);
+  eglTerminate(dpy);
+  gcmTerminate();
+
+  return 0;
+}
@@ -0,0 +1,420 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// fifodecode.cpp - Host-side decoder for command buffer captures written by libGL when it is
+// configured with RSXGL_CONFIG_fifo_capture_path. Method names are taken from the rules-ng
+// headers in src/nvfx, which are read at run time. Reports how often each method was sent,
+// how many words each draw call cost, and how many writes left a method's value unchanged.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(RSXGL_FIFODECODE_DATADIR)
+#define RSXGL_FIFODECODE_DATADIR "."
+#endif
+
+// Method names for one class of object, keyed by method offset:
+typedef std::map< uint32_t, std::string > method_names_type;
+
+static const uint32_t nsubchannels = 8;
+
+// Which class prefix is bound to each subchannel. libgcm binds the 3D object to subchannel 0, and
+// RSXGL uses subchannel 1 for memory-to-memory copies; anything else can be set with -s:
+static std::string subchannel_prefixes[nsubchannels] = {
+  "NV30_3D_", "NV03_M2MF_", "", "", "", "", "", ""
+};
+
+static method_names_type subchannel_names[nsubchannels];
+
+// The M2MF object's header isn't in src/nvfx; these are the methods RSXGL uses:
+static const struct { uint32_t method; const char * name; } m2mf_methods[] = {
+  { 0x180, "NV03_M2MF_DMA_NOTIFY" },
+  { 0x184, "NV03_M2MF_DMA_BUFFER_IN" },
+  { 0x188, "NV03_M2MF_DMA_BUFFER_OUT" },
+  { 0x30c, "NV03_M2MF_OFFSET_IN" },
+  { 0x310, "NV03_M2MF_OFFSET_OUT" },
+  { 0x314, "NV03_M2MF_PITCH_IN" },
+  { 0x318, "NV03_M2MF_PITCH_OUT" },
+  { 0x31c, "NV03_M2MF_LINE_LENGTH_IN" },
+  { 0x320, "NV03_M2MF_LINE_COUNT" },
+  { 0x324, "NV03_M2MF_FORMAT" },
+  { 0x328, "NV03_M2MF_BUF_NOTIFY" },
+  { 0, 0 }
+};
+
+// Methods below 0x100 are handled by the channel itself, whichever object is bound:
+static const struct { uint32_t method; const char * name; } channel_methods[] = {
+  { 0x50, "NV406E_REFERENCE" },
+  { 0x60, "NV406E_SEMAPHORE_CONTEXT_DMA" },
+  { 0x64, "NV406E_SEMAPHORE_OFFSET" },
+  { 0x68, "NV406E_SEMAPHORE_ACQUIRE" },
+  { 0x6c, "NV406E_SEMAPHORE_RELEASE" },
+  { 0, 0 }
+};
+
+// 3D methods that do something each time they're written, so that writing the same value twice
+// isn't redundant:
+static const char * side_effect_methods[] = {
+  "NV30_3D_VERTEX_BEGIN_END",
+  "NV30_3D_VB_ELEMENT_U16",
+  "NV30_3D_VB_ELEMENT_U32",
+  "NV30_3D_VB_VERTEX_BATCH",
+  "NV30_3D_VB_INDEX_BATCH",
+  "NV30_3D_CLEAR_BUFFERS",
+  "NV40_3D_VTX_CACHE_INVALIDATE",
+  "NV40_3D_TEX_CACHE_CTL",
+  "NV30_3D_VP_UPLOAD_INST",
+  "NV30_3D_VP_UPLOAD_CONST",
+  "NV30_3D_VP_UPLOAD_FROM_ID",
+  "NV30_3D_VP_UPLOAD_CONST_ID",
+  0
+};
+
+static void
+usage()
+{
+  std::cerr << "Usage: rsxgl-fifodecode [options] capture\n" << std::endl;
+  std::cerr << "Options\n" << std::endl;
+  std::cerr << "\t-d <dir>\tRead nv30-40_3d.xml.h and nv01_2d.xml.h from <dir> (default: " RSXGL_FIFODECODE_DATADIR ")\n" << std::endl;
+  std::cerr << "\t-s <n>=<prefix>\tNames for subchannel <n> come from methods starting with <prefix>\n" << std::endl;
+  std::cerr << "\t-t\t\tPrint every method as it is decoded\n" << std::endl;
+}
+
+static bool
+parse_hex(const std::string & s,uint32_t & value)
+{
+  char * end = 0;
+  value = strtoul(s.c_str(),&end,0);
+  return end != s.c_str() && *end == 0;
+}
+
+// rules-ng headers put each method at the start of a paragraph, followed by the masks and values
+// of its fields. Arrays are written as function-like macros, with their lengths given by __LEN:
+static bool
+read_header(const std::string & path,std::map< std::string, uint32_t > & methods)
+{
+  std::ifstream in(path.c_str());
+  if(!in) {
+    std::cerr << "rsxgl-fifodecode: cannot read " << path << std::endl;
+    return false;
+  }
+
+  struct array_t {
+    std::string name;
+    uint32_t base, stride0, stride1;
+    bool two_dimensional;
+  };
+
+  std::vector< array_t > arrays;
+  std::map< std::string, uint32_t > lengths;
+
+  bool paragraph = true;
+  std::string line;
+  while(std::getline(in,line)) {
+    if(line.find_first_not_of(" \t\r") == std::string::npos) {
+      paragraph = true;
+      continue;
+    }
+
+    const bool first = paragraph;
+    paragraph = false;
+
+    if(line.compare(0,8,"#define ") != 0) continue;
+
+    std::istringstream fields(line.substr(8));
+    std::string name;
+    fields >> name;
+
+    const size_t lparen = name.find('(');
+    if(lparen == std::string::npos) {
+      std::string value;
+      fields >> value;
+
+      uint32_t x = 0;
+      if(!parse_hex(value,x)) continue;
+
+      const size_t len = name.rfind("__LEN");
+      if(len != std::string::npos && len + 5 == name.size()) {
+	lengths[name.substr(0,len)] = x;
+      }
+      else if(first && name.find("__") == std::string::npos) {
+	methods.insert(std::make_pair(name,x));
+      }
+    }
+    else {
+      // (0x00000400 + 0x10*(i0) + 0x4*(i1))
+      std::string expression;
+      std::getline(fields,expression);
+
+      array_t a;
+      a.name = name.substr(0,lparen);
+      a.two_dimensional = name.find("i1") != std::string::npos;
+
+      unsigned int base = 0, stride0 = 0, stride1 = 0;
+      const int n = a.two_dimensional ?
+	sscanf(expression.c_str()," (0x%x + 0x%x*(i0) + 0x%x*(i1))",&base,&stride0,&stride1) :
+	sscanf(expression.c_str()," (0x%x + 0x%x*(i0))",&base,&stride0);
+      if(n != (a.two_dimensional ? 3 : 2)) continue;
+
+      a.base = base;
+      a.stride0 = stride0;
+      a.stride1 = stride1;
+      arrays.push_back(a);
+    }
+  }
+
+  for(std::vector< array_t >::const_iterator it = arrays.begin();it != arrays.end();++it) {
+    const array_t & a = *it;
+
+    std::map< std::string, uint32_t >::const_iterator jt = lengths.find(a.name);
+    const uint32_t n0 = (jt != lengths.end()) ? jt -> second : 1;
+    const uint32_t n1 = a.two_dimensional ? (a.stride0 / a.stride1) : 1;
+
+    for(uint32_t i = 0;i < n0;++i) {
+      for(uint32_t j = 0;j < n1;++j) {
+	std::ostringstream element;
+	element << a.name << '(' << i;
+	if(a.two_dimensional) element << ',' << j;
+	element << ')';
+	methods.insert(std::make_pair(element.str(),a.base + a.stride0 * i + a.stride1 * j));
+      }
+    }
+  }
+
+  return true;
+}
+
+static std::string
+method_name(const uint32_t subchannel,const uint32_t method)
+{
+  const method_names_type & names = subchannel_names[subchannel];
+  method_names_type::const_iterator it = names.find(method);
+  if(it != names.end()) return it -> second;
+
+  std::ostringstream s;
+  s << "SUBC" << subchannel << "_0x" << std::hex << std::setw(4) << std::setfill('0') << method;
+  return s.str();
+}
+
+struct method_stats_t {
+  uint64_t writes, redundant;
+
+  method_stats_t() : writes(0), redundant(0) {}
+};
+
+int
+main(int argc,char ** argv)
+{
+  std::string datadir = RSXGL_FIFODECODE_DATADIR;
+  bool trace = false;
+
+  int c;
+  while((c = getopt(argc,argv,"d:s:th")) != -1) {
+    switch(c) {
+    case 'd':
+      datadir = optarg;
+      break;
+    case 's': {
+      const std::string arg = optarg;
+      const size_t eq = arg.find('=');
+      uint32_t n = 0;
+      if(eq == std::string::npos || !parse_hex(arg.substr(0,eq),n) || n >= nsubchannels) {
+	usage();
+	return 1;
+      }
+      subchannel_prefixes[n] = arg.substr(eq + 1);
+    } break;
+    case 't':
+      trace = true;
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if(optind != (argc - 1)) {
+    usage();
+    return 1;
+  }
+
+  // Method names:
+  std::map< std::string, uint32_t > methods;
+  if(!read_header(datadir + "/nv30-40_3d.xml.h",methods) || !read_header(datadir + "/nv01_2d.xml.h",methods)) {
+    return 1;
+  }
+
+  for(size_t i = 0;m2mf_methods[i].name != 0;++i) {
+    methods.insert(std::make_pair(std::string(m2mf_methods[i].name),m2mf_methods[i].method));
+  }
+
+  // The 3D header has classes named both NV30_3D_ and NV40_3D_:
+  for(std::map< std::string, uint32_t >::const_iterator it = methods.begin();it != methods.end();++it) {
+    for(uint32_t i = 0;i < nsubchannels;++i) {
+      const std::string & prefix = subchannel_prefixes[i];
+      if(prefix.empty()) continue;
+
+      const bool matches =
+	(it -> first.compare(0,prefix.size(),prefix) == 0) ||
+	(prefix == "NV30_3D_" && it -> first.compare(0,8,"NV40_3D_") == 0);
+      if(!matches) continue;
+
+      subchannel_names[i].insert(std::make_pair(it -> second,it -> first));
+    }
+  }
+
+  for(uint32_t i = 0;i < nsubchannels;++i) {
+    for(size_t j = 0;channel_methods[j].name != 0;++j) {
+      subchannel_names[i][channel_methods[j].method] = channel_methods[j].name;
+    }
+  }
+
+  std::vector< bool > side_effects(0x2000 >> 2,false);
+  for(size_t i = 0;side_effect_methods[i] != 0;++i) {
+    const std::string name = side_effect_methods[i];
+    for(std::map< std::string, uint32_t >::const_iterator it = methods.lower_bound(name);it != methods.end() && it -> first.compare(0,name.size(),name) == 0;++it) {
+      if(it -> first.size() == name.size() || it -> first[name.size()] == '(') {
+	side_effects[(it -> second >> 2) & 0x7ff] = true;
+      }
+    }
+  }
+
+  // Read the capture. The PPU wrote it big-endian:
+  std::ifstream in(argv[optind],std::ios::binary);
+  if(!in) {
+    std::cerr << "rsxgl-fifodecode: cannot read " << argv[optind] << std::endl;
+    return 1;
+  }
+
+  std::vector< uint32_t > words;
+  {
+    uint8_t bytes[4];
+    while(in.read((char *)bytes,4)) {
+      words.push_back(((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3]);
+    }
+  }
+
+  // Decode:
+  std::map< std::pair< uint32_t, uint32_t >, method_stats_t > stats;
+  std::vector< uint32_t > last_value[nsubchannels];
+  std::vector< bool > last_valid[nsubchannels];
+  for(uint32_t i = 0;i < nsubchannels;++i) {
+    last_value[i].resize(0x2000 >> 2,0);
+    last_valid[i].resize(0x2000 >> 2,false);
+  }
+
+  uint64_t nheaders = 0, ncontrol = 0, ndata = 0, nredundant = 0;
+
+  // Words per draw are counted from the end of one draw to the end of the next:
+  const uint32_t begin_end = 0x1808;
+  std::vector< uint64_t > draw_words;
+  uint64_t words_since_draw = 0;
+
+  for(size_t i = 0;i < words.size();) {
+    const uint32_t word = words[i];
+
+    // jump, call, return:
+    if((word & 0xe0000003) == 0x20000000 || (word & 0x3) == 0x2 || word == 0x00020000) {
+      if(trace) std::cout << std::setw(8) << i << "  control 0x" << std::hex << std::setw(8) << std::setfill('0') << word << std::dec << std::setfill(' ') << std::endl;
+      ++ncontrol;
+      ++words_since_draw;
+      ++i;
+      continue;
+    }
+
+    const bool increment = (word & 0xe0030003) == 0;
+    const bool non_increment = (word & 0xe0030003) == 0x40000000;
+    if(!increment && !non_increment) {
+      std::cerr << "rsxgl-fifodecode: unrecognized word 0x" << std::hex << word << std::dec << " at " << i << std::endl;
+      ++i;
+      continue;
+    }
+
+    const uint32_t method = word & 0x1ffc, subchannel = (word >> 13) & 0x7, count = (word >> 18) & 0x7ff;
+
+    ++nheaders;
+    ++i;
+
+    if(trace) {
+      std::cout << std::setw(8) << (i - 1) << "  " << method_name(subchannel,method) << (non_increment ? " (ni)" : "") << " x" << count << std::endl;
+    }
+
+    for(uint32_t j = 0;j < count && i < words.size();++j,++i) {
+      const uint32_t m = non_increment ? method : ((method + j * 4) & 0x1ffc);
+      const uint32_t value = words[i];
+      const uint32_t index = m >> 2;
+
+      method_stats_t & s = stats[std::make_pair(subchannel,m)];
+      ++s.writes;
+      ++ndata;
+
+      if(!side_effects[index] && last_valid[subchannel][index] && last_value[subchannel][index] == value && m >= 0x100) {
+	++s.redundant;
+	++nredundant;
+      }
+
+      last_value[subchannel][index] = value;
+      last_valid[subchannel][index] = true;
+
+      if(trace) {
+	std::cout << "\t\t" << method_name(subchannel,m) << " = 0x" << std::hex << std::setw(8) << std::setfill('0') << value << std::dec << std::setfill(' ') << std::endl;
+      }
+    }
+
+    words_since_draw += 1 + count;
+
+    if(subchannel == 0 && method == begin_end && count > 0 && words[i - 1] == 0) {
+      draw_words.push_back(words_since_draw);
+      words_since_draw = 0;
+    }
+  }
+
+  // Report:
+  std::cout << "words: " << words.size() << " (headers: " << nheaders << ", data: " << ndata << ", jump/call/return: " << ncontrol << ")" << std::endl;
+
+  if(!draw_words.empty()) {
+    std::sort(draw_words.begin(),draw_words.end());
+    uint64_t total = 0;
+    for(size_t i = 0;i < draw_words.size();++i) total += draw_words[i];
+
+    std::cout << "draws: " << draw_words.size()
+	      << " words per draw: mean " << std::fixed << std::setprecision(1) << ((double)total / (double)draw_words.size())
+	      << " min " << draw_words.front()
+	      << " median " << draw_words[draw_words.size() / 2]
+	      << " max " << draw_words.back() << std::endl;
+  }
+  else {
+    std::cout << "draws: 0" << std::endl;
+  }
+
+  std::cout << "redundant writes: " << nredundant << " (" << std::fixed << std::setprecision(1) << (words.empty() ? 0.0 : (100.0 * (double)nredundant / (double)words.size())) << "% of words)" << std::endl;
+  std::cout << std::endl;
+
+  // Per-method counts, most frequently written first:
+  std::vector< std::pair< uint64_t, std::pair< uint32_t, uint32_t > > > order;
+  for(std::map< std::pair< uint32_t, uint32_t >, method_stats_t >::const_iterator it = stats.begin();it != stats.end();++it) {
+    order.push_back(std::make_pair(it -> second.writes,it -> first));
+  }
+  std::sort(order.rbegin(),order.rend());
+
+  std::cout << std::setw(10) << "writes" << std::setw(11) << "redundant" << "  method" << std::endl;
+  for(size_t i = 0;i < order.size();++i) {
+    const method_stats_t & s = stats[order[i].second];
+    std::cout << std::setw(10) << s.writes << std::setw(11) << s.redundant << "  " << method_name(order[i].second.first,order[i].second.second) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,581 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// hostgcm.c - Host stand-in for libgcm. RSX local memory is a block of host memory, main
+// memory is "mapped" by recording host address ranges against io offsets, and a thread
+// plays the part of the RSX's command processor: it follows the put register, moving get
+// past each command, and carries out the methods whose effects the library can observe
+// (semaphores, reports, the reference register, flips). Everything else is skipped over.
+
+#include <rsx/gcm_sys.h>
+#include <sysutil/video.h>
+#include <ppu_intrinsics.h>
+#include "hostgcm.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+// Same amount of local memory that the PS3's libgcm reports:
+#define HOSTGCM_LOCAL_SIZE 0x0f900000
+
+#define HOSTGCM_MAX_IO_REGIONS 64
+#define HOSTGCM_IO_ALIGNMENT (1024*1024)
+
+#define HOSTGCM_MAX_LABELS 256
+#define HOSTGCM_MAX_REPORTS 2048
+
+// Methods that the consumer carries out:
+#define HOSTGCM_METHOD_REF 0x50
+#define HOSTGCM_METHOD_SEMAPHORE_OFFSET 0x64
+#define HOSTGCM_METHOD_SEMAPHORE_ACQUIRE 0x68
+#define HOSTGCM_METHOD_SEMAPHORE_RELEASE 0x6c
+#define HOSTGCM_METHOD_3D_SEMAPHORE_OFFSET 0x1d6c
+#define HOSTGCM_METHOD_3D_SEMAPHORE_BACKENDWRITE_RELEASE 0x1d70
+#define HOSTGCM_METHOD_3D_QUERY_GET 0x1800
+
+#define HOSTGCM_FLIP_SUBCHANNEL ((GCM_FLIP_COMMAND >> 13) & 0x7)
+#define HOSTGCM_FLIP_METHOD (GCM_FLIP_COMMAND & 0x1ffc)
+
+struct hostgcm_io_region_t {
+  const uint8_t * address;
+  u32 size, offset;
+};
+
+static struct {
+  // The RSX's own memory:
+  uint8_t * local;
+
+  // Main memory that has been made visible to the RSX:
+  struct hostgcm_io_region_t io[HOSTGCM_MAX_IO_REGIONS];
+  unsigned int nio;
+  u32 io_next;
+  pthread_mutex_t io_mutex;
+
+  gcmContextData context;
+  gcmControlRegister control;
+
+  volatile u32 labels[HOSTGCM_MAX_LABELS * 4] __attribute__((aligned(16)));
+  volatile gcmReportData reports[HOSTGCM_MAX_REPORTS] __attribute__((aligned(16)));
+
+  u32 display_offset[8];
+  volatile u32 flip_status;
+  u32 flip_mode;
+
+  struct hostgcm_stats_t stats;
+  hostgcm_method_callback method_callback;
+  void * method_callback_data;
+
+  pthread_t thread;
+  volatile int running;
+  struct timespec epoch;
+} hostgcm = {
+  .io_mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+//
+static inline u32
+hostgcm_load(volatile u32 * p)
+{
+  return __atomic_load_n(p,__ATOMIC_ACQUIRE);
+}
+
+static inline void
+hostgcm_store(volatile u32 * p,u32 value)
+{
+  __atomic_store_n(p,value,__ATOMIC_RELEASE);
+}
+
+static void
+hostgcm_pause(unsigned int spins)
+{
+  if(spins < 64) {
+    sched_yield();
+  }
+  else {
+    struct timespec ts = { 0, 20000 };
+    nanosleep(&ts,0);
+  }
+}
+
+// Memory:
+static int
+hostgcm_init_local()
+{
+  if(hostgcm.local == 0) {
+    // Pages are only touched as the library uses them:
+    void * p = mmap(0,HOSTGCM_LOCAL_SIZE,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,-1,0);
+    if(p == MAP_FAILED) {
+      return -1;
+    }
+    hostgcm.local = (uint8_t *)p;
+  }
+  return 0;
+}
+
+s32
+gcmMapMainMemory(const void * address,const u32 size,u32 * offset)
+{
+  s32 result = -1;
+
+  pthread_mutex_lock(&hostgcm.io_mutex);
+  if(hostgcm.nio < HOSTGCM_MAX_IO_REGIONS && (((uintptr_t)address) & (HOSTGCM_IO_ALIGNMENT - 1)) == 0) {
+    struct hostgcm_io_region_t * region = hostgcm.io + hostgcm.nio;
+    region -> address = (const uint8_t *)address;
+    region -> size = size;
+    region -> offset = hostgcm.io_next;
+
+    hostgcm.io_next += (size + HOSTGCM_IO_ALIGNMENT - 1) & ~(HOSTGCM_IO_ALIGNMENT - 1);
+    __atomic_store_n(&hostgcm.nio,hostgcm.nio + 1,__ATOMIC_RELEASE);
+
+    *offset = region -> offset;
+    result = 0;
+  }
+  pthread_mutex_unlock(&hostgcm.io_mutex);
+
+  return result;
+}
+
+s32
+gcmAddressToOffset(const void * address,u32 * offset)
+{
+  const uint8_t * p = (const uint8_t *)address;
+
+  if(hostgcm.local != 0 && p >= hostgcm.local && p < (hostgcm.local + HOSTGCM_LOCAL_SIZE)) {
+    *offset = p - hostgcm.local;
+    return 0;
+  }
+
+  const unsigned int nio = __atomic_load_n(&hostgcm.nio,__ATOMIC_ACQUIRE);
+  for(unsigned int i = 0;i < nio;++i) {
+    const struct hostgcm_io_region_t * region = hostgcm.io + i;
+    if(p >= region -> address && p < (region -> address + region -> size)) {
+      *offset = region -> offset + (p - region -> address);
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+s32
+gcmIoOffsetToAddress(u32 offset,void ** address)
+{
+  const unsigned int nio = __atomic_load_n(&hostgcm.nio,__ATOMIC_ACQUIRE);
+  for(unsigned int i = 0;i < nio;++i) {
+    const struct hostgcm_io_region_t * region = hostgcm.io + i;
+    if(offset >= region -> offset && offset < (region -> offset + region -> size)) {
+      *address = (void *)(region -> address + (offset - region -> offset));
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+void
+gcmGetConfiguration(gcmConfiguration * config)
+{
+  hostgcm_init_local();
+
+  config -> localAddress = hostgcm.local;
+  config -> localSize = HOSTGCM_LOCAL_SIZE;
+  config -> ioAddress = hostgcm.nio > 0 ? (void *)hostgcm.io[0].address : 0;
+  config -> ioSize = hostgcm.nio > 0 ? hostgcm.io[0].size : 0;
+  config -> memoryFrequency = 650000000;
+  config -> coreFrequency = 500000000;
+}
+
+gcmControlRegister *
+gcmGetControlRegister(void)
+{
+  return &hostgcm.control;
+}
+
+u32 *
+gcmGetLabelAddress(const u8 index)
+{
+  return (u32 *)(hostgcm.labels + ((u32)index * 4));
+}
+
+gcmReportData *
+gcmGetReportDataAddress(const u32 index)
+{
+  return index < HOSTGCM_MAX_REPORTS ? (gcmReportData *)(hostgcm.reports + index) : 0;
+}
+
+// The command processor:
+static u64
+hostgcm_timer()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (u64)(ts.tv_sec - hostgcm.epoch.tv_sec) * 1000000000ULL + (u64)ts.tv_nsec - (u64)hostgcm.epoch.tv_nsec;
+}
+
+static volatile u32 *
+hostgcm_label(u32 offset)
+{
+  return hostgcm.labels + (((offset >> 2) & ~3) % (HOSTGCM_MAX_LABELS * 4));
+}
+
+struct hostgcm_channel_t {
+  u32 semaphore_offset, semaphore_offset_3d;
+};
+
+// Returns 0 if the consumer was asked to stop while waiting on a semaphore:
+static int
+hostgcm_execute(struct hostgcm_channel_t * channel,u32 subchannel,u32 method,u32 value)
+{
+  if(method < 0x100) {
+    switch(method) {
+    case HOSTGCM_METHOD_REF:
+      hostgcm_store(&hostgcm.control.ref,value);
+      break;
+    case HOSTGCM_METHOD_SEMAPHORE_OFFSET:
+      channel -> semaphore_offset = value;
+      break;
+    case HOSTGCM_METHOD_SEMAPHORE_ACQUIRE:
+      {
+	volatile u32 * label = hostgcm_label(channel -> semaphore_offset);
+	++hostgcm.stats.acquires;
+	if(hostgcm_load(label) != value) {
+	  ++hostgcm.stats.acquire_waits;
+	  for(unsigned int spins = 0;hostgcm_load(label) != value;++spins) {
+	    if(!hostgcm.running) return 0;
+	    hostgcm_pause(spins);
+	  }
+	}
+      }
+      break;
+    case HOSTGCM_METHOD_SEMAPHORE_RELEASE:
+      ++hostgcm.stats.releases;
+      hostgcm_store(hostgcm_label(channel -> semaphore_offset),value);
+      break;
+    default:
+      break;
+    }
+  }
+  else if(subchannel == 0) {
+    switch(method) {
+    case HOSTGCM_METHOD_3D_SEMAPHORE_OFFSET:
+      channel -> semaphore_offset_3d = value;
+      break;
+    case HOSTGCM_METHOD_3D_SEMAPHORE_BACKENDWRITE_RELEASE:
+      // The backend writes its value with the first and third bytes exchanged:
+      ++hostgcm.stats.releases;
+      hostgcm_store(hostgcm_label(channel -> semaphore_offset_3d),(value & 0xff00ff00) | ((value >> 16) & 0xff) | ((value & 0xff) << 16));
+      break;
+    case HOSTGCM_METHOD_3D_QUERY_GET:
+      {
+	// Nothing is rasterized, so sample counts are always zero:
+	const u32 index = (value & 0x00ffffff) >> 4;
+	if(index < HOSTGCM_MAX_REPORTS) {
+	  ++hostgcm.stats.reports;
+	  hostgcm.reports[index].value = 0;
+	  hostgcm.reports[index].zero = 0;
+	  __atomic_store_n(&hostgcm.reports[index].timer,hostgcm_timer(),__ATOMIC_RELEASE);
+	}
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  else if(subchannel == HOSTGCM_FLIP_SUBCHANNEL && method == HOSTGCM_FLIP_METHOD) {
+    ++hostgcm.stats.flips;
+    hostgcm_store(&hostgcm.flip_status,0);
+  }
+
+  if(hostgcm.method_callback != 0) {
+    (*hostgcm.method_callback)(hostgcm.method_callback_data,subchannel,method,value);
+  }
+
+  return 1;
+}
+
+static void *
+hostgcm_thread(void * arg)
+{
+  struct hostgcm_channel_t channel = { 0, 0 };
+  u32 return_offset = 0;
+  unsigned int spins = 0;
+
+  while(hostgcm.running) {
+    u32 get = hostgcm_load(&hostgcm.control.get);
+    const u32 put = hostgcm_load(&hostgcm.control.put);
+
+    if(get == put) {
+      hostgcm_pause(spins++);
+      continue;
+    }
+    spins = 0;
+
+    // Process commands up until put, publishing get after each one:
+    while(get != put && hostgcm.running) {
+      u32 * p = 0;
+      if(gcmIoOffsetToAddress(get,(void **)&p) != 0) {
+	fprintf(stderr,"hostgcm: get (%x) isn't mapped; stopping\n",get);
+	hostgcm.running = 0;
+	break;
+      }
+
+      const u32 word = *p;
+
+      // jump:
+      if((word & 0xe0000003) == 0x20000000) {
+	++hostgcm.stats.jumps;
+	++hostgcm.stats.words;
+	get = word & 0x1ffffffc;
+      }
+      // call:
+      else if((word & 0x3) == 0x2) {
+	++hostgcm.stats.calls;
+	++hostgcm.stats.words;
+	return_offset = get + 4;
+	get = word & 0xfffffffc;
+      }
+      // return:
+      else if(word == 0x00020000) {
+	++hostgcm.stats.returns;
+	++hostgcm.stats.words;
+	get = return_offset;
+      }
+      // method header, incrementing or not:
+      else if((word & 0xa0030003) == 0) {
+	const u32 subchannel = (word >> 13) & 0x7, method = word & 0x1ffc, count = (word >> 18) & 0x7ff;
+	const u32 increment = (word & 0x40000000) ? 0 : 4;
+
+	++hostgcm.stats.headers;
+	for(u32 i = 0;i < count;++i) {
+	  if(!hostgcm_execute(&channel,subchannel,method + i * increment,p[1 + i])) break;
+	}
+	hostgcm.stats.methods += count;
+	hostgcm.stats.words += count + 1;
+	get += (count + 1) * 4;
+      }
+      else {
+	++hostgcm.stats.invalid;
+	++hostgcm.stats.words;
+	get += 4;
+      }
+
+      hostgcm_store(&hostgcm.control.get,get);
+    }
+  }
+
+  return 0;
+}
+
+// Called when the command buffer set up by gcmInitBodyEx fills up. Jump back to its beginning,
+// once the consumer has finished with everything in it. It's drained up to the jump first;
+// otherwise a consumer that hadn't yet moved away from the beginning would look like one that
+// had already come back around to it:
+static s32
+hostgcm_callback(gcmContextData * context,u32 count)
+{
+  u32 begin = 0, current = 0;
+  gcmAddressToOffset(context -> begin,&begin);
+  gcmAddressToOffset(context -> current,&current);
+
+  __sync();
+  hostgcm_store(&hostgcm.control.put,current);
+  for(unsigned int spins = 0;hostgcm_load(&hostgcm.control.get) != current && hostgcm.running;++spins) {
+    hostgcm_pause(spins);
+  }
+
+  *context -> current = 0x20000000 | begin;
+  __sync();
+  hostgcm_store(&hostgcm.control.put,begin);
+  for(unsigned int spins = 0;hostgcm_load(&hostgcm.control.get) != begin && hostgcm.running;++spins) {
+    hostgcm_pause(spins);
+  }
+
+  context -> current = context -> begin;
+  return 0;
+}
+
+s32
+gcmInitBodyEx(gcmContextData * ATTRIBUTE_PRXPTR * ctx,const u32 cmdSize,const u32 ioSize,const void * ioAddress)
+{
+  *ctx = 0;
+
+  if(hostgcm.running || hostgcm_init_local() != 0 || cmdSize > ioSize) {
+    return -1;
+  }
+
+  u32 offset = 0;
+  if(gcmMapMainMemory(ioAddress,ioSize,&offset) != 0) {
+    return -1;
+  }
+
+  gcmContextData * context = &hostgcm.context;
+  context -> begin = (u32 *)ioAddress;
+  context -> current = context -> begin;
+  // Leave room for the jump back to the beginning:
+  context -> end = context -> begin + (cmdSize / sizeof(u32)) - 1;
+  context -> callback = hostgcm_callback;
+
+  hostgcm.control.put = offset;
+  hostgcm.control.get = offset;
+  hostgcm.control.ref = 0xffffffff;
+
+  memset((void *)hostgcm.labels,0,sizeof(hostgcm.labels));
+  memset((void *)hostgcm.reports,0,sizeof(hostgcm.reports));
+  clock_gettime(CLOCK_MONOTONIC,&hostgcm.epoch);
+
+  hostgcm.running = 1;
+  if(pthread_create(&hostgcm.thread,0,hostgcm_thread,0) != 0) {
+    hostgcm.running = 0;
+    return -1;
+  }
+
+  *ctx = context;
+  return 0;
+}
+
+s32
+gcmInitBody(gcmContextData * ATTRIBUTE_PRXPTR * ctx,const u32 cmdSize,const u32 ioSize,const void * ioAddress)
+{
+  return gcmInitBodyEx(ctx,cmdSize,ioSize,ioAddress);
+}
+
+void
+gcmTerminate(void)
+{
+  if(hostgcm.running) {
+    hostgcm.running = 0;
+    pthread_join(hostgcm.thread,0);
+  }
+}
+
+// Display:
+s32
+gcmSetDisplayBuffer(const u8 bufferId,const u32 offset,const u32 pitch,const u32 width,const u32 height)
+{
+  if(bufferId >= 8) return -1;
+  hostgcm.display_offset[bufferId] = offset;
+  return 0;
+}
+
+void
+gcmSetFlipMode(const u32 mode)
+{
+  hostgcm.flip_mode = mode;
+}
+
+void
+gcmResetFlipStatus(void)
+{
+  hostgcm_store(&hostgcm.flip_status,1);
+}
+
+u32
+gcmGetFlipStatus(void)
+{
+  return hostgcm_load(&hostgcm.flip_status);
+}
+
+s32
+gcmSetFlip(gcmContextData * ctx,const u8 bufferId)
+{
+  if((ctx -> current + 2) > ctx -> end) {
+    if((*ctx -> callback)(ctx,2) != 0) return -1;
+  }
+  ctx -> current[0] = (1 << 18) | GCM_FLIP_COMMAND;
+  ctx -> current[1] = bufferId;
+  ctx -> current += 2;
+  return 0;
+}
+
+// Flips take effect as soon as the consumer reaches them, so there's nothing to wait for:
+void
+gcmSetWaitFlip(gcmContextData * ctx)
+{
+}
+
+// Video:
+static u8
+hostgcm_resolution()
+{
+  const char * s = getenv("HOSTGCM_RESOLUTION");
+  if(s != 0) {
+    const int r = atoi(s);
+    if(r == 1080) return VIDEO_RESOLUTION_1080;
+    if(r == 576) return VIDEO_RESOLUTION_576;
+    if(r == 480) return VIDEO_RESOLUTION_480;
+  }
+  return VIDEO_RESOLUTION_720;
+}
+
+s32
+videoGetState(s32 videoOut,s32 deviceIndex,videoState * state)
+{
+  memset(state,0,sizeof(videoState));
+  state -> displayMode.resolution = hostgcm_resolution();
+  state -> displayMode.aspect = VIDEO_ASPECT_16_9;
+  return 0;
+}
+
+s32
+videoGetResolution(s32 resolutionId,videoResolution * resolution)
+{
+  switch(resolutionId) {
+  case VIDEO_RESOLUTION_1080:
+    resolution -> width = 1920; resolution -> height = 1080;
+    return 0;
+  case VIDEO_RESOLUTION_720:
+    resolution -> width = 1280; resolution -> height = 720;
+    return 0;
+  case VIDEO_RESOLUTION_576:
+    resolution -> width = 720; resolution -> height = 576;
+    return 0;
+  case VIDEO_RESOLUTION_480:
+    resolution -> width = 720; resolution -> height = 480;
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+s32
+videoConfigure(s32 videoOut,videoConfiguration * config,void * option,s32 blocking)
+{
+  return 0;
+}
+
+// Extras:
+void
+hostgcm_get_stats(struct hostgcm_stats_t * stats)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  *stats = hostgcm.stats;
+}
+
+void
+hostgcm_reset_stats(void)
+{
+  hostgcm_finish();
+  memset(&hostgcm.stats,0,sizeof(hostgcm.stats));
+}
+
+void
+hostgcm_finish(void)
+{
+  for(unsigned int spins = 0;hostgcm.running && hostgcm_load(&hostgcm.control.get) != hostgcm_load(&hostgcm.control.put);++spins) {
+    hostgcm_pause(spins);
+  }
+}
+
+void
+hostgcm_set_method_callback(hostgcm_method_callback callback,void * data)
+{
+  hostgcm_finish();
+  hostgcm.method_callback_data = data;
+  hostgcm.method_callback = callback;
+}
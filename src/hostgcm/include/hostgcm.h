@@ -0,0 +1,50 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// hostgcm.h - Functions specific to the host stand-in for libgcm, for programs that
+// want to inspect what the "RSX" has been asked to do.
+
+#ifndef rsxgl_hostgcm_H
+#define rsxgl_hostgcm_H
+
+#include <rsx/gcm_sys.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counters kept by the thread that consumes the command buffer:
+struct hostgcm_stats_t {
+  // Every word that get moved past, including jumps, calls and returns:
+  u64 words;
+
+  // Method headers, and the method data that followed them:
+  u64 headers, methods;
+
+  u64 jumps, calls, returns;
+
+  // Semaphore acquires, and how many of them had to wait for their label:
+  u64 acquires, acquire_waits;
+  u64 releases, reports, flips;
+
+  // Words that didn't decode as anything; the consumer skips over them:
+  u64 invalid;
+};
+
+void hostgcm_get_stats(struct hostgcm_stats_t * stats);
+void hostgcm_reset_stats(void);
+
+// Block until the consumer has caught up with the put register:
+void hostgcm_finish(void);
+
+// Called for every method the consumer executes, after the stand-in's own handling of it:
+typedef void (*hostgcm_method_callback)(void * data,u32 subchannel,u32 method,u32 value);
+void hostgcm_set_method_callback(hostgcm_method_callback callback,void * data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
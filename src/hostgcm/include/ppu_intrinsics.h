@@ -0,0 +1,38 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// ppu_intrinsics.h - Host versions of the PPU intrinsics that RSXGL uses.
+
+#ifndef rsxgl_hostgcm_ppu_intrinsics_H
+#define rsxgl_hostgcm_ppu_intrinsics_H
+
+#include <stdint.h>
+#include <time.h>
+
+// The PPU's time base ticks at 79.8MHz; keep that rate so that intervals the library
+// computes from it (e.g., the autoflush timeout) mean the same thing on the host:
+#define HOSTGCM_TIMEBASE_FREQUENCY 79800000ULL
+
+static inline uint64_t
+__mftb(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ((uint64_t)ts.tv_sec * HOSTGCM_TIMEBASE_FREQUENCY) + (((uint64_t)ts.tv_nsec * (HOSTGCM_TIMEBASE_FREQUENCY / 100000ULL)) / 10000ULL);
+}
+
+static inline void
+__sync(void)
+{
+  __sync_synchronize();
+}
+
+static inline void
+__lwsync(void)
+{
+  __sync_synchronize();
+}
+
+#endif
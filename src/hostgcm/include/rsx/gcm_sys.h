@@ -0,0 +1,102 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// rsx/gcm_sys.h - Host stand-in for the parts of PSL1GHT's libgcm that RSXGL uses.
+
+#ifndef rsxgl_hostgcm_gcm_sys_H
+#define rsxgl_hostgcm_gcm_sys_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Library code tests this to pick host versions of the few things that can't be
+// expressed in terms of the gcm API (e.g., calling the context's callback):
+#define RSXGL_HOSTGCM 1
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+// Pointers handed out by the PS3's PRX modules are 32 bits wide. On the host they're
+// just pointers:
+#ifndef ATTRIBUTE_PRXPTR
+#define ATTRIBUTE_PRXPTR
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GCM_FLIP_HSYNC 1
+#define GCM_FLIP_VSYNC 2
+#define GCM_FLIP_HSYNC_AND_BREAK_EVERYTHING 3
+
+#define GCM_LOCATION_RSX 0
+#define GCM_LOCATION_CELL 1
+
+// Method used by gcmSetFlip to ask for a buffer to be displayed:
+#define GCM_FLIP_COMMAND 0xe920
+
+struct _gcmCtxData;
+typedef s32 (*gcmContextCallback)(struct _gcmCtxData *,u32);
+
+typedef struct _gcmCtxData {
+  u32 * begin ATTRIBUTE_PRXPTR;
+  u32 * end ATTRIBUTE_PRXPTR;
+  u32 * current ATTRIBUTE_PRXPTR;
+  gcmContextCallback callback ATTRIBUTE_PRXPTR;
+} gcmContextData;
+
+typedef struct {
+  volatile u32 put;
+  volatile u32 get;
+  volatile u32 ref;
+} gcmControlRegister;
+
+typedef struct {
+  void * localAddress ATTRIBUTE_PRXPTR;
+  void * ioAddress ATTRIBUTE_PRXPTR;
+  u32 localSize;
+  u32 ioSize;
+  u32 memoryFrequency;
+  u32 coreFrequency;
+} gcmConfiguration;
+
+typedef struct {
+  u64 timer;
+  u32 value;
+  u32 zero;
+} gcmReportData;
+
+s32 gcmInitBody(gcmContextData * ATTRIBUTE_PRXPTR * ctx,const u32 cmdSize,const u32 ioSize,const void * ioAddress);
+s32 gcmInitBodyEx(gcmContextData * ATTRIBUTE_PRXPTR * ctx,const u32 cmdSize,const u32 ioSize,const void * ioAddress);
+void gcmTerminate(void);
+
+void gcmGetConfiguration(gcmConfiguration * config);
+gcmControlRegister * gcmGetControlRegister(void);
+u32 * gcmGetLabelAddress(const u8 index);
+gcmReportData * gcmGetReportDataAddress(const u32 index);
+
+s32 gcmAddressToOffset(const void * address,u32 * offset);
+s32 gcmIoOffsetToAddress(u32 offset,void ** address);
+s32 gcmMapMainMemory(const void * address,const u32 size,u32 * offset);
+
+s32 gcmSetDisplayBuffer(const u8 bufferId,const u32 offset,const u32 pitch,const u32 width,const u32 height);
+void gcmSetFlipMode(const u32 mode);
+void gcmResetFlipStatus(void);
+u32 gcmGetFlipStatus(void);
+s32 gcmSetFlip(gcmContextData * ctx,const u8 bufferId);
+void gcmSetWaitFlip(gcmContextData * ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,13 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// rsx/rsx.h - Host stand-in for PSL1GHT's librsx; only the gcm part is provided.
+
+#ifndef rsxgl_hostgcm_rsx_H
+#define rsxgl_hostgcm_rsx_H
+
+#include <rsx/gcm_sys.h>
+
+#endif
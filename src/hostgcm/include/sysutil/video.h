@@ -0,0 +1,69 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// sysutil/video.h - Host stand-in for PSL1GHT's video output configuration.
+
+#ifndef rsxgl_hostgcm_video_H
+#define rsxgl_hostgcm_video_H
+
+#include <rsx/gcm_sys.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIDEO_RESOLUTION_1080 1
+#define VIDEO_RESOLUTION_720 2
+#define VIDEO_RESOLUTION_480 4
+#define VIDEO_RESOLUTION_576 5
+
+#define VIDEO_BUFFER_FORMAT_XRGB 0
+#define VIDEO_BUFFER_FORMAT_XBGR 1
+#define VIDEO_BUFFER_FORMAT_FLOAT 2
+
+#define VIDEO_ASPECT_AUTO 0
+#define VIDEO_ASPECT_4_3 1
+#define VIDEO_ASPECT_16_9 2
+
+typedef struct {
+  u8 resolution;
+  u8 scanMode;
+  u8 conversion;
+  u8 aspect;
+  u8 padding[2];
+  u16 refreshRates;
+} videoDisplayMode;
+
+typedef struct {
+  u8 state;
+  u8 colorSpace;
+  u8 padding[6];
+  videoDisplayMode displayMode;
+} videoState;
+
+typedef struct {
+  u16 width;
+  u16 height;
+} videoResolution;
+
+typedef struct {
+  u8 resolution;
+  u8 format;
+  u8 aspect;
+  u8 padding[9];
+  u32 pitch;
+} videoConfiguration;
+
+// The stand-in always reports a 720p display; set HOSTGCM_RESOLUTION to 1080, 576 or 480 to
+// pretend otherwise.
+s32 videoGetState(s32 videoOut,s32 deviceIndex,videoState * state);
+s32 videoGetResolution(s32 resolutionId,videoResolution * resolution);
+s32 videoConfigure(s32 videoOut,videoConfiguration * config,void * option,s32 blocking);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
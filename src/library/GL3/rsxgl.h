@@ -17,13 +17,23 @@
 extern "C" {
 #endif
 
-/* Set shared-memory size and command buffer length: */
+/* Set shared-memory size and command buffer length. The initial command buffer is command_buffer_length
+   words long; the rest of the shared memory is divided into further command buffer segments that are each
+   command_segment_length words long. More segments are created as needed.
+
+   swap_queue_length is the number of frames that eglSwapBuffers lets the CPU queue up ahead of the RSX;
+   window surfaces get one more color buffer than this (so 2 gives triple buffering). eglSwapBuffers gives
+   up waiting for the oldest frame after max_swap_wait_iterations * swap_wait_interval microseconds, or
+   never if max_swap_wait_iterations is 0.
+*/
 struct rsxgl_init_parameters_t {
   khronos_usize_t gcm_buffer_size;
   khronos_usize_t command_buffer_length;
   uint32_t max_swap_wait_iterations;
   useconds_t swap_wait_interval;
   uint32_t rsx_mspace_offset, rsx_mspace_size;
+  khronos_usize_t command_segment_length;
+  uint32_t swap_queue_length;
 };
 
 /*! \brief Customize the resources that RSXGL allocates upon initialization. Call this, optionally, before
@@ -7,6 +7,11 @@
 #include "arena.h"
 #include "rsxgl_context.h"
 #include "gl_object_storage.h"
+#include "timestamp.h"
+#include "tlsf.h"
+#include "migrate.h"
+#include "texture_migrate.h"
+#include "rsxgl_config.h"
 
 #include <GL3/gl3.h>
 #include "GL3/rsxgl3ext.h"
@@ -17,6 +22,8 @@
 #include <stddef.h>
 #include <malloc.h>
 
+#include "util/u_format.h"
+
 #if defined(GLAPI)
 #undef GLAPI
 #endif
@@ -27,10 +34,72 @@ memory_arena_t::storage_type & memory_arena_t::storage()
   return current_object_ctx() -> arena_storage();
 }
 
+// Allocators that arenas can use:
+static void *
+rsxgl_arena_tlsf_memalign(memory_arena_t * arena,rsx_size_t align,rsx_size_t size)
+{
+  const uint32_t offset = rsxgl_tlsf_memalign((rsxgl_tlsf_t *)arena -> user_data,align,size);
+  return (offset == RSXGL_TLSF_NONE) ? 0 : ((uint8_t *)arena -> address + offset);
+}
+
+static void
+rsxgl_arena_tlsf_free(memory_arena_t * arena,void * address)
+{
+  rsxgl_tlsf_free((rsxgl_tlsf_t *)arena -> user_data,(uint8_t *)address - (uint8_t *)arena -> address);
+}
+
+static void
+rsxgl_arena_tlsf_destroy(memory_arena_t * arena)
+{
+  rsxgl_tlsf_destroy((rsxgl_tlsf_t *)arena -> user_data);
+}
+
+static void *
+rsxgl_arena_mspace_memalign(memory_arena_t * arena,rsx_size_t align,rsx_size_t size)
+{
+  void * address = mspace_memalign((mspace)arena -> user_data,align,size);
+  if(address != 0) rsxgl_memory_stats_allocate(&arena -> stats,mspace_usable_size(address));
+  return address;
+}
+
+static void
+rsxgl_arena_mspace_free(memory_arena_t * arena,void * address)
+{
+  rsxgl_memory_stats_free(&arena -> stats,mspace_usable_size(address));
+  mspace_free((mspace)arena -> user_data,address);
+}
+
+static void
+rsxgl_arena_mspace_destroy(memory_arena_t * arena)
+{
+  destroy_mspace((mspace)arena -> user_data);
+}
+
+static void *
+rsxgl_arena_rsx_heap_memalign(memory_arena_t *,rsx_size_t align,rsx_size_t size)
+{
+  return rsxgl_rsx_memalign(align,size);
+}
+
+static void
+rsxgl_arena_rsx_heap_free(memory_arena_t *,void * address)
+{
+  rsxgl_rsx_free(address);
+}
+
+void
+rsxgl_arena_init_rsx_heap(memory_arena_t & arena)
+{
+  arena.user_data = 0;
+  arena.memalign_fn = rsxgl_arena_rsx_heap_memalign;
+  arena.free_fn = rsxgl_arena_rsx_heap_free;
+  arena.destroy_fn = 0;
+}
+
 memory_t
 rsxgl_arena_allocate(memory_arena_t & arena,rsx_size_t align,rsx_size_t size,void * * address)
 {
-  void * addr = mspace_memalign(arena.space,align,size);
+  void * addr = arena.memalign_fn(&arena,align,size);
 
   if(addr == 0) {
     return memory_t();
@@ -44,7 +113,226 @@ rsxgl_arena_allocate(memory_arena_t & arena,rsx_size_t align,rsx_size_t size,voi
 void
 rsxgl_arena_free(struct memory_arena_t & arena,const struct memory_t & memory)
 {
-  mspace_free(arena.space,rsxgl_arena_address(arena,memory));
+  arena.free_fn(&arena,rsxgl_arena_address(arena,memory));
+}
+
+void
+rsxgl_arena_free_deferred(rsxgl_context_t * ctx,const memory_arena_t::name_type arena,const memory_t & memory,const uint64_t timestamp)
+{
+  if(!memory) return;
+
+  if(timestamp == 0 || rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp)) {
+    rsxgl_arena_free(memory_arena_t::storage().at(arena),memory);
+  }
+  else {
+    ctx -> deferred_frees.push_back(rsxgl_deferred_free_t(arena,memory,timestamp));
+    ++memory_arena_t::storage().at(arena).deferred_frees;
+  }
+}
+
+// Free whatever deferred memory the RSX has finished with. Doesn't wait:
+void
+rsxgl_arena_reclaim(rsxgl_context_t * ctx)
+{
+  std::vector< rsxgl_deferred_free_t > & deferred_frees = ctx -> deferred_frees;
+
+  for(size_t i = 0;i < deferred_frees.size();) {
+    if(rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,deferred_frees[i].timestamp)) {
+      memory_arena_t & arena = memory_arena_t::storage().at(deferred_frees[i].arena);
+      rsxgl_arena_free(arena,deferred_frees[i].memory);
+      --arena.deferred_frees;
+      deferred_frees[i] = deferred_frees.back();
+      deferred_frees.pop_back();
+    }
+    else {
+      ++i;
+    }
+  }
+}
+
+// Wait for the RSX to finish with all of a context's deferred frees, and free them. Called as
+// the context is destroyed, so the arenas are found through its own object context:
+void
+rsxgl_arena_release_deferred(rsxgl_context_t * ctx)
+{
+  std::vector< rsxgl_deferred_free_t > & deferred_frees = ctx -> deferred_frees;
+  if(deferred_frees.empty()) return;
+
+  uint64_t timestamp = 0;
+  for(size_t i = 0;i < deferred_frees.size();++i) {
+    timestamp = std::max(timestamp,deferred_frees[i].timestamp);
+  }
+  rsxgl_timestamp_wait(ctx,timestamp,RSXGL_STALL_BUFFER_DELETE);
+
+  memory_arena_t::storage_type & arenas = ctx -> object_context() -> arena_storage();
+  for(size_t i = 0;i < deferred_frees.size();++i) {
+    memory_arena_t & arena = arenas.at(deferred_frees[i].arena);
+    rsxgl_arena_free(arena,deferred_frees[i].memory);
+    --arena.deferred_frees;
+  }
+
+  std::vector< rsxgl_deferred_free_t >().swap(deferred_frees);
+}
+
+// Allocate from an arena; if it's full, wait for the deferred frees from that arena, oldest
+// first, until there's room:
+memory_t
+rsxgl_arena_allocate_reclaim(rsxgl_context_t * ctx,const memory_arena_t::name_type arena,rsx_size_t align,rsx_size_t size,void * * address)
+{
+  rsxgl_arena_reclaim(ctx);
+
+  memory_t memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),align,size,address);
+
+  while(!memory) {
+    std::vector< rsxgl_deferred_free_t > & deferred_frees = ctx -> deferred_frees;
+
+    size_t oldest = deferred_frees.size();
+    for(size_t i = 0;i < deferred_frees.size();++i) {
+      if(deferred_frees[i].arena == arena && (oldest == deferred_frees.size() || deferred_frees[i].timestamp < deferred_frees[oldest].timestamp)) {
+	oldest = i;
+      }
+    }
+
+    if(oldest == deferred_frees.size()) break;
+
+    rsxgl_timestamp_wait(ctx,deferred_frees[oldest].timestamp,RSXGL_STALL_BUFFER_DATA);
+    rsxgl_arena_reclaim(ctx);
+
+    memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),align,size,address);
+  }
+
+  return memory;
+}
+
+// Compaction. Over a long session the RSX's memory fragments, until a large allocation fails
+// even though there's plenty of room in total. Once a frame, if an arena's largest free block
+// is less than half of its free memory, buffers and textures near the top of it are moved
+// into holes further down, so that the free memory runs together. The RSX does the copying,
+// and no more than RSXGL_CONFIG_compaction_budget bytes are moved per frame.
+struct rsxgl_compaction_candidate_t {
+  memory_arena_t::name_type arena;
+  uint32_t offset, size, name;
+  uint8_t is_texture;
+
+  rsxgl_compaction_candidate_t(const memory_arena_t::name_type _arena,const uint32_t _offset,const uint32_t _size,const uint32_t _name,const uint8_t _is_texture)
+    : arena(_arena), offset(_offset), size(_size), name(_name), is_texture(_is_texture) {
+  }
+
+  // Highest offset first:
+  bool operator <(const rsxgl_compaction_candidate_t & rhs) const {
+    return offset > rhs.offset;
+  }
+};
+
+// Only arenas managed by TLSF can tell how fragmented they are:
+static rsxgl_tlsf_t *
+rsxgl_arena_tlsf(const memory_arena_t & arena)
+{
+  if(arena.memalign_fn == rsxgl_arena_tlsf_memalign) {
+    return (rsxgl_tlsf_t *)arena.user_data;
+  }
+  else if(arena.memalign_fn == rsxgl_arena_rsx_heap_memalign) {
+    return rsxgl_rsx_heap();
+  }
+  else {
+    return 0;
+  }
+}
+
+void
+rsxgl_arena_memory_stats(const memory_arena_t & arena,rsxgl_memory_stats_t & stats)
+{
+  const rsxgl_tlsf_t * tlsf = rsxgl_arena_tlsf(arena);
+  if(tlsf != 0) {
+    rsxgl_tlsf_memory_stats(tlsf,&stats);
+  }
+  else {
+    stats = arena.stats;
+    stats.size = arena.size;
+    rsxgl_mspace_memory_stats((mspace)arena.user_data,&stats);
+  }
+}
+
+static bool
+rsxgl_arena_fragmented(const memory_arena_t::name_type name)
+{
+  memory_arena_t::storage_type & arenas = memory_arena_t::storage();
+  if(!arenas.is_object(name)) return false;
+
+  const rsxgl_tlsf_t * tlsf = rsxgl_arena_tlsf(arenas.at(name));
+  if(tlsf == 0) return false;
+
+  const uint32_t free_size = tlsf -> size - tlsf -> used_size;
+  return ((uint64_t)rsxgl_tlsf_largest_free(tlsf) * 2) < free_size;
+}
+
+void
+rsxgl_arena_compact(rsxgl_context_t * ctx)
+{
+  memory_arena_t::storage_type & arenas = memory_arena_t::storage();
+
+  std::vector< uint8_t > fragmented(arenas.contents_size(),0);
+  bool any = false;
+  for(memory_arena_t::name_type i = 0,n = arenas.contents_size();i < n;++i) {
+    fragmented[i] = rsxgl_arena_fragmented(i);
+    any = any || fragmented[i];
+  }
+  if(!any) return;
+
+  // Storage that can be moved. Anything that the CPU can get at, or whose address has been
+  // baked into a command list, stays put:
+  std::vector< rsxgl_compaction_candidate_t > candidates;
+
+  buffer_t::storage_type & buffers = buffer_t::storage();
+  for(buffer_t::name_type i = 1,n = buffers.contents_size();i < n;++i) {
+    if(!buffers.is_object(i)) continue;
+
+    const buffer_t & buffer = buffers.at(i);
+    if(!buffer.memory || buffer.memory.location != RSXGL_MEMORY_LOCATION_LOCAL || buffer.arena >= fragmented.size() || !fragmented[buffer.arena] ||
+       buffer.mapped != 0 || buffer.pinned || buffer.size > RSXGL_CONFIG_compaction_budget) continue;
+
+    candidates.push_back(rsxgl_compaction_candidate_t(buffer.arena,buffer.memory.offset,buffer.size,i,0));
+  }
+
+  texture_t::storage_type & textures = texture_t::storage();
+  for(texture_t::name_type i = 0,n = textures.contents_size();i < n;++i) {
+    if(!textures.is_object(i)) continue;
+
+    const texture_t & texture = textures.at(i);
+    if(!texture.memory || !texture.memory.owner || texture.memory.location != RSXGL_MEMORY_LOCATION_LOCAL || texture.arena >= fragmented.size() || !fragmented[texture.arena] ||
+       texture.invalid || texture.pinned) continue;
+
+    const uint32_t size = rsxgl_texture_size(texture);
+    if(size > RSXGL_CONFIG_compaction_budget) continue;
+
+    candidates.push_back(rsxgl_compaction_candidate_t(texture.arena,texture.memory.offset,size,i,1));
+  }
+
+  std::sort(candidates.begin(),candidates.end());
+
+  uint32_t budget = RSXGL_CONFIG_compaction_budget;
+  for(std::vector< rsxgl_compaction_candidate_t >::const_iterator it = candidates.begin(),it_end = candidates.end();it != it_end && budget > 0;++it) {
+    if(it -> size > budget) continue;
+
+    // Only worth it if the new storage is further down than the old:
+    memory_arena_t & arena = arenas.at(it -> arena);
+    const memory_t memory = rsxgl_arena_allocate(arena,128,it -> size);
+    if(!memory) continue;
+
+    if(memory.offset >= it -> offset) {
+      rsxgl_arena_free(arena,memory);
+      continue;
+    }
+
+    if(it -> is_texture) {
+      rsxgl_texture_move(ctx,it -> name,textures.at(it -> name),memory);
+    }
+    else {
+      rsxgl_buffer_move(ctx,it -> name,buffers.at(it -> name),it -> arena,memory);
+    }
+
+    budget -= it -> size;
+  }
 }
 
 static inline size_t
@@ -61,37 +349,69 @@ rsxgl_memory_location(GLenum location)
   }
 }
 
-GLAPI GLuint APIENTRY
-glCreateMemoryArenaRSX(GLenum location,GLsizei align,GLsizei size)
+// Create an arena in RSX memory, or in main memory that's mapped for the RSX. Returns 0 if the
+// memory couldn't be had:
+memory_arena_t::name_type
+rsxgl_arena_create(const uint32_t location,const rsx_size_t align,const rsx_size_t size)
 {
-  const size_t rsx_location = rsxgl_memory_location(location);
-  if(rsx_location == ~0U) RSXGL_ERROR(GL_INVALID_ENUM,0);
+  void * address = 0;
+  uint32_t offset = 0;
 
-  if(location == GL_MAIN_MEMORY_ARENA_RSX && ((align % (1024 * 1024) != 0) || (size % (1024 * 1024) != 0))) {
-    RSXGL_ERROR(GL_INVALID_VALUE,0);
+  if(location == RSXGL_MEMORY_LOCATION_LOCAL) {
+    address = rsxgl_rsx_memalign(align,size);
+    if(address == 0) return 0;
+
+    gcmAddressToOffset(address,&offset);
   }
+  else if(location == RSXGL_MEMORY_LOCATION_MAIN) {
+    address = memalign(align,size);
+    if(address == 0) return 0;
 
-  uint32_t name = memory_arena_t::storage().create_name_and_object();
+    gcmMapMainMemory(address,size,&offset);
+  }
+
+  const memory_arena_t::name_type name = memory_arena_t::storage().create_name_and_object();
   memory_arena_t & arena = memory_arena_t::storage().at(name);
-  uint32_t offset = 0;
 
-  if(rsx_location == RSXGL_MEMORY_LOCATION_LOCAL) {
-    arena.address = rsxgl_rsx_memalign(align,size);
-    if(arena.address == 0) RSXGL_ERROR(GL_OUT_OF_MEMORY,0);
+  arena.address = address;
+  arena.memory.location = location;
+  arena.memory.offset = offset;
+  arena.size = size;
 
-    gcmAddressToOffset(arena.address,&offset);
+  if(location == RSXGL_MEMORY_LOCATION_LOCAL) {
+    arena.user_data = rsxgl_tlsf_create(arena.size);
+    arena.memalign_fn = rsxgl_arena_tlsf_memalign;
+    arena.free_fn = rsxgl_arena_tlsf_free;
+    arena.destroy_fn = rsxgl_arena_tlsf_destroy;
+  }
+  else {
+    arena.user_data = create_mspace_with_base(arena.address,arena.size,0);
+    arena.memalign_fn = rsxgl_arena_mspace_memalign;
+    arena.free_fn = rsxgl_arena_mspace_free;
+    arena.destroy_fn = rsxgl_arena_mspace_destroy;
   }
-  else if(rsx_location == RSXGL_MEMORY_LOCATION_MAIN) {
-    arena.address = memalign(align,size);
-    if(arena.address == 0) RSXGL_ERROR(GL_OUT_OF_MEMORY,0);
 
-    gcmMapMainMemory(arena.address,size,&offset);
+  if(arena.user_data == 0) {
+    arena.destroy_fn = 0;
+    memory_arena_t::storage().destroy(name);
+    return 0;
   }
 
-  arena.memory.location = rsx_location;
-  arena.memory.offset = offset;
-  arena.size = size;
-  arena.space = create_mspace_with_base(arena.address,arena.size,0);
+  return name;
+}
+
+GLAPI GLuint APIENTRY
+glCreateMemoryArenaRSX(GLenum location,GLsizei align,GLsizei size)
+{
+  const size_t rsx_location = rsxgl_memory_location(location);
+  if(rsx_location == ~0U) RSXGL_ERROR(GL_INVALID_ENUM,0);
+
+  if(location == GL_MAIN_MEMORY_ARENA_RSX && ((align % (1024 * 1024) != 0) || (size % (1024 * 1024) != 0))) {
+    RSXGL_ERROR(GL_INVALID_VALUE,0);
+  }
+
+  const memory_arena_t::name_type name = rsxgl_arena_create(rsx_location,align,size);
+  if(name == 0) RSXGL_ERROR(GL_OUT_OF_MEMORY,0);
 
   RSXGL_NOERROR(name);
 }
@@ -99,7 +419,7 @@ glCreateMemoryArenaRSX(GLenum location,GLsizei align,GLsizei size)
 void
 memory_arena_t::destroy()
 {
-  destroy_mspace(space);
+  if(destroy_fn != 0) destroy_fn(this);
 
   if(memory.location == RSXGL_MEMORY_LOCATION_LOCAL) {
     rsxgl_rsx_free(address);
@@ -109,6 +429,18 @@ memory_arena_t::destroy()
   }
 }
 
+struct rsxgl_deferred_free_from {
+  const memory_arena_t::name_type arena;
+
+  rsxgl_deferred_free_from(const memory_arena_t::name_type _arena)
+    : arena(_arena) {
+  }
+
+  bool operator()(const rsxgl_deferred_free_t & deferred_free) const {
+    return deferred_free.arena == arena;
+  }
+};
+
 GLAPI void APIENTRY
 glDeleteMemoryArenaRSX(GLuint name)
 {
@@ -116,6 +448,28 @@ glDeleteMemoryArenaRSX(GLuint name)
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
+  // Memory from this arena that's waiting to be freed goes with it, once the RSX is done with it.
+  // Only this context's deferred frees can be waited for here; if another context still has
+  // some against the arena, it can't be deleted yet:
+  struct rsxgl_context_t * ctx = current_ctx();
+  std::vector< rsxgl_deferred_free_t > & deferred_frees = ctx -> deferred_frees;
+
+  const size_t own = std::count_if(deferred_frees.begin(),deferred_frees.end(),rsxgl_deferred_free_from(name));
+  if(memory_arena_t::storage().at(name).deferred_frees != own) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  for(size_t i = 0;i < deferred_frees.size();) {
+    if(deferred_frees[i].arena == name) {
+      rsxgl_timestamp_wait(ctx,deferred_frees[i].timestamp,RSXGL_STALL_BUFFER_DELETE);
+      deferred_frees[i] = deferred_frees.back();
+      deferred_frees.pop_back();
+    }
+    else {
+      ++i;
+    }
+  }
+
   memory_arena_t::storage().destroy(name);
 
   RSXGL_NOERROR_();
@@ -154,30 +508,153 @@ glUseMemoryArenaRSX(GLenum target,GLuint name)
   ctx -> arena_binding.bind(rsx_target,name);
 }
 
+// Bytes that each kind of object has allocated from an arena. Found by walking the objects,
+// which is slow, but keeps the allocation paths free of bookkeeping:
+static uint32_t
+rsxgl_arena_buffer_memory(const memory_arena_t::name_type name)
+{
+  uint32_t result = 0;
+
+  buffer_t::storage_type & buffers = buffer_t::storage();
+  for(buffer_t::name_type i = 1,n = buffers.contents_size();i < n;++i) {
+    if(!buffers.is_object(i)) continue;
+
+    const buffer_t & buffer = buffers.at(i);
+    if(buffer.memory && buffer.arena == name) result += buffer.size;
+  }
+
+  return result;
+}
+
+static uint32_t
+rsxgl_arena_texture_memory(const memory_arena_t::name_type name)
+{
+  uint32_t result = 0;
+
+  texture_t::storage_type & textures = texture_t::storage();
+  for(texture_t::name_type i = 0,n = textures.contents_size();i < n;++i) {
+    if(!textures.is_object(i)) continue;
+
+    const texture_t & texture = textures.at(i);
+    if(texture.memory && texture.memory.owner && texture.arena == name) result += rsxgl_texture_size(texture);
+  }
+
+  return result;
+}
+
+static uint32_t
+rsxgl_arena_renderbuffer_memory(const memory_arena_t::name_type name)
+{
+  uint32_t result = 0;
+
+  renderbuffer_t::storage_type & renderbuffers = renderbuffer_t::storage();
+  for(renderbuffer_t::name_type i = 1,n = renderbuffers.contents_size();i < n;++i) {
+    if(!renderbuffers.is_object(i)) continue;
+
+    const renderbuffer_t & renderbuffer = renderbuffers.at(i);
+    if(renderbuffer.surface.memory && renderbuffer.arena == name) result += util_format_get_2d_size(renderbuffer.pformat,renderbuffer.surface.pitch,renderbuffer.size[1]);
+  }
+
+  return result;
+}
+
+// Fragment program microcode is allocated from the RSX heap, and so is charged to the default
+// arena:
+static uint32_t
+rsxgl_arena_program_memory(const memory_arena_t::name_type name)
+{
+  if(name != 0) return 0;
+
+  rsxgl_memory_stats_t stats;
+  rsxgl_program_ucode_stats(RSXGL_MEMORY_LOCATION_LOCAL,stats);
+  return stats.allocated;
+}
+
+static inline GLenum
+rsxgl_memory_stats_location(const uint32_t location)
+{
+  return (location == RSXGL_MEMORY_LOCATION_LOCAL) ? GL_GPU_MEMORY_ARENA_RSX : GL_MAIN_MEMORY_ARENA_RSX;
+}
+
 GLAPI void APIENTRY
 glGetMemoryArenaParameterivRSX(GLenum target,GLenum pname,GLint * params)
 {
+  struct rsxgl_context_t * ctx = current_ctx();
+
+  // Which arena the per-object figures come from; ~0 for pools that don't hold objects:
+  memory_arena_t::name_type name = ~0U;
+  GLenum location = GL_GPU_MEMORY_ARENA_RSX;
+  rsxgl_memory_stats_t stats;
+
   const size_t rsx_target = rsxgl_arena_target(target);
-  if(rsx_target == ~0U) {
+  if(rsx_target != ~0U) {
+    memory_arena_t & arena = ctx -> arena_binding[rsx_target];
+
+    name = ctx -> arena_binding.names[rsx_target];
+    location = rsxgl_memory_stats_location(arena.memory.location);
+    rsxgl_arena_memory_stats(arena,stats);
+    stats.size = arena.size;
+  }
+  else if(target == GL_GPU_MEMORY_HEAP_RSX) {
+    name = 0;
+    rsxgl_tlsf_memory_stats(rsxgl_rsx_heap(),&stats);
+  }
+  else if(target == GL_VERTEX_MIGRATE_BUFFER_RSX) {
+    location = rsxgl_memory_stats_location(RSXGL_VERTEX_MIGRATE_BUFFER_LOCATION);
+    rsxgl_vertex_migrate_stats(stats);
+  }
+  else if(target == GL_TEXTURE_MIGRATE_BUFFER_RSX) {
+    location = rsxgl_memory_stats_location(RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION);
+    rsxgl_texture_migrate_stats(stats);
+  }
+  else if(target == GL_VERTEX_PROGRAM_MEMORY_RSX) {
+    location = GL_MAIN_MEMORY_ARENA_RSX;
+    rsxgl_program_ucode_stats(RSXGL_MEMORY_LOCATION_MAIN,stats);
+  }
+  else if(target == GL_FRAGMENT_PROGRAM_MEMORY_RSX) {
+    rsxgl_program_ucode_stats(RSXGL_MEMORY_LOCATION_LOCAL,stats);
+  }
+  else {
     RSXGL_ERROR_(GL_INVALID_ENUM);
   }
 
-  struct rsxgl_context_t * ctx = current_ctx();
-
-  memory_arena_t & arena = ctx -> arena_binding[rsx_target];
-
   if(pname == GL_ARENA_SIZE_RSX) {
-    *params = arena.size;
+    *params = stats.size;
   }
   else if(pname == GL_ARENA_LOCATION_RSX) {
-    if(arena.memory.location == RSXGL_MEMORY_LOCATION_LOCAL) {
-      *params = GL_GPU_MEMORY_ARENA_RSX;
+    *params = location;
+  }
+  else if(pname == GL_ARENA_ALLOCATED_RSX) {
+    *params = stats.allocated;
+  }
+  else if(pname == GL_ARENA_FREE_RSX) {
+    *params = stats.free;
+  }
+  else if(pname == GL_ARENA_LARGEST_FREE_RSX) {
+    *params = stats.largest_free;
+  }
+  else if(pname == GL_ARENA_ALLOCATION_COUNT_RSX) {
+    *params = stats.count;
+  }
+  else if(pname == GL_ARENA_HIGH_WATER_RSX) {
+    *params = stats.high_water;
+  }
+  else if(pname == GL_ARENA_BUFFER_MEMORY_RSX || pname == GL_ARENA_TEXTURE_MEMORY_RSX || pname == GL_ARENA_RENDERBUFFER_MEMORY_RSX || pname == GL_ARENA_PROGRAM_MEMORY_RSX) {
+    if(name == ~0U) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    if(pname == GL_ARENA_BUFFER_MEMORY_RSX) {
+      *params = rsxgl_arena_buffer_memory(name);
+    }
+    else if(pname == GL_ARENA_TEXTURE_MEMORY_RSX) {
+      *params = rsxgl_arena_texture_memory(name);
     }
-    else if(arena.memory.location == RSXGL_MEMORY_LOCATION_MAIN) {
-      *params = GL_MAIN_MEMORY_ARENA_RSX;
+    else if(pname == GL_ARENA_RENDERBUFFER_MEMORY_RSX) {
+      *params = rsxgl_arena_renderbuffer_memory(name);
     }
     else {
-      RSXGL_ERROR_(GL_INVALID_ENUM);
+      *params = rsxgl_arena_program_memory(name);
     }
   }
   else {
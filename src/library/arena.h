@@ -15,6 +15,8 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+
 #include <boost/integer.hpp>
 
 enum rsxgl_arena_target {
@@ -78,41 +80,58 @@ struct memory_arena_t {
   binding_bitfield_type binding_bitfield;
 
   void * address;
-  mspace space;
   memory_t memory;
   rsx_size_t size;
 
+  // The allocator that manages the arena's memory, and its state. Arenas in RSX memory use
+  // TLSF (tlsf.h), which keeps its bookkeeping in main memory; arenas in main memory use
+  // dlmalloc, whose boundary tags are cheap to get at there:
+  void * user_data;
+  void * (*memalign_fn)(memory_arena_t *,rsx_size_t,rsx_size_t);
+  void (*free_fn)(memory_arena_t *,void *);
+  void (*destroy_fn)(memory_arena_t *);
+
+  // Allocation counts for arenas whose allocator doesn't keep its own (dlmalloc):
+  rsxgl_memory_stats_t stats;
+
+  // Deferred frees, from any context, that have yet to be returned to the arena:
+  uint32_t deferred_frees;
+
   memory_arena_t()
-    : address(0), space(0), size(0) {
+    : address(0), size(0), user_data(0), memalign_fn(0), free_fn(0), destroy_fn(0), stats(), deferred_frees(0) {
   }
 
   void destroy();
+};
 
-#if 0
-  // eventually:
-  void * user_data;
-
-  // functions:
-  // allocate
-  void * (*malloc_fn)(memory_arena_t *,rsx_size_t);
-  void * (*memalign_fn)(memory_arena_t *,rsx_size_t,rsx_size_t);
+// Have an arena allocate from the RSX's own heap (see mem.c); used by the default arena:
+void rsxgl_arena_init_rsx_heap(memory_arena_t &);
 
-  // resize (why?)
-  void * (*realloc_fn)(memory_arena_t *,void *,rsx_size_t);
+void rsxgl_arena_memory_stats(const memory_arena_t &,rsxgl_memory_stats_t &);
 
-  // free
-  void (*free_fn)(memory_arena_t *,void *);
+memory_arena_t::name_type rsxgl_arena_create(const uint32_t,const rsx_size_t,const rsx_size_t);
+memory_t rsxgl_arena_allocate(memory_arena_t &,rsx_size_t,rsx_size_t,void * * = 0);
+void rsxgl_arena_free(memory_arena_t &,const memory_t &);
 
-  // address_to_offset
-  int32_t (*address_to_offset_fn)(memory_arena_t *,void *,uint32_t *);
+// Memory that the RSX may still be using is put on the context's list of deferred frees, and
+// returned to its arena once the timestamp passes:
+struct rsxgl_deferred_free_t {
+  memory_arena_t::name_type arena;
+  memory_t memory;
+  uint64_t timestamp;
 
-  // offset_to_address
-  int32_t (*offset_to_address_fn)(memory_arena_t *,uint32_t,void * *);
-#endif
+  rsxgl_deferred_free_t(const memory_arena_t::name_type _arena,const memory_t & _memory,const uint64_t _timestamp)
+    : arena(_arena), memory(_memory), timestamp(_timestamp) {
+  }
 };
 
-memory_t rsxgl_arena_allocate(memory_arena_t &,rsx_size_t,rsx_size_t,void * * = 0);
-void rsxgl_arena_free(memory_arena_t &,const memory_t &);
+struct rsxgl_context_t;
+
+void rsxgl_arena_free_deferred(rsxgl_context_t *,const memory_arena_t::name_type,const memory_t &,const uint64_t);
+void rsxgl_arena_reclaim(rsxgl_context_t *);
+void rsxgl_arena_release_deferred(rsxgl_context_t *);
+void rsxgl_arena_compact(rsxgl_context_t *);
+memory_t rsxgl_arena_allocate_reclaim(rsxgl_context_t *,const memory_arena_t::name_type,rsx_size_t,rsx_size_t,void * * = 0);
 
 static inline void *
 rsxgl_arena_address(memory_arena_t & arena,const memory_t & memory)
@@ -161,4 +180,25 @@ rsxgl_memory_transfer(gcmContextData * context,
   gcm_finish_n_commands(context,12);
 }
 
+// Copy size contiguous bytes. The copy is split into lines, since the number of lines in one
+// transfer is limited:
+static inline void
+rsxgl_memory_copy(gcmContextData * context,memory_t dst,memory_t src,uint32_t size)
+{
+  static const uint32_t line = RSXGL_MEMORY_COPY_LINE_LENGTH, max_lines = RSXGL_MEMORY_COPY_MAX_LINES;
+
+  while(size >= line) {
+    const uint32_t lines = std::min(size / line,max_lines);
+    rsxgl_memory_transfer(context,dst,line,1,src,line,1,line,lines);
+
+    dst += lines * line;
+    src += lines * line;
+    size -= lines * line;
+  }
+
+  if(size > 0) {
+    rsxgl_memory_transfer(context,dst,size,1,src,size,1,size,1);
+  }
+}
+
 #endif
@@ -820,8 +820,16 @@ glVertexAttribDivisor (GLuint index, GLuint divisor)
   // TODO: Implement this
 }
 
+// Upper bound on the number of words emitted by rsxgl_attribs_validate, which doesn't check for
+// space in the command buffer itself:
+uint32_t
+rsxgl_attribs_validate_words(rsxgl_context_t * ctx,program_t & program)
+{
+  return 8 + ((ctx -> invalid_attribs.any() || ctx -> invalid_attrib_assignments.any()) ? (5 * RSXGL_MAX_VERTEX_ATTRIBS) : 0);
+}
+
 void
-rsxgl_attribs_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t start,const uint32_t length,const uint32_t timestamp)
+rsxgl_attribs_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t start,const uint32_t length,const uint64_t timestamp)
 {
   gcmContextData * context = ctx -> base.gcm_context;
 
@@ -829,7 +837,7 @@ rsxgl_attribs_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t
   // TODO: move this someplace where it can be determined if vertex buffers have been made
   // invalid, and perform the operation if that's the case.
   {
-    uint32_t * buffer = gcm_reserve(context,8);
+    uint32_t * buffer = gcm_reserve_unchecked(context,8);
 
     gcm_emit_method_at(buffer,0,0x1710,1);
     gcm_emit_at(buffer,1,0);
@@ -870,54 +878,64 @@ rsxgl_attribs_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t
 
     const program_t::attrib_size_type api_index = assignment_it.value();
 
+    // Every draw marks the part of the buffer that it reads. If the vertex range, or the
+    // stride, isn't known, then that's the rest of the buffer:
+    if(enabled_attrib_pointers.test(api_index) && attribs.buffers.names[api_index] != 0 && attribs.buffers[api_index].memory) {
+      const uint32_t stride = attribs.stride[api_index];
+      if(length > 0 && stride > 0) {
+	rsxgl_buffer_validate(ctx,attribs.buffers[api_index],attribs.offset[api_index] + start * stride,length * stride,timestamp);
+      }
+      else {
+	rsxgl_buffer_validate(ctx,attribs.buffers[api_index],attribs.offset[api_index],0,timestamp);
+      }
+      rsxgl_buffer_gpu_read(ctx,attribs.buffers[api_index]);
+    }
+
     if(invalid_it.test() || invalid_attribs.test(api_index)) {
       // Attribute is backed by a buffer:
       if(enabled_attrib_pointers.test(api_index)) {
 	// A buffer is actually attached:
 	if(attribs.buffers.names[api_index] != 0 && attribs.buffers[api_index].memory) {
-	  rsxgl_buffer_validate(ctx,attribs.buffers[api_index],start,length,timestamp);
-
 	  const memory_t memory = attribs.buffers[api_index].memory + attribs.offset[api_index];
 
-	  uint32_t * buffer = gcm_reserve(context,4);
+	  uint32_t * buffer = gcm_reserve_unchecked(context,4);
 	  
-	  gcm_emit_method_at(buffer,0,NV30_3D_VTXBUF(index),1);
-	  gcm_emit_at(buffer,1,memory.offset | ((uint32_t)memory.location << 31));
-	  gcm_emit_method_at(buffer,2,NV30_3D_VTXFMT(index),1);
-	  gcm_emit_at(buffer,3,
-		      /* ((uint32_t)attribs.frequency[api_index] << 16 | */
-		      ((uint32_t)attribs.stride[api_index] << NV30_3D_VTXFMT_STRIDE__SHIFT) |
-		      ((uint32_t)(attribs.size[api_index] + 1) << NV30_3D_VTXFMT_SIZE__SHIFT) |
-		      ((uint32_t)attribs.type[api_index] & 0x7));
+	  gcm_emit_shadowed1(&buffer,NV30_3D_VTXBUF(index),memory.offset | ((uint32_t)memory.location << 31));
+	  gcm_emit_shadowed1(&buffer,NV30_3D_VTXFMT(index),
+			     /* ((uint32_t)attribs.frequency[api_index] << 16 | */
+			     ((uint32_t)attribs.stride[api_index] << NV30_3D_VTXFMT_STRIDE__SHIFT) |
+			     ((uint32_t)(attribs.size[api_index] + 1) << NV30_3D_VTXFMT_SIZE__SHIFT) |
+			     ((uint32_t)attribs.type[api_index] & 0x7));
 	  
-	  gcm_finish_n_commands(context,4);
+	  gcm_finish_commands(context,&buffer);
 	}
 	// Nothing attached; disable fetch:
 	else {
-	  uint32_t * buffer = gcm_reserve(context,2);
-
-	  gcm_emit_method_at(buffer,0,NV30_3D_VTXFMT(index),1);
-	  gcm_emit_at(buffer,1,
-		      /* ((uint32_t)attribs.frequency[i] << 16 | */
-		      ((uint32_t)0 << NV30_3D_VTXFMT_STRIDE__SHIFT) |
-		      ((uint32_t)0 << NV30_3D_VTXFMT_SIZE__SHIFT) |
-		      ((uint32_t)RSXGL_VERTEX_F32 & 0x7));
+	  uint32_t * buffer = gcm_reserve_unchecked(context,2);
+
+	  gcm_emit_shadowed1(&buffer,NV30_3D_VTXFMT(index),
+			     /* ((uint32_t)attribs.frequency[i] << 16 | */
+			     ((uint32_t)0 << NV30_3D_VTXFMT_STRIDE__SHIFT) |
+			     ((uint32_t)0 << NV30_3D_VTXFMT_SIZE__SHIFT) |
+			     ((uint32_t)RSXGL_VERTEX_F32 & 0x7));
 	  
-	  gcm_finish_n_commands(context,2);
+	  gcm_finish_commands(context,&buffer);
 	}
       }
       // Attribute is constant:
       else {
-	uint32_t * buffer = gcm_reserve(context,5);
+	const uint32_t values[4] = {
+	  attribs.defaults[api_index][0].u,
+	  attribs.defaults[api_index][1].u,
+	  attribs.defaults[api_index][2].u,
+	  attribs.defaults[api_index][3].u
+	};
 
-	gcm_emit_method_at(buffer,0,NV30_3D_VTX_ATTR_4F(index),4);
+	uint32_t * buffer = gcm_reserve_unchecked(context,5);
 
-	gcm_emit_at(buffer,1,attribs.defaults[api_index][0].u);
-	gcm_emit_at(buffer,2,attribs.defaults[api_index][1].u);
-	gcm_emit_at(buffer,3,attribs.defaults[api_index][2].u);
-	gcm_emit_at(buffer,4,attribs.defaults[api_index][3].u);
+	gcm_emit_shadowed(&buffer,NV30_3D_VTX_ATTR_4F(index),values,4);
 	
-	gcm_finish_n_commands(context,5);
+	gcm_finish_commands(context,&buffer);
       }
 
       validated.set(api_index);
@@ -943,6 +961,7 @@ rsxgl_attribs_validate(rsxgl_context_t * ctx,program_t & program,const uint32_t
       continue;
     }
     rsxgl_buffer_validate(ctx,attribs.buffers[i],start,length,timestamp);
+    rsxgl_buffer_gpu_read(ctx,attribs.buffers[i]);
   }
 
   // TODO: Somewhere in here, make it so that attribs with nothing attached will disable fetching by the RSX (by setting NV30_3D_VTXFMT_SIZE to 0):
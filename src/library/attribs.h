@@ -72,6 +72,7 @@ struct attribs_t {
 
 struct rsxgl_context_t;
 
-void rsxgl_attribs_validate(rsxgl_context_t *,program_t &,const uint32_t,const uint32_t,const uint32_t);
+uint32_t rsxgl_attribs_validate_words(rsxgl_context_t *,program_t &);
+void rsxgl_attribs_validate(rsxgl_context_t *,program_t &,const uint32_t,const uint32_t,const uint64_t);
 
 #endif
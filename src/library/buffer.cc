@@ -4,19 +4,24 @@
 //
 // buffer.cc - Manage buffer objects.
 
+#include "rsxgl_config.h"
 #include "rsxgl_context.h"
 #include <rsx/gcm_sys.h>
 #include "gl_fifo.h"
 #include "buffer.h"
 #include "timestamp.h"
 #include "attribs.h"
+#include "migrate.h"
 
 #include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
 #include "error.h"
 
 #include <stddef.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include <unistd.h>
 
 #if defined(GLAPI)
@@ -35,6 +40,12 @@ buffer_t::~buffer_t()
   if(memory.offset != 0) {
     rsxgl_arena_free(memory_arena_t::storage().at(arena),memory);
   }
+  if(mapped_staging.offset != 0) {
+    rsxgl_arena_free(memory_arena_t::storage().at(arena),mapped_staging);
+  }
+  if(readback.offset != 0) {
+    rsxgl_arena_free(memory_arena_t::storage().at(current_object_ctx() -> main_buffer_arena),readback);
+  }
 }
 
 GLAPI void APIENTRY
@@ -72,8 +83,9 @@ glDeleteBuffers (GLsizei n, const GLuint* buffers)
       // TODO - orphan it, instead of doing this:
       buffer_t & buffer = buffer_t::storage().at(buffer_name);
       if(buffer.timestamp > 0) {
-	rsxgl_timestamp_wait(ctx,buffer.timestamp);
+	rsxgl_timestamp_wait(ctx,buffer.timestamp,RSXGL_STALL_BUFFER_DELETE);
 	buffer.timestamp = 0;
+	buffer.ranges.clear();
       }
 
       // 
@@ -249,6 +261,171 @@ glBindBufferBase (GLenum target, GLuint index, GLuint buffer_name)
   rsxgl_bind_buffer_range(target,index,buffer_name,0,~0);
 }
 
+// See if the buffer is attached to the current vertex array object; if so, invalidate:
+static inline void
+rsxgl_buffer_invalidate_attribs(rsxgl_context_t * ctx,const buffer_t::name_type name)
+{
+  attribs_t & attribs = ctx -> attribs_binding[0];
+  for(size_t i = 0;i < RSXGL_MAX_VERTEX_ATTRIBS;++i) {
+    if(attribs.buffers.is_bound(i,name)) {
+      ctx -> invalid_attribs.set(i);
+    }
+  }
+}
+
+// Placement. Buffers that the application writes to from the CPU most frames do better in
+// main memory, which the CPU writes to quickly; the RSX reads local memory fastest, so that's
+// where everything else goes. Buffers start out where their usage hint suggests, and those
+// that are written to, or that live in main memory, are looked at again once enough frames
+// have passed to tell how they're really being used:
+static inline bool
+rsxgl_buffer_usage_prefers_main(const uint32_t usage)
+{
+  return usage == RSXGL_STREAM_DRAW || usage == RSXGL_DYNAMIC_DRAW || usage == RSXGL_STREAM_READ || usage == RSXGL_STATIC_READ || usage == RSXGL_DYNAMIC_READ;
+}
+
+static inline memory_arena_t::name_type
+rsxgl_buffer_main_arena(rsxgl_context_t * ctx)
+{
+  rsxgl_object_context_t * object_ctx = ctx -> object_context();
+  if(object_ctx -> main_buffer_arena == 0) {
+    object_ctx -> main_buffer_arena = rsxgl_arena_create(RSXGL_MEMORY_LOCATION_MAIN,1024 * 1024,RSXGL_CONFIG_main_buffer_arena_size);
+  }
+  return object_ctx -> main_buffer_arena;
+}
+
+static inline void
+rsxgl_buffer_placement_queue(rsxgl_context_t * ctx,const buffer_t::name_type name,buffer_t & buffer)
+{
+  if(buffer.placement_auto && !buffer.pinned && !buffer.placement_queued) {
+    buffer.placement_queued = 1;
+    buffer.cpu_writes = 0;
+    buffer.gpu_reads = 0;
+    buffer.placement_frame = ctx -> frame;
+    buffer.cpu_write_frame = ~0U;
+    buffer.gpu_read_frame = ~0U;
+    ctx -> placement_queue.push_back(name);
+  }
+}
+
+static inline void
+rsxgl_buffer_cpu_write(rsxgl_context_t * ctx,const buffer_t::name_type name,buffer_t & buffer)
+{
+  rsxgl_buffer_placement_queue(ctx,name,buffer);
+  if(buffer.cpu_write_frame != ctx -> frame) {
+    buffer.cpu_write_frame = ctx -> frame;
+    if(buffer.cpu_writes < 0xffff) ++buffer.cpu_writes;
+  }
+}
+
+void
+rsxgl_buffer_gpu_read(rsxgl_context_t * ctx,buffer_t & buffer)
+{
+  if(buffer.placement_queued && buffer.gpu_read_frame != ctx -> frame) {
+    buffer.gpu_read_frame = ctx -> frame;
+    if(buffer.gpu_reads < 0xffff) ++buffer.gpu_reads;
+  }
+}
+
+// Move a buffer's contents to memory allocated from arena, using the RSX. The old storage is
+// freed once the RSX has copied it, and is done with whatever else it was doing with it:
+void
+rsxgl_buffer_move(rsxgl_context_t * ctx,const buffer_t::name_type name,buffer_t & buffer,const memory_arena_t::name_type arena,const memory_t & memory)
+{
+  const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+  rsxgl_memory_copy(ctx -> gcm_context(),memory,buffer.memory,buffer.size);
+  rsxgl_timestamp_batch_post(ctx,1);
+
+  rsxgl_arena_free_deferred(ctx,buffer.arena,buffer.memory,timestamp);
+
+  buffer.arena = arena;
+  buffer.memory = memory;
+  buffer.invalid = 1;
+
+  // CPU access has to wait for the copy:
+  rsxgl_buffer_validate(ctx,buffer,0,0,timestamp);
+
+  rsxgl_buffer_invalidate_attribs(ctx,name);
+}
+
+static bool
+rsxgl_buffer_migrate(rsxgl_context_t * ctx,const buffer_t::name_type name,buffer_t & buffer,const memory_arena_t::name_type arena)
+{
+  const memory_t memory = rsxgl_arena_allocate(memory_arena_t::storage().at(arena),128,buffer.size);
+  if(!memory) return false;
+
+  rsxgl_buffer_move(ctx,name,buffer,arena,memory);
+  return true;
+}
+
+void
+rsxgl_buffer_placement_update(rsxgl_context_t * ctx)
+{
+  std::vector< buffer_t::name_type > & queue = ctx -> placement_queue;
+  size_t migrations = 0;
+
+  for(size_t i = 0;i < queue.size();) {
+    const buffer_t::name_type name = queue[i];
+    bool keep = false;
+
+    if(buffer_t::storage().is_object(name)) {
+      buffer_t & buffer = buffer_t::storage().at(name);
+      const uint32_t frames = ctx -> frame - buffer.placement_frame;
+
+      if(!buffer.placement_auto || buffer.pinned || !buffer.memory) {
+	keep = false;
+      }
+      else if(frames < RSXGL_BUFFER_PLACEMENT_FRAMES || buffer.mapped != 0 || migrations >= RSXGL_BUFFER_PLACEMENT_MAX_MIGRATIONS) {
+	keep = true;
+      }
+      else {
+	// Written to on most frames:
+	if(buffer.memory.location == RSXGL_MEMORY_LOCATION_LOCAL && ((uint32_t)buffer.cpu_writes * 2) >= frames) {
+	  const memory_arena_t::name_type arena = rsxgl_buffer_main_arena(ctx);
+	  if(arena != 0 && rsxgl_buffer_migrate(ctx,name,buffer,arena)) ++migrations;
+	}
+	// Drawn from, but not written to:
+	else if(buffer.memory.location == RSXGL_MEMORY_LOCATION_MAIN && buffer.cpu_writes == 0 && buffer.gpu_reads >= frames) {
+	  if(rsxgl_buffer_migrate(ctx,name,buffer,0)) ++migrations;
+	}
+
+	// Buffers in main memory stay under watch:
+	buffer.cpu_writes = 0;
+	buffer.gpu_reads = 0;
+	buffer.placement_frame = ctx -> frame;
+	buffer.cpu_write_frame = ~0U;
+	buffer.gpu_read_frame = ~0U;
+	keep = (buffer.memory.location == RSXGL_MEMORY_LOCATION_MAIN);
+      }
+
+      buffer.placement_queued = keep;
+    }
+
+    if(keep) {
+      ++i;
+    }
+    else {
+      queue[i] = queue.back();
+      queue.pop_back();
+    }
+  }
+}
+
+// Asynchronous readback (GL_RSX_buffer_readback). glReadbackBufferRangeRSX has the RSX copy part
+// of a buffer in local memory to main memory, which the CPU reads much faster. Once the copy's
+// landed, glGetBufferSubData and read-only maps of that part of the buffer use it instead:
+static inline bool
+rsxgl_buffer_readback_covers(const buffer_t & buffer,const rsx_size_t offset,const rsx_size_t length)
+{
+  return buffer.readback_size > 0 && offset >= buffer.readback_offset && (offset + length) <= (buffer.readback_offset + buffer.readback_size);
+}
+
+static inline void *
+rsxgl_buffer_readback_address(rsxgl_context_t * ctx,const buffer_t & buffer,const rsx_size_t offset)
+{
+  return (uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(ctx -> object_context() -> main_buffer_arena),buffer.readback) + (offset - buffer.readback_offset);
+}
+
 GLAPI void APIENTRY
 glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
 {
@@ -271,6 +448,11 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
+  // Command lists have the buffer's storage address baked into them:
+  if(ctx -> buffer_binding[rsx_target].pinned != 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
   int rsx_usage = rsxgl_buffer_usage(usage);
   if(rsx_usage < 0) {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -278,61 +460,61 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
 
   buffer_t * buffer = &ctx -> buffer_binding[rsx_target];
 
-#if 0
-  // If a pending GPU operation uses this buffer, then orphan it:
-  if((buffer -> timestamp != 0) && (!rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,buffer -> timestamp))) {
-    buffer_t::storage().orphan(ctx -> buffer_binding.names[rsx_target]);
-
-    buffer -> timestamp = 0;
-    buffer -> invalid = 0;
-    buffer -> usage = 0;
-    buffer -> mapped = 0;
+  // If a pending GPU operation uses this buffer, then orphan its storage - it's freed once
+  // the RSX is done with it, and the buffer gets new storage straight away:
+  if(buffer -> memory) {
+    rsxgl_arena_free_deferred(ctx,buffer -> arena,buffer -> memory,buffer -> timestamp);
     buffer -> memory = memory_t();
-    buffer -> arena = 0;
     buffer -> size = 0;
-    buffer -> mapped_offset = 0;
-    buffer -> mapped_size = 0;
   }
-#else
-  if(buffer -> timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,buffer -> timestamp);
-    buffer -> timestamp = 0;
+  if(buffer -> readback) {
+    rsxgl_arena_free_deferred(ctx,ctx -> object_context() -> main_buffer_arena,buffer -> readback,buffer -> readback_timestamp);
+    buffer -> readback = memory_t();
+    buffer -> readback_capacity = 0;
   }
-
-  // Free the old buffer:
-  if(buffer -> memory.offset != 0) {
-    rsxgl_arena_free(memory_arena_t::storage().at(buffer -> arena),buffer -> memory);
-    buffer -> memory = memory_t();
-  }
-#endif
+  rsxgl_buffer_invalidate_readback(*buffer);
+  buffer -> timestamp = 0;
+  buffer -> ranges.clear();
 
   // If a buffer is actually being requested, then allocate memory for it:
   void * address = 0;
   
+  const buffer_t::name_type name = ctx -> buffer_binding.names[rsx_target];
+
   if(size > 0) {
     buffer -> invalid = 1;
     buffer -> usage = rsx_usage;
     buffer -> arena = ctx -> arena_binding.names[RSXGL_BUFFER_ARENA];
-    buffer -> memory = rsxgl_arena_allocate(memory_arena_t::storage().at(buffer -> arena),128,size,&address);
+
+    // Buffers from the default arena are placed automatically:
+    buffer -> placement_auto = (buffer -> arena == 0);
+    if(buffer -> placement_auto && rsxgl_buffer_usage_prefers_main(rsx_usage)) {
+      const memory_arena_t::name_type arena = rsxgl_buffer_main_arena(ctx);
+      if(arena != 0) {
+	buffer -> memory = rsxgl_arena_allocate_reclaim(ctx,arena,128,size,&address);
+	if(buffer -> memory) buffer -> arena = arena;
+      }
+    }
+
+    if(!buffer -> memory) {
+      buffer -> memory = rsxgl_arena_allocate_reclaim(ctx,buffer -> arena,128,size,&address);
+    }
     
     if(!buffer -> memory) RSXGL_ERROR_(GL_OUT_OF_MEMORY);
     
     buffer -> size = size;
+
+    if(buffer -> memory.location == RSXGL_MEMORY_LOCATION_MAIN) {
+      rsxgl_buffer_placement_queue(ctx,name,*buffer);
+    }
   }
 
   if(address != 0 && data != 0 && buffer -> size > 0) {
     memcpy(address,data,buffer -> size);
+    rsxgl_buffer_cpu_write(ctx,name,*buffer);
   }
 
-  const buffer_t::name_type name = ctx -> buffer_binding.names[rsx_target];
-
-  // See if the buffer is attached to the current vertex array object; if so, invalidate:
-  attribs_t & attribs = ctx -> attribs_binding[0];
-  for(size_t i = 0;i < RSXGL_MAX_VERTEX_ATTRIBS;++i) {
-    if(attribs.buffers.is_bound(i,name)) {
-      ctx -> invalid_attribs.set(i);
-    }
-  }
+  rsxgl_buffer_invalidate_attribs(ctx,name);
 
   RSXGL_NOERROR_();
 }
@@ -352,7 +534,7 @@ glBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid*
   }
   buffer_t & buffer = ctx -> buffer_binding[rsx_target];
   
-  if(buffer.mapped != 0) {
+  if(rsxgl_buffer_mapped_exclusive(buffer)) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -366,15 +548,43 @@ glBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid*
   void * address = rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory);
 
   if(address != 0 && data != 0 && size > 0) {
-    // TODO - if a pending operation depends upon this buffer, wait for that operation to finish:
-    // TODO - replace this with something smarter that doesn't conservatively decide to block on the GPU:
-    if(buffer.timestamp > 0) {
-      rsxgl_timestamp_wait(ctx,buffer.timestamp);
-      buffer.timestamp = 0;
+    rsxgl_buffer_cpu_write(ctx,ctx -> buffer_binding.names[rsx_target],buffer);
+    rsxgl_buffer_invalidate_readback(buffer);
+
+    // Only the RSX's use of the range being written matters:
+    const uint64_t range_timestamp = rsxgl_buffer_timestamp(buffer,offset,size);
+
+    // If the RSX is still using the buffer, then don't wait for it. Stage the data in the
+    // migration buffer instead, and have the RSX copy it into place once it's done with what
+    // came before:
+    if(range_timestamp > 0 && size <= RSXGL_CONFIG_buffer_subdata_staging_size &&
+       !rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,range_timestamp)) {
+      gcmContextData * context = ctx -> gcm_context();
+
+      void * staging = rsxgl_vertex_migrate_memalign(context,RSXGL_VERTEX_MIGRATE_BUFFER_ALIGN,size);
+      memcpy(staging,data,size);
+
+      uint32_t staging_offset = 0;
+      int32_t s = gcmAddressToOffset(staging,&staging_offset);
+      rsxgl_assert(s == 0);
+
+      const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+
+      rsxgl_memory_copy(context,buffer.memory + offset,memory_t(RSXGL_VERTEX_MIGRATE_BUFFER_LOCATION,staging_offset),size);
+      rsxgl_vertex_migrate_free(context,staging,size);
+
+      rsxgl_timestamp_batch_post(ctx,1);
+
+      rsxgl_buffer_validate(ctx,buffer,offset,size,timestamp);
     }
+    else {
+      if(range_timestamp > 0) {
+	rsxgl_timestamp_wait(ctx,range_timestamp,RSXGL_STALL_BUFFER_SUBDATA);
+      }
     
-    // Copy the data:
-    memcpy((uint8_t *)address + offset,data,size);
+      // Copy the data:
+      memcpy((uint8_t *)address + offset,data,size);
+    }
   }
 
   RSXGL_NOERROR_();
@@ -395,7 +605,7 @@ glGetBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, GLvoid *dat
   }
   buffer_t & buffer = ctx -> buffer_binding[rsx_target];
   
-  if(buffer.mapped != 0) {
+  if(rsxgl_buffer_mapped_exclusive(buffer)) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -406,52 +616,212 @@ glGetBufferSubData (GLenum target, GLintptr offset, GLsizeiptr size, GLvoid *dat
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  void * address = rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory);
+  if(data != 0 && size > 0) {
+    // Read from the copy made by glReadbackBufferRangeRSX, if there is one:
+    if(rsxgl_buffer_readback_covers(buffer,offset,size)) {
+      rsxgl_timestamp_wait(ctx,buffer.readback_timestamp,RSXGL_STALL_BUFFER_READBACK);
+      memcpy(data,rsxgl_buffer_readback_address(ctx,buffer,offset),size);
+    }
+    else {
+      void * address = rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory);
 
-  if(address != 0 && data != 0 && size > 0) {
-    // TODO - wait for pending operations to finish:
+      if(address != 0) {
+	// The RSX may still be writing to the range:
+	const uint64_t range_timestamp = rsxgl_buffer_timestamp(buffer,offset,size);
+	if(range_timestamp > 0) {
+	  rsxgl_timestamp_wait(ctx,range_timestamp,RSXGL_STALL_BUFFER_READBACK);
+	}
 
-    // Copy it:
-    memcpy(data,(uint8_t *)address + offset,size);
+	memcpy(data,(uint8_t *)address + offset,size);
+      }
+    }
   }
 
   RSXGL_NOERROR_();
 }
 
+GLAPI void APIENTRY
+glReadbackBufferRangeRSX (GLenum target, GLintptr offset, GLsizeiptr length)
+{
+  const size_t rsx_target = rsxgl_buffer_target(target);
+  if(rsx_target == ~0U) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(ctx -> buffer_binding.names[rsx_target] == 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+  buffer_t & buffer = ctx -> buffer_binding[rsx_target];
+
+  if(rsxgl_buffer_mapped_exclusive(buffer)) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  if(offset < 0 || length < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+  if(!rsxgl_buffer_valid_range(buffer,offset,length)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  rsxgl_buffer_invalidate_readback(buffer);
+
+  // The CPU reads buffers in main memory directly, once the RSX is done with them:
+  if(length == 0 || buffer.memory.location == RSXGL_MEMORY_LOCATION_MAIN) {
+    RSXGL_NOERROR_();
+  }
+
+  if(buffer.readback_capacity < (rsx_size_t)length) {
+    const memory_arena_t::name_type arena = rsxgl_buffer_main_arena(ctx);
+    if(arena == 0) {
+      RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+    }
+
+    if(buffer.readback) {
+      rsxgl_arena_free_deferred(ctx,arena,buffer.readback,buffer.readback_timestamp);
+      buffer.readback = memory_t();
+      buffer.readback_capacity = 0;
+    }
+
+    buffer.readback = rsxgl_arena_allocate_reclaim(ctx,arena,128,length);
+    if(!buffer.readback) {
+      RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+    }
+    buffer.readback_capacity = length;
+  }
+
+  // The copy is ordered behind whatever the RSX has already been told to do with the buffer,
+  // including writes to it; fence it to find out when it's landed:
+  const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+  rsxgl_memory_copy(ctx -> gcm_context(),buffer.readback,buffer.memory + offset,length);
+  rsxgl_timestamp_batch_post(ctx,1);
+
+  rsxgl_buffer_validate(ctx,buffer,offset,length,timestamp);
+
+  buffer.readback_offset = offset;
+  buffer.readback_size = length;
+  buffer.readback_timestamp = timestamp;
+
+  RSXGL_NOERROR_();
+}
+
+// Give a buffer that the RSX is still using new storage of the same size. The old storage is
+// freed once the RSX is done with it:
+static inline bool
+rsxgl_buffer_orphan(rsxgl_context_t * ctx,const buffer_t::name_type buffer_name,buffer_t & buffer)
+{
+  rsxgl_arena_free_deferred(ctx,buffer.arena,buffer.memory,buffer.timestamp);
+  buffer.timestamp = 0;
+  buffer.ranges.clear();
+  buffer.invalid = 1;
+  buffer.memory = rsxgl_arena_allocate_reclaim(ctx,buffer.arena,128,buffer.size);
+
+  rsxgl_buffer_invalidate_attribs(ctx,buffer_name);
+
+  if(!buffer.memory) {
+    buffer.size = 0;
+    return false;
+  }
+  else {
+    return true;
+  }
+}
+
 static inline void *
-rsxgl_map_buffer_range(rsxgl_context_t * ctx,const buffer_t::name_type buffer_name,const uint32_t offset, const uint32_t _length,const uint32_t access)
+rsxgl_map_buffer_range(rsxgl_context_t * ctx,const buffer_t::name_type buffer_name,const uint32_t offset,const uint32_t length,const uint32_t access)
 {
   buffer_t & buffer = buffer_t::storage().at(buffer_name);
-  const uint32_t length = (_length == 0) ? buffer.size : _length;
 
   if(buffer.mapped != 0) {
     RSXGL_ERROR(GL_INVALID_OPERATION,0);
   }
 
-  int rsx_access = rsxgl_buffer_access(access);
-  if(rsx_access == ~0) {
-    RSXGL_ERROR(GL_INVALID_ENUM,0);
-  }
-
-  if(offset < 0 || length < 0) {
+  if(access & ~(GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_FLUSH_EXPLICIT_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_PERSISTENT_BIT_RSX)) {
     RSXGL_ERROR(GL_INVALID_VALUE,0);
   }
+  if((access & (GL_MAP_READ_BIT | GL_MAP_WRITE_BIT)) == 0) {
+    RSXGL_ERROR(GL_INVALID_OPERATION,0);
+  }
+  if((access & GL_MAP_READ_BIT) && (access & (GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT))) {
+    RSXGL_ERROR(GL_INVALID_OPERATION,0);
+  }
+  if((access & GL_MAP_FLUSH_EXPLICIT_BIT) && !(access & GL_MAP_WRITE_BIT)) {
+    RSXGL_ERROR(GL_INVALID_OPERATION,0);
+  }
+
   if(!rsxgl_buffer_valid_range(buffer,offset,length)) {
     RSXGL_ERROR(GL_INVALID_VALUE,0);
   }
 
-  // TODO - replace this with something smarter that doesn't conservatively decide to block on the GPU:
-  if(buffer.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,buffer.timestamp);
-    buffer.timestamp = 0;
+  void * address = 0;
+  memory_t staging;
+
+  // Only wait for the RSX as a last resort. If the application doesn't want to synchronize,
+  // or the RSX is done with the buffer, then map it directly:
+  const uint64_t range_timestamp = rsxgl_buffer_timestamp(buffer,offset,length);
+  const bool busy = (range_timestamp > 0) && !rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,range_timestamp);
+
+  // A read-only map of a range that's been read back maps the copy in main memory:
+  if(access == GL_MAP_READ_BIT && rsxgl_buffer_readback_covers(buffer,offset,length)) {
+    rsxgl_timestamp_wait(ctx,buffer.readback_timestamp,RSXGL_STALL_BUFFER_MAP);
+    address = rsxgl_buffer_readback_address(ctx,buffer,offset);
+  }
+  // A persistent mapping is never synchronized - the application fences the regions it writes:
+  else if(busy && !(access & (GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_PERSISTENT_BIT_RSX))) {
+    // The whole buffer's contents can be discarded - give it new storage, unless a command
+    // list refers to the storage it has now:
+    if(buffer.pinned == 0 && ((access & GL_MAP_INVALIDATE_BUFFER_BIT) || ((access & GL_MAP_INVALIDATE_RANGE_BIT) && offset == 0 && length == buffer.size))) {
+      if(!rsxgl_buffer_orphan(ctx,buffer_name,buffer)) {
+	RSXGL_ERROR(GL_OUT_OF_MEMORY,0);
+      }
+    }
+    // Only the range can be discarded - the application writes to staging memory, which is
+    // copied into the buffer, behind whatever the RSX is already doing with it:
+    else if(access & (GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)) {
+      staging = rsxgl_arena_allocate(memory_arena_t::storage().at(buffer.arena),128,length,&address);
+    }
+
+    if(!staging && buffer.timestamp > 0) {
+      rsxgl_timestamp_wait(ctx,range_timestamp,RSXGL_STALL_BUFFER_MAP);
+    }
   }
 
-  // 
-  buffer.mapped = rsx_access;
-  buffer.mapped_offset = 0;
-  buffer.mapped_size = buffer.size;
+  if(!staging && address == 0) {
+    address = (uint8_t *)rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory) + offset;
+  }
+
+  buffer.mapped = ((access & GL_MAP_READ_BIT) ? RSXGL_READ_ONLY : 0) | ((access & GL_MAP_WRITE_BIT) ? RSXGL_WRITE_ONLY : 0);
+  buffer.persistent = (access & GL_MAP_PERSISTENT_BIT_RSX) ? 1 : 0;
+  if(access & GL_MAP_WRITE_BIT) {
+    rsxgl_buffer_cpu_write(ctx,buffer_name,buffer);
+    rsxgl_buffer_invalidate_readback(buffer);
+  }
+  buffer.mapped_flags = access;
+  buffer.mapped_offset = offset;
+  buffer.mapped_size = length;
+  buffer.mapped_address = address;
+  buffer.mapped_staging = staging;
 
-  RSXGL_NOERROR(rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory));
+  RSXGL_NOERROR(address);
+}
+
+// Make the application's writes to part of a mapped range visible to the RSX. offset is
+// relative to the mapped range. Mapped memory is shared with the RSX, so this only has work to
+// do when the mapping goes through staging memory:
+static inline void
+rsxgl_buffer_flush_mapped_range(rsxgl_context_t * ctx,buffer_t & buffer,const uint32_t offset,const uint32_t length)
+{
+  if(!buffer.mapped_staging || length == 0) return;
+
+  const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+
+  rsxgl_memory_copy(ctx -> gcm_context(),buffer.memory + (buffer.mapped_offset + offset),buffer.mapped_staging + offset,length);
+
+  rsxgl_timestamp_batch_post(ctx,1);
+
+  rsxgl_buffer_validate(ctx,buffer,buffer.mapped_offset + offset,length,timestamp);
 }
 
 //
@@ -468,8 +838,14 @@ glMapBuffer (GLenum target, GLenum access)
   if(ctx -> buffer_binding.names[rsx_target] == 0) {
     RSXGL_ERROR(GL_INVALID_OPERATION,0);
   }
-  
-  return rsxgl_map_buffer_range(ctx,ctx -> buffer_binding.names[rsx_target],0,0,access);
+
+  const int rsx_access = rsxgl_buffer_access(access);
+  if(rsx_access == ~0) {
+    RSXGL_ERROR(GL_INVALID_ENUM,0);
+  }
+
+  return rsxgl_map_buffer_range(ctx,ctx -> buffer_binding.names[rsx_target],0,ctx -> buffer_binding[rsx_target].size,
+				((rsx_access & RSXGL_READ_ONLY) ? GL_MAP_READ_BIT : 0) | ((rsx_access & RSXGL_WRITE_ONLY) ? GL_MAP_WRITE_BIT : 0));
 }
 
 GLAPI GLvoid* APIENTRY
@@ -480,6 +856,10 @@ glMapBufferRange (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield
     RSXGL_ERROR(GL_INVALID_ENUM,0);
   }
 
+  if(offset < 0 || length <= 0) {
+    RSXGL_ERROR(GL_INVALID_VALUE,0);
+  }
+
   rsxgl_context_t * ctx = current_ctx();
 
   if(ctx -> buffer_binding.names[rsx_target] == 0) {
@@ -504,18 +884,18 @@ glFlushMappedBufferRange (GLenum target, GLintptr offset, GLsizeiptr length)
   }
   buffer_t & buffer = ctx -> buffer_binding[rsx_target];
 
-  if(buffer.mapped == 0) {
+  if(buffer.mapped == 0 || !(buffer.mapped_flags & GL_MAP_FLUSH_EXPLICIT_BIT)) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
   if(offset < 0 || length < 0) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
-  if(!rsxgl_buffer_valid_range(buffer,offset,length)) {
+  if((offset + length) > buffer.mapped_size) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  // TODO - Implement this function.
+  rsxgl_buffer_flush_mapped_range(ctx,buffer,offset,length);
 
   RSXGL_NOERROR_();
 }
@@ -539,9 +919,20 @@ glUnmapBuffer (GLenum target)
     RSXGL_ERROR(GL_INVALID_OPERATION,GL_FALSE);
   }
 
+  if(buffer.mapped_staging) {
+    if(!(buffer.mapped_flags & GL_MAP_FLUSH_EXPLICIT_BIT)) {
+      rsxgl_buffer_flush_mapped_range(ctx,buffer,0,buffer.mapped_size);
+    }
+    rsxgl_arena_free_deferred(ctx,buffer.arena,buffer.mapped_staging,buffer.timestamp);
+  }
+
   buffer.mapped = 0;
+  buffer.persistent = 0;
   buffer.mapped_offset = 0;
   buffer.mapped_size = 0;
+  buffer.mapped_flags = 0;
+  buffer.mapped_address = 0;
+  buffer.mapped_staging = memory_t();
 
   RSXGL_NOERROR(GL_TRUE);
 }
@@ -608,7 +999,7 @@ glGetBufferParameteriv (GLenum target, GLenum pname, GLint *params)
     }
   }
   else if(pname == GL_BUFFER_ACCESS_FLAGS) {
-    *params = (buffer.mapped & RSXGL_READ_ONLY ? GL_MAP_READ_BIT : 0) | (buffer.mapped & RSXGL_WRITE_ONLY ? GL_MAP_WRITE_BIT : 0);
+    *params = buffer.mapped_flags;
   }
   else if(pname == GL_BUFFER_MAPPED) {
     *params = (buffer.mapped != 0) ? GL_TRUE : GL_FALSE;
@@ -642,12 +1033,7 @@ glGetBufferPointerv (GLenum target, GLenum pname, GLvoid** params)
   buffer_t & buffer = ctx -> buffer_binding[rsx_target];
 
   if(pname == GL_BUFFER_MAP_POINTER) {
-    if(buffer.mapped != 0) {
-      *params = rsxgl_arena_address(memory_arena_t::storage().at(buffer.arena),buffer.memory);
-    }
-    else {
-      *params = 0;
-    }
+    *params = buffer.mapped_address;
   }
   else {
     RSXGL_ERROR_(GL_INVALID_ENUM);
@@ -690,7 +1076,7 @@ glCopyBufferSubData (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
   
-  const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+  const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
 
   gcmContextData * context = ctx -> gcm_context();
 
@@ -712,26 +1098,109 @@ glCopyBufferSubData (GLenum readTarget, GLenum writeTarget, GLintptr readOffset,
 
   gcm_finish_n_commands(context,12);
 
-  rsxgl_timestamp_post(ctx,timestamp);
-
-  rsxgl_assert(timestamp >= ctx -> buffer_binding[iread].timestamp);
-  rsxgl_assert(timestamp >= ctx -> buffer_binding[iwrite].timestamp);
+  rsxgl_timestamp_batch_post(ctx,1);
 
-  ctx -> buffer_binding[iread].timestamp = timestamp;
-  ctx -> buffer_binding[iwrite].timestamp = timestamp;
+  rsxgl_buffer_validate(ctx,ctx -> buffer_binding[iread],readOffset,size,timestamp);
+  rsxgl_buffer_gpu_read(ctx,ctx -> buffer_binding[iread]);
+  rsxgl_buffer_validate(ctx,ctx -> buffer_binding[iwrite],writeOffset,size,timestamp);
+  rsxgl_buffer_invalidate_readback(write_buffer);
 
   RSXGL_NOERROR_();
 }
 
+static inline bool
+rsxgl_buffer_range_less(const buffer_range_t & lhs,const buffer_range_t & rhs)
+{
+  return lhs.start < rhs.start;
+}
+
+// Record that the RSX uses [start,start + length) of the buffer until timestamp. Timestamps only
+// go up, so the new range replaces whatever parts of older ones it overlaps:
 void
-rsxgl_buffer_validate(rsxgl_context_t *,buffer_t & buffer,const uint32_t start,const uint32_t length,const uint32_t timestamp)
+rsxgl_buffer_validate(rsxgl_context_t * ctx,buffer_t & buffer,const uint32_t _start,const uint32_t length,const uint64_t timestamp)
 {
   rsxgl_assert(timestamp >= buffer.timestamp);
   buffer.timestamp = timestamp;
 
+  const rsx_size_t
+    start = std::min(_start,buffer.size),
+    end = (length == 0) ? buffer.size : std::min(_start + length,buffer.size);
+
+  std::vector< buffer_range_t > & ranges = buffer.ranges;
+
+  // The common case - the same range as last time:
+  if(ranges.size() == 1 && ranges[0].start == start && ranges[0].end == end) {
+    ranges[0].timestamp = timestamp;
+  }
+  else {
+    // Reused so that it keeps its capacity:
+    static std::vector< buffer_range_t > result;
+    result.clear();
+
+    for(std::vector< buffer_range_t >::const_iterator it = ranges.begin(),it_end = ranges.end();it != it_end;++it) {
+      // Forget about ranges that the RSX is known to be done with:
+      if(rsxgl_timestamp_passed_conservative(ctx -> cached_timestamp,it -> timestamp)) continue;
+
+      if(it -> end <= start || it -> start >= end) {
+	result.push_back(*it);
+      }
+      else {
+	if(it -> start < start) result.push_back(buffer_range_t(it -> start,start,it -> timestamp));
+	if(it -> end > end) result.push_back(buffer_range_t(end,it -> end,it -> timestamp));
+      }
+    }
+    result.push_back(buffer_range_t(start,end,timestamp));
+    std::sort(result.begin(),result.end(),rsxgl_buffer_range_less);
+
+    // Join neighbours that share a timestamp:
+    std::vector< buffer_range_t >::iterator out = result.begin();
+    for(std::vector< buffer_range_t >::const_iterator it = result.begin() + 1,it_end = result.end();it != it_end;++it) {
+      if(it -> start == out -> end && it -> timestamp == out -> timestamp) {
+	out -> end = it -> end;
+      }
+      else {
+	*(++out) = *it;
+      }
+    }
+    result.erase(out + 1,result.end());
+
+    // Too many ranges - join the pair of neighbours that the RSX will finish with soonest,
+    // along with the gap between them:
+    while(result.size() > RSXGL_MAX_BUFFER_RANGES) {
+      size_t oldest = 0;
+      for(size_t i = 1,n = result.size() - 1;i < n;++i) {
+	if(std::max(result[i].timestamp,result[i + 1].timestamp) < std::max(result[oldest].timestamp,result[oldest + 1].timestamp)) {
+	  oldest = i;
+	}
+      }
+
+      result[oldest].end = result[oldest + 1].end;
+      result[oldest].timestamp = std::max(result[oldest].timestamp,result[oldest + 1].timestamp);
+      result.erase(result.begin() + oldest + 1);
+    }
+
+    ranges.swap(result);
+  }
+
   if(buffer.invalid) {
     // TODO - here will go flushing of mapped buffers, to replace the current scheme where the CPU synchronizes with the GPU.
 
     buffer.invalid = 1;
   }
 }
+
+// The timestamp that the RSX has to reach before it's done with [start,start + length) of the
+// buffer, or 0 if it isn't using any of it:
+uint64_t
+rsxgl_buffer_timestamp(const buffer_t & buffer,const uint32_t start,const uint32_t length)
+{
+  const rsx_size_t end = (length == 0) ? buffer.size : (start + length);
+
+  uint64_t timestamp = 0;
+  for(std::vector< buffer_range_t >::const_iterator it = buffer.ranges.begin(),it_end = buffer.ranges.end();it != it_end;++it) {
+    if(it -> start < end && it -> end > start) {
+      timestamp = std::max(timestamp,it -> timestamp);
+    }
+  }
+  return timestamp;
+}
@@ -13,6 +13,8 @@
 #include "gl_object.h"
 #include "arena.h"
 
+#include <vector>
+
 enum rsxgl_buffer_target {
   RSXGL_ARRAY_BUFFER = 0,
   RSXGL_COPY_READ_BUFFER = 1,
@@ -52,6 +54,16 @@ enum rsxgl_buffer_usage {
   RSXGL_DYNAMIC_COPY = 8
 };
 
+// Part of a buffer, [start,end), that the RSX uses until timestamp:
+struct buffer_range_t {
+  rsx_size_t start, end;
+  uint64_t timestamp;
+
+  buffer_range_t(const rsx_size_t _start,const rsx_size_t _end,const uint64_t _timestamp)
+    : start(_start), end(_end), timestamp(_timestamp) {
+  }
+};
+
 struct buffer_t {
   typedef bindable_gl_object< buffer_t, RSXGL_MAX_BUFFERS, RSXGL_MAX_BUFFER_TARGETS > gl_object_type;
   typedef typename gl_object_type::name_type name_type;
@@ -63,10 +75,28 @@ struct buffer_t {
 
   binding_bitfield_type binding_bitfield;
 
-  uint32_t deleted:1, timestamp:31;
+  uint32_t deleted:1;
+  uint64_t timestamp;
   uint32_t ref_count;
 
-  uint8_t invalid:1,usage:4,mapped:2;
+  // The parts of the buffer that the RSX has been told to use, sorted and not overlapping.
+  // timestamp is the latest of them, and covers the whole buffer:
+  std::vector< buffer_range_t > ranges;
+
+  uint8_t invalid:1,usage:4,mapped:2,persistent:1;
+
+  // Buffers allocated from the default arena are placed by RSXGL, in RSX or main memory,
+  // according to their usage hint and how they're actually used (see
+  // rsxgl_buffer_placement_update). The counts are of frames since placement_frame in which the
+  // CPU wrote to the buffer, and in which the RSX drew from it; the *_frame fields are the last
+  // such frames, so that each is counted once:
+  uint8_t placement_auto:1,placement_queued:1;
+  uint16_t cpu_writes, gpu_reads;
+  uint32_t placement_frame, cpu_write_frame, gpu_read_frame;
+
+  // Number of recorded command lists that have the buffer's storage address baked into them.
+  // While it's nonzero, the storage is neither moved nor replaced:
+  uint16_t pinned;
 
   memory_t memory;
   memory_arena_t::name_type arena;
@@ -74,8 +104,25 @@ struct buffer_t {
 
   rsx_size_t mapped_offset, mapped_size;
 
+  // GL_MAP_*_BIT flags that the buffer was mapped with, and the address returned to the
+  // application. A range that the RSX is still using may be mapped through staging memory,
+  // which is copied into the buffer when it's flushed:
+  uint8_t mapped_flags;
+  void * mapped_address;
+  memory_t mapped_staging;
+
+  // Copy of [readback_offset,readback_offset + readback_size) in main memory, made by the RSX
+  // for glReadbackBufferRangeRSX, and ready once readback_timestamp has passed. It's allocated
+  // from the object context's main_buffer_arena, and is readback_capacity bytes long:
+  memory_t readback;
+  rsx_size_t readback_offset, readback_size, readback_capacity;
+  uint64_t readback_timestamp;
+
   buffer_t()
-    : deleted(0), timestamp(0), ref_count(0), invalid(0), usage(0), mapped(0), arena(0), size(0), mapped_offset(0), mapped_size(0) {
+    : deleted(0), timestamp(0), ref_count(0), invalid(0), usage(0), mapped(0), persistent(0),
+      placement_auto(0), placement_queued(0), cpu_writes(0), gpu_reads(0), placement_frame(0), cpu_write_frame(~0U), gpu_read_frame(~0U), pinned(0),
+      arena(0), size(0), mapped_offset(0), mapped_size(0), mapped_flags(0), mapped_address(0),
+      readback_offset(0), readback_size(0), readback_capacity(0), readback_timestamp(0) {
   }
 
   ~buffer_t();
@@ -87,8 +134,29 @@ rsxgl_pointer_to_offset(const void * ptr)
   return (uint32_t)((uint64_t)ptr);
 }
 
+// A mapped buffer can't be used by the RSX, or changed by GL functions, unless it was mapped
+// persistently (GL_RSX_persistent_map):
+static inline bool
+rsxgl_buffer_mapped_exclusive(const buffer_t & buffer)
+{
+  return buffer.mapped != 0 && !buffer.persistent;
+}
+
+// Anything that changes a buffer's contents makes its read back copy stale:
+static inline void
+rsxgl_buffer_invalidate_readback(buffer_t & buffer)
+{
+  buffer.readback_size = 0;
+}
+
 struct rsxgl_context_t;
 
-void rsxgl_buffer_validate(rsxgl_context_t *,buffer_t &,const uint32_t,const uint32_t,const uint32_t);
+// A length of 0 means the rest of the buffer:
+void rsxgl_buffer_validate(rsxgl_context_t *,buffer_t &,const uint32_t,const uint32_t,const uint64_t);
+// Called when a draw reads from the buffer; copies that RSXGL makes for itself don't count:
+void rsxgl_buffer_gpu_read(rsxgl_context_t *,buffer_t &);
+uint64_t rsxgl_buffer_timestamp(const buffer_t &,const uint32_t,const uint32_t);
+void rsxgl_buffer_placement_update(rsxgl_context_t *);
+void rsxgl_buffer_move(rsxgl_context_t *,const buffer_t::name_type,buffer_t &,const memory_arena_t::name_type,const memory_t &);
 
 #endif
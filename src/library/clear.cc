@@ -98,13 +98,18 @@ glClear(GLbitfield mask)
 
   struct rsxgl_context_t * ctx = current_ctx();
   
-  const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+  const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+  gcmContextData * context = ctx -> base.gcm_context;
+
   rsxgl_draw_framebuffer_validate(ctx,timestamp);
+
+  // Recorded, if a command list is open:
+  gcm_record_enter(context);
+
+  gcm_reserve_all(context,rsxgl_state_validate_words(ctx) + 2);
   rsxgl_state_validate(ctx);
   
-  gcmContextData * context = ctx -> base.gcm_context;
-  
-  uint32_t * buffer = gcm_reserve(context,2);
+  uint32_t * buffer = gcm_reserve_unchecked(context,2);
   gcm_emit_method_at(buffer,0,NV30_3D_CLEAR_BUFFERS,1);
   
   const write_mask_t write_mask = ctx -> framebuffer_binding[RSXGL_DRAW_FRAMEBUFFER].complete_write_mask;
@@ -118,8 +123,9 @@ glClear(GLbitfield mask)
 	      (mask & GL_STENCIL_BUFFER_BIT ? (write_mask.parts.stencil ? NV30_3D_CLEAR_BUFFERS_STENCIL : 0) : 0));
   
   gcm_finish_n_commands(context,2);
+  gcm_record_leave(context);
     
-  rsxgl_timestamp_post(ctx,timestamp);
+  rsxgl_timestamp_batch_post(ctx,1);
   
   RSXGL_NOERROR_();
 }
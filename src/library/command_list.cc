@@ -0,0 +1,473 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// command_list.cc - Command lists recorded from draw calls, and replayed with a call command.
+// While a list is being recorded, the commands that draw functions emit are redirected into
+// it (see gcm_record_enter() in gl_fifo.h). Calling the list later costs a single word in the
+// command buffer, plus whatever it takes to set the current framebuffer up.
+
+#include "rsxgl_context.h"
+#include "command_list.h"
+#include "framebuffer.h"
+#include "gl_object_storage.h"
+#include "gl_fifo.h"
+#include "sync.h"
+#include "mem.h"
+
+#include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
+#include "error.h"
+
+#include <rsx/gcm_sys.h>
+
+#include <malloc.h>
+#include <algorithm>
+
+#if defined(GLAPI)
+#undef GLAPI
+#endif
+#define GLAPI extern "C"
+
+command_list_t::storage_type & command_list_t::storage()
+{
+  return current_object_ctx() -> command_list_storage();
+}
+
+// Chunks come from pools of main memory that have been mapped for the RSX, since it can only
+// fetch commands from there:
+static struct command_list_pools_t {
+  uint8_t * address[RSXGL_MAX_COMMAND_LIST_POOLS];
+  uint32_t size[RSXGL_MAX_COMMAND_LIST_POOLS];
+  mspace space[RSXGL_MAX_COMMAND_LIST_POOLS];
+  uint32_t npools;
+} command_list_pools = { { }, { }, { }, 0 };
+
+static bool
+rsxgl_command_list_pool_grow(uint32_t size)
+{
+  if(command_list_pools.npools == RSXGL_MAX_COMMAND_LIST_POOLS) return false;
+
+  // Leave room for the allocator's own bookkeeping:
+  size = std::max((uint32_t)RSXGL_COMMAND_LIST_POOL_SIZE,(size + 4096 + (1024 * 1024 - 1)) & ~(uint32_t)(1024 * 1024 - 1));
+
+  void * address = memalign(1024 * 1024,size);
+  if(address == 0) return false;
+
+  uint32_t offset = 0;
+  if(gcmMapMainMemory(address,size,&offset) != 0) {
+    free(address);
+    return false;
+  }
+
+  const uint32_t i = command_list_pools.npools++;
+  command_list_pools.address[i] = (uint8_t *)address;
+  command_list_pools.size[i] = size;
+  command_list_pools.space[i] = create_mspace_with_base(address,size,0);
+
+  rsxgl_debug_printf("%s: %u bytes at %lx\n",__PRETTY_FUNCTION__,size,(unsigned long)address);
+
+  return true;
+}
+
+static command_list_t::chunk_t *
+rsxgl_command_list_chunk_create(const uint32_t length)
+{
+  const uint32_t size = sizeof(command_list_t::chunk_t) + length * sizeof(uint32_t);
+
+  void * address = 0;
+  for(uint32_t i = 0;i < command_list_pools.npools && address == 0;++i) {
+    address = mspace_memalign(command_list_pools.space[i],16,size);
+  }
+
+  if(address == 0) {
+    if(!rsxgl_command_list_pool_grow(size)) return 0;
+    address = mspace_memalign(command_list_pools.space[command_list_pools.npools - 1],16,size);
+    if(address == 0) return 0;
+  }
+
+  command_list_t::chunk_t * chunk = (command_list_t::chunk_t *)address;
+  chunk -> next = 0;
+  chunk -> length = length;
+
+  int32_t s = gcmAddressToOffset(chunk + 1,&chunk -> offset);
+  rsxgl_assert(s == 0);
+
+  return chunk;
+}
+
+static void
+rsxgl_command_list_chunk_destroy(command_list_t::chunk_t * chunk)
+{
+  for(uint32_t i = 0;i < command_list_pools.npools;++i) {
+    if((uint8_t *)chunk >= command_list_pools.address[i] && (uint8_t *)chunk < (command_list_pools.address[i] + command_list_pools.size[i])) {
+      mspace_free(command_list_pools.space[i],chunk);
+      return;
+    }
+  }
+  rsxgl_assert(0);
+}
+
+static inline uint32_t *
+rsxgl_command_list_chunk_begin(command_list_t::chunk_t * chunk)
+{
+  return (uint32_t *)(chunk + 1);
+}
+
+template< typename Object >
+static inline void
+rsxgl_command_list_reference(std::vector< typename Object::name_type > & names,const typename Object::name_type name)
+{
+  if(name == 0 || std::find(names.begin(),names.end(),name) != names.end()) return;
+
+  Object::gl_object_type::ref(name);
+  names.push_back(name);
+}
+
+template< typename Object >
+static inline void
+rsxgl_command_list_unreference(std::vector< typename Object::name_type > & names)
+{
+  std::for_each(names.begin(),names.end(),Object::gl_object_type::unref_and_maybe_delete);
+  names.clear();
+}
+
+// Objects are pinned by every recorded list that refers to them, and unpinned when the list
+// is cleared; while pinned, their storage stays where it is:
+template< typename Object >
+static inline void
+rsxgl_command_list_pin(const std::vector< typename Object::name_type > & names,const int delta)
+{
+  for(typename std::vector< typename Object::name_type >::const_iterator it = names.begin(),it_end = names.end();it != it_end;++it) {
+    Object::storage().at(*it).pinned += delta;
+  }
+}
+
+// Throw away a list's contents. The RSX must be done with them:
+static void
+rsxgl_command_list_clear(command_list_t & list)
+{
+  for(command_list_t::chunk_t * chunk = list.chunks;chunk != 0;) {
+    command_list_t::chunk_t * next = chunk -> next;
+    rsxgl_command_list_chunk_destroy(chunk);
+    chunk = next;
+  }
+
+  list.chunks = 0;
+  list.last_chunk = 0;
+  list.overflow = 0;
+
+  if(list.pinned) {
+    rsxgl_command_list_pin< buffer_t >(list.buffers,-1);
+    rsxgl_command_list_pin< texture_t >(list.textures,-1);
+    rsxgl_command_list_pin< program_t >(list.programs,-1);
+    list.pinned = 0;
+  }
+
+  rsxgl_command_list_unreference< buffer_t >(list.buffers);
+  rsxgl_command_list_unreference< texture_t >(list.textures);
+  rsxgl_command_list_unreference< program_t >(list.programs);
+}
+
+// The RSX's state, as far as the context is concerned, is unknown after a list has been
+// recorded or called:
+static void
+rsxgl_command_list_invalidate(rsxgl_context_t * ctx)
+{
+  ctx -> state.invalid.all = ~0;
+  ctx -> invalid.all = ~0;
+
+  // What the RSX holds depends upon whether it's running the list or the commands around it:
+  gcm_shadow_invalidate();
+
+  ctx -> invalid_attribs.set();
+  ctx -> invalid_attrib_assignments.set();
+  ctx -> invalid_textures.set();
+  ctx -> invalid_texture_assignments.set();
+  ctx -> invalid_samplers.set();
+
+  if(ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM] != 0) {
+    ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].invalid_uniforms = 1;
+  }
+}
+
+// Wait until the RSX is no longer executing a list:
+static void
+rsxgl_command_list_wait(rsxgl_context_t * ctx,command_list_t & list)
+{
+  if(list.timestamp > 0) {
+    rsxgl_timestamp_wait(ctx,list.timestamp,RSXGL_STALL_COMMAND_LIST);
+  }
+  list.timestamp = 0;
+}
+
+void
+rsxgl_command_list_reference_draw(rsxgl_context_t * ctx,program_t & program)
+{
+  rsxgl_assert(ctx -> command_list != 0);
+  command_list_t & list = command_list_t::storage().at(ctx -> command_list);
+
+  rsxgl_command_list_reference< program_t >(list.programs,ctx -> program_binding.names[RSXGL_ACTIVE_PROGRAM]);
+  rsxgl_command_list_reference< buffer_t >(list.buffers,ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER]);
+
+  // Buffers that the program's attributes are fetched from:
+  {
+    const program_t::attribs_bitfield_type attribs_enabled = program.attribs_enabled;
+    const program_t::attrib_assignments_type attrib_assignments = program.attrib_assignments;
+
+    program_t::attribs_bitfield_type::const_iterator enabled_it = attribs_enabled.begin();
+    program_t::attrib_assignments_type::const_iterator assignment_it = attrib_assignments.begin();
+
+    attribs_t & attribs = ctx -> attribs_binding[0];
+
+    for(program_t::attrib_size_type index = 0;index < RSXGL_MAX_VERTEX_ATTRIBS;++index,enabled_it.next(attribs_enabled),assignment_it.next(attrib_assignments)) {
+      if(!enabled_it.test()) continue;
+
+      const program_t::attrib_size_type api_index = assignment_it.value();
+      if(attribs.enabled.test(api_index)) {
+	rsxgl_command_list_reference< buffer_t >(list.buffers,attribs.buffers.names[api_index]);
+      }
+    }
+  }
+
+  // Textures that the program samples from:
+  {
+    const program_t::textures_bitfield_type textures_enabled = program.textures_enabled;
+    const program_t::texture_assignments_type texture_assignments = program.texture_assignments;
+
+    program_t::textures_bitfield_type::const_iterator enabled_it = textures_enabled.begin();
+    program_t::texture_assignments_type::const_iterator assignment_it = texture_assignments.begin();
+
+    for(program_t::texture_size_type index = 0;index < (RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS + RSXGL_MAX_TEXTURE_IMAGE_UNITS);++index,enabled_it.next(textures_enabled),assignment_it.next(texture_assignments)) {
+      if(!enabled_it.test()) continue;
+
+      rsxgl_command_list_reference< texture_t >(list.textures,ctx -> texture_binding.names[assignment_it.value()]);
+    }
+  }
+}
+
+// Called by gcm_reserve_slow() when the list being recorded runs out of room:
+extern "C" void
+gcm_record_next(gcmContextData * context,const uint32_t length)
+{
+  command_list_t & list = command_list_t::storage().at(current_ctx() -> command_list);
+
+  command_list_t::chunk_t * chunk = rsxgl_command_list_chunk_create(std::max((uint32_t)RSXGL_COMMAND_LIST_CHUNK_LENGTH,length + 1));
+
+  // Out of memory - start over at the beginning of the current chunk. glEndCommandListRSX
+  // will report the failure and throw away whatever was recorded:
+  if(chunk == 0) {
+    rsxgl_assert((context -> begin + length) <= context -> end);
+    list.overflow = 1;
+    context -> current = context -> begin;
+    return;
+  }
+
+  // There's always one word left over at the end of a chunk for this jump:
+  gcm_emit_at(context -> current,0,gcm_jump_cmd(chunk -> offset));
+
+  list.last_chunk -> next = chunk;
+  list.last_chunk = chunk;
+
+  context -> begin = rsxgl_command_list_chunk_begin(chunk);
+  context -> current = context -> begin;
+  context -> end = context -> begin + chunk -> length - 1;
+}
+
+GLAPI void APIENTRY
+glGenCommandListsRSX(GLsizei n,GLuint * lists)
+{
+  if(n < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  GLsizei count = command_list_t::storage().create_names(n,lists);
+
+  if(count != n) {
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glDeleteCommandListsRSX(GLsizei n,const GLuint * lists)
+{
+  if(n < 0) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  rsxgl_context_t * ctx = current_ctx();
+
+  for(GLsizei i = 0;i < n;++i,++lists) {
+    const GLuint list_name = *lists;
+
+    if(list_name == 0) continue;
+
+    if(list_name == ctx -> command_list) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    if(command_list_t::storage().is_object(list_name)) {
+      command_list_t & list = command_list_t::storage().at(list_name);
+      rsxgl_command_list_wait(ctx,list);
+      rsxgl_command_list_clear(list);
+
+      command_list_t::storage().destroy(list_name);
+    }
+    else if(command_list_t::storage().is_name(list_name)) {
+      command_list_t::storage().destroy(list_name);
+    }
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI GLboolean APIENTRY
+glIsCommandListRSX(GLuint list)
+{
+  return command_list_t::storage().is_object(list);
+}
+
+GLAPI void APIENTRY
+glBeginCommandListRSX(GLuint list_name)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(ctx -> command_list != 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  if(list_name == 0 || !command_list_t::storage().is_name(list_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+  else if(!command_list_t::storage().is_object(list_name)) {
+    command_list_t::storage().create_object(list_name);
+  }
+
+  command_list_t & list = command_list_t::storage().at(list_name);
+
+  // Re-recording - the previous contents may still be in use:
+  if(list.chunks != 0) {
+    rsxgl_command_list_wait(ctx,list);
+    rsxgl_command_list_clear(list);
+  }
+
+  list.chunks = rsxgl_command_list_chunk_create(RSXGL_COMMAND_LIST_CHUNK_LENGTH);
+  if(list.chunks == 0) {
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+  list.last_chunk = list.chunks;
+
+  gcm_record.begin = rsxgl_command_list_chunk_begin(list.chunks);
+  gcm_record.current = gcm_record.begin;
+  gcm_record.end = gcm_record.begin + list.chunks -> length - 1;
+  gcm_record.open = 1;
+
+  ctx -> command_list = list_name;
+
+  // The list mustn't depend upon state set up before it:
+  rsxgl_command_list_invalidate(ctx);
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glEndCommandListRSX()
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(ctx -> command_list == 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  command_list_t & list = command_list_t::storage().at(ctx -> command_list);
+  gcmContextData * context = ctx -> gcm_context();
+
+  gcm_record_enter(context);
+
+  uint32_t * buffer = gcm_reserve(context,1);
+  gcm_emit_at(buffer,0,gcm_return_cmd());
+  gcm_finish_n_commands(context,1);
+
+  gcm_record_leave(context);
+  gcm_record.open = 0;
+
+  ctx -> command_list = 0;
+
+  // None of the state that the list set up has actually been sent to the RSX:
+  rsxgl_command_list_invalidate(ctx);
+
+  if(list.overflow) {
+    rsxgl_command_list_clear(list);
+    RSXGL_ERROR_(GL_OUT_OF_MEMORY);
+  }
+
+  // The list has the buffers' and textures' addresses, and the programs' microcode offsets,
+  // baked into it, so they mustn't move until it's cleared:
+  rsxgl_command_list_pin< buffer_t >(list.buffers,1);
+  rsxgl_command_list_pin< texture_t >(list.textures,1);
+  rsxgl_command_list_pin< program_t >(list.programs,1);
+  list.pinned = 1;
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glCallCommandListRSX(GLuint list_name)
+{
+  rsxgl_context_t * ctx = current_ctx();
+
+  if(ctx -> command_list != 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
+  if(!command_list_t::storage().is_name(list_name)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
+  }
+
+  if(!command_list_t::storage().is_object(list_name)) {
+    RSXGL_NOERROR_();
+  }
+
+  command_list_t & list = command_list_t::storage().at(list_name);
+
+  if(list.chunks == 0) {
+    RSXGL_NOERROR_();
+  }
+
+  gcmContextData * context = ctx -> gcm_context();
+  const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+
+  // Lists draw into whatever framebuffer is current when they're called:
+  rsxgl_draw_framebuffer_validate(ctx,timestamp);
+
+  uint32_t * buffer = gcm_reserve(context,1);
+  gcm_emit_at(buffer,0,gcm_call_cmd(list.chunks -> offset));
+  gcm_finish_n_commands(context,1);
+
+  rsxgl_timestamp_batch_post(ctx,1);
+  list.timestamp = timestamp;
+
+  // Everything that the list refers to is in use until timestamp:
+  for(std::vector< buffer_t::name_type >::const_iterator it = list.buffers.begin(),it_end = list.buffers.end();it != it_end;++it) {
+    rsxgl_buffer_validate(ctx,buffer_t::storage().at(*it),0,0,timestamp);
+    rsxgl_buffer_gpu_read(ctx,buffer_t::storage().at(*it));
+  }
+  for(std::vector< texture_t::name_type >::const_iterator it = list.textures.begin(),it_end = list.textures.end();it != it_end;++it) {
+    texture_t::storage().at(*it).timestamp = timestamp;
+  }
+  for(std::vector< program_t::name_type >::const_iterator it = list.programs.begin(),it_end = list.programs.end();it != it_end;++it) {
+    program_t & program = program_t::storage().at(*it);
+    program.timestamp = timestamp;
+
+    // Fragment program constants are patched into the program itself, and the list may
+    // have left different values there:
+    program.invalid_uniforms = 1;
+  }
+
+  rsxgl_command_list_invalidate(ctx);
+  rsxgl_gcm_autoflush_draw(context);
+
+  RSXGL_NOERROR_();
+}
@@ -0,0 +1,59 @@
+//-*-C++-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// command_list.h - Command lists recorded from draw calls, and replayed with a call command.
+
+#ifndef rsxgl_command_list_H
+#define rsxgl_command_list_H
+
+#include "gl_constants.h"
+#include "rsxgl_limits.h"
+#include "gl_object.h"
+#include "buffer.h"
+#include "textures.h"
+#include "program.h"
+
+#include <vector>
+
+struct command_list_t {
+  typedef gl_object< command_list_t, RSXGL_MAX_COMMAND_LISTS > gl_object_type;
+  typedef typename gl_object_type::name_type name_type;
+  typedef typename gl_object_type::storage_type storage_type;
+
+  static storage_type & storage();
+
+  // Commands are written into chunks of RSX-mapped main memory, which are chained together
+  // by jump commands. The header of each chunk links it to the next one:
+  struct chunk_t {
+    chunk_t * next;
+    uint32_t offset, length;
+  };
+
+  chunk_t * chunks, * last_chunk;
+
+  // overflow is set if a chunk couldn't be allocated while the list was being recorded;
+  // pinned once the list has pinned its buffers and textures. timestamp is that of the last
+  // call to the list:
+  uint32_t overflow:1, pinned:1;
+  uint64_t timestamp;
+
+  // Objects that the list's commands refer to. Each of them is referenced for as long as the
+  // list's contents exist, and is considered to be in use by the RSX whenever the list is called:
+  std::vector< buffer_t::name_type > buffers;
+  std::vector< texture_t::name_type > textures;
+  std::vector< program_t::name_type > programs;
+
+  command_list_t()
+    : chunks(0), last_chunk(0), overflow(0), pinned(0), timestamp(0) {
+  }
+};
+
+struct rsxgl_context_t;
+
+// Called by draw functions while a list is being recorded, so that it can hold onto the
+// objects used by the draw:
+void rsxgl_command_list_reference_draw(rsxgl_context_t *,program_t &);
+
+#endif
@@ -39,6 +39,34 @@
 
 extern "C" double drand48();
 
+#if RSXGL_CONFIG_draw_profile
+// Time spent in each step of rsxgl_draw, in time base ticks. Read with glGetDrawProfileui64vRSX:
+enum rsxgl_draw_profile_steps {
+  RSXGL_DRAW_PROFILE_STORAGE = 0,
+  RSXGL_DRAW_PROFILE_PROGRAM,
+  RSXGL_DRAW_PROFILE_STATE,
+  RSXGL_DRAW_PROFILE_ATTRIBS,
+  RSXGL_DRAW_PROFILE_UNIFORMS,
+  RSXGL_DRAW_PROFILE_TEXTURES,
+  RSXGL_DRAW_PROFILE_COMMANDS,
+  RSXGL_DRAW_PROFILE_TOTAL,
+  RSXGL_MAX_DRAW_PROFILE_STEPS
+};
+
+static struct {
+  uint64_t draws;
+  uint64_t ticks[RSXGL_MAX_DRAW_PROFILE_STEPS];
+} rsxgl_draw_profile = { 0, { 0 } };
+
+#define RSXGL_DRAW_PROFILE_BEGIN() const uint64_t _profile_begin = __mftb(); uint64_t _profile_last = _profile_begin
+#define RSXGL_DRAW_PROFILE_STEP(STEP) { const uint64_t _profile_now = __mftb(); rsxgl_draw_profile.ticks[(STEP)] += _profile_now - _profile_last; _profile_last = _profile_now; }
+#define RSXGL_DRAW_PROFILE_END() { rsxgl_draw_profile.ticks[RSXGL_DRAW_PROFILE_TOTAL] += __mftb() - _profile_begin; ++rsxgl_draw_profile.draws; }
+#else
+#define RSXGL_DRAW_PROFILE_BEGIN()
+#define RSXGL_DRAW_PROFILE_STEP(STEP)
+#define RSXGL_DRAW_PROFILE_END()
+#endif
+
 static inline uint32_t
 rsxgl_draw_mode(GLenum mode)
 {
@@ -94,7 +122,7 @@ rsxgl_check_unmapped_arrays(rsxgl_context_t * ctx,const bit_set< RSXGL_MAX_VERTE
   const bit_set< RSXGL_MAX_VERTEX_ATTRIBS > enabled_attribs = attribs.enabled & program_attribs;
 
   for(size_t i = 0;i < RSXGL_MAX_VERTEX_ATTRIBS;++i) {
-    if(enabled_attribs.test(i) && attribs.buffers.names[i] != 0 && attribs.buffers[i].mapped) {
+    if(enabled_attribs.test(i) && attribs.buffers.names[i] != 0 && rsxgl_buffer_mapped_exclusive(attribs.buffers[i])) {
       RSXGL_ERROR_(GL_INVALID_OPERATION);
     }
   }
@@ -116,8 +144,25 @@ rsxgl_check_transform_feedback(const rsxgl_context_t * ctx,uint32_t rsx_primitiv
   }
 }
 
+// Commands recorded into a command list can't refer to memory that only lasts for the draw
+// call (client-side indices), or to other parts of the command buffer (the subroutine that
+// instanced draws call - the RSX can't nest calls). Transform feedback isn't recorded either:
+static inline void
+rsxgl_check_command_list(rsxgl_context_t * ctx,const bool client_indices,const GLsizei primcount)
+{
+  if(ctx -> command_list == 0) return;
+
+  const program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
+
+  if(client_indices ||
+     (primcount > 1 && program.instanceid_index != ~0) ||
+     ctx -> state.enable.transform_feedback_mode != 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+}
+
 static inline uint32_t
-rsxgl_check_draw_arrays(rsxgl_context_t * ctx,GLenum mode)
+rsxgl_check_draw_arrays(rsxgl_context_t * ctx,GLenum mode,const GLsizei primcount = 1)
 {
   const uint32_t rsx_primitive_type = rsxgl_draw_mode(mode);
   RSXGL_FORWARD_ERROR(~0);
@@ -136,11 +181,14 @@ rsxgl_check_draw_arrays(rsxgl_context_t * ctx,GLenum mode)
   rsxgl_check_transform_feedback(ctx,rsx_primitive_type);
   RSXGL_FORWARD_ERROR(~0);
 
+  rsxgl_check_command_list(ctx,false,primcount);
+  RSXGL_FORWARD_ERROR(~0);
+
   return rsx_primitive_type;
 }
 
 static inline std::pair< uint32_t, uint32_t >
-rsxgl_check_draw_elements(rsxgl_context_t * ctx,GLenum mode,GLenum type)
+rsxgl_check_draw_elements(rsxgl_context_t * ctx,GLenum mode,GLenum type,const GLsizei primcount = 1)
 {
   const uint32_t rsx_primitive_type = rsxgl_draw_mode(mode);
   RSXGL_FORWARD_ERROR(std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES));
@@ -164,6 +212,9 @@ rsxgl_check_draw_elements(rsxgl_context_t * ctx,GLenum mode,GLenum type)
   rsxgl_check_transform_feedback(ctx,rsx_primitive_type);
   RSXGL_FORWARD_ERROR(std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES));
 
+  rsxgl_check_command_list(ctx,ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] == 0,primcount);
+  RSXGL_FORWARD_ERROR(std::make_pair(~0U, RSXGL_MAX_ELEMENT_TYPES));
+
   return std::make_pair(rsx_primitive_type,rsx_element_type);
 }
 
@@ -535,36 +586,64 @@ namespace {
     rsxgl_debug_printf("%s\n",__PRETTY_FUNCTION__);
 #endif
 
+    RSXGL_DRAW_PROFILE_BEGIN();
+
     // Compute the range of array elements used by this draw call:
     const std::pair< uint32_t, uint32_t > index_range = elementRangePolicy.range();
 
     // Iteration:
     typename IterationPolicy::iterator it = iterationPolicy.begin(), it_end = iterationPolicy.end();
 
-    // Timestamps, determined by the number of iterations:
+    // Every iteration shares the batched timestamp:
     const size_t timestampCount = it_end - it;
-    uint32_t timestamp = rsxgl_timestamp_create(ctx,timestampCount);
-    const uint32_t lastTimestamp = timestamp + timestampCount - 1;
+    const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+
+    gcmContextData * gcm_context = ctx -> gcm_context();
+    program_t & program = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM];
+
+    // Validate state. Steps that may upload data do their own space checks. The framebuffer
+    // and texture storage aren't captured by command lists, so they go straight to the RSX:
+    rsxgl_draw_framebuffer_validate(ctx,timestamp);
+    rsxgl_textures_validate_storage(ctx,program,timestamp);
+    RSXGL_DRAW_PROFILE_STEP(RSXGL_DRAW_PROFILE_STORAGE);
+
+    // Everything from here on is recorded, if a command list is open:
+    if(ctx -> command_list != 0) {
+      rsxgl_command_list_reference_draw(ctx,program);
+      gcm_record_enter(gcm_context);
+    }
+
+    rsxgl_program_validate(ctx,timestamp);
+    RSXGL_DRAW_PROFILE_STEP(RSXGL_DRAW_PROFILE_PROGRAM);
+
+    // The remaining validators emit without checking for space, so reserve enough for all of them at once:
+    gcm_reserve_all(gcm_context,
+		    rsxgl_state_validate_words(ctx) +
+		    rsxgl_attribs_validate_words(ctx,program) +
+		    rsxgl_uniforms_validate_words(ctx,program) +
+		    rsxgl_textures_validate_words(ctx,program));
 
-    // Validate state:
-    rsxgl_draw_framebuffer_validate(ctx,lastTimestamp);
     rsxgl_state_validate(ctx);
-    rsxgl_program_validate(ctx,lastTimestamp);
-    rsxgl_attribs_validate(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM],index_range.first,index_range.second,lastTimestamp);
-    rsxgl_uniforms_validate(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM]);
-    rsxgl_textures_validate(ctx,ctx -> program_binding[RSXGL_ACTIVE_PROGRAM],lastTimestamp);
+    RSXGL_DRAW_PROFILE_STEP(RSXGL_DRAW_PROFILE_STATE);
+    rsxgl_attribs_validate(ctx,program,index_range.first,index_range.second,timestamp);
+    RSXGL_DRAW_PROFILE_STEP(RSXGL_DRAW_PROFILE_ATTRIBS);
+    rsxgl_uniforms_validate(ctx,program);
+    RSXGL_DRAW_PROFILE_STEP(RSXGL_DRAW_PROFILE_UNIFORMS);
+    rsxgl_textures_validate(ctx,program,timestamp);
+    RSXGL_DRAW_PROFILE_STEP(RSXGL_DRAW_PROFILE_TEXTURES);
 
     // Draw functions:
-    gcmContextData * gcm_context = ctx -> gcm_context();
 
     if(!ctx -> state.enable.rasterizer_discard) {
       drawPolicy.begin(gcm_context,timestamp);
-      for(;it != it_end;++it,++timestamp) {
+      for(;it != it_end;++it) {
 	drawPolicy.draw(gcm_context,timestamp,it);
-	rsxgl_timestamp_post(ctx,timestamp);
       }
       drawPolicy.end(gcm_context,timestamp);
+
+      rsxgl_gcm_autoflush_draw(gcm_context);
     }
+    RSXGL_DRAW_PROFILE_STEP(RSXGL_DRAW_PROFILE_COMMANDS);
 
     // Transform feedback:
     if(ctx -> state.enable.transform_feedback_mode != 0) {
@@ -576,32 +655,27 @@ namespace {
 
 	const uint32_t vertexid_index = ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].streamvp_vertexid_index;
 
-	rsxgl_feedback_framebuffer_validate(ctx,0,count,lastTimestamp);
+	rsxgl_feedback_framebuffer_validate(ctx,0,count,timestamp);
 
 	// set feedback "viewport":
 	{
+	  const uint32_t transform[8] = {
+	    _ieee32_t(0.0f).u,
+	    _ieee32_t(0.0f).u,
+	    _ieee32_t(0.5f).u,
+	    _ieee32_t(0.0f).u,
+	    _ieee32_t(1.0f).u,
+	    _ieee32_t(1.0f).u,
+	    _ieee32_t(0.0f).u,
+	    _ieee32_t(0.0f).u
+	  };
+
 	  uint32_t * buffer = gcm_reserve(gcm_context,17);
 
-	  gcm_emit_method(&buffer,NV30_3D_VIEWPORT_HORIZ,2);
-	  gcm_emit(&buffer,((uint32_t)w << 16));
-	  gcm_emit(&buffer,((uint32_t)h << 16));
-	  
-	  gcm_emit_method(&buffer,NV30_3D_DEPTH_RANGE_NEAR,2);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(1.0f).u);
-	  
-	  gcm_emit_method(&buffer,NV30_3D_VIEWPORT_TRANSLATE,8);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.5f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(1.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(1.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  gcm_emit(&buffer,_ieee32_t(0.0f).u);
-	  
-	  gcm_emit_method(&buffer,NV30_3D_DEPTH_CONTROL,1);
-	  gcm_emit(&buffer,((uint32_t)0));
+	  gcm_emit_shadowed2(&buffer,NV30_3D_VIEWPORT_HORIZ,((uint32_t)w << 16),((uint32_t)h << 16));
+	  gcm_emit_shadowed2(&buffer,NV30_3D_DEPTH_RANGE_NEAR,_ieee32_t(0.0f).u,_ieee32_t(1.0f).u);
+	  gcm_emit_shadowed(&buffer,NV30_3D_VIEWPORT_TRANSLATE,transform,8);
+	  gcm_emit_shadowed1(&buffer,NV30_3D_DEPTH_CONTROL,0);
 	  
 	  gcm_finish_commands(gcm_context,&buffer);
 	}
@@ -610,23 +684,21 @@ namespace {
 	{
 	  uint32_t * buffer = gcm_reserve(gcm_context,2);
 
-	  gcm_emit_method_at(buffer,0,NV30_3D_DEPTH_TEST_ENABLE,1);
-	  gcm_emit_at(buffer,1,0);
+	  gcm_emit_shadowed1(&buffer,NV30_3D_DEPTH_TEST_ENABLE,0);
 	  
-	  gcm_finish_n_commands(gcm_context,2);
+	  gcm_finish_commands(gcm_context,&buffer);
 	}
 
 	// point size:
 	{
 	  uint32_t * buffer = gcm_reserve(gcm_context,2);
 	  
-	  gcm_emit_method_at(buffer,0,NV30_3D_POINT_SIZE,1);
-	  gcm_emit_at(buffer,1,_ieee32_t(1.0f).u);
+	  gcm_emit_shadowed1(&buffer,NV30_3D_POINT_SIZE,_ieee32_t(1.0f).u);
 	  
-	  gcm_finish_n_commands(gcm_context,2);
+	  gcm_finish_commands(gcm_context,&buffer);
 	}
 
-	rsxgl_feedback_program_validate(ctx,lastTimestamp);
+	rsxgl_feedback_program_validate(ctx,timestamp);
 
 	// invalidate vertex cache
 	{
@@ -651,15 +723,13 @@ namespace {
 	{
 	  uint32_t * buffer = gcm_reserve(gcm_context,4);
 
-	  gcm_emit_method_at(buffer,0,NV30_3D_VTXBUF(vertexid_index),1);
-	  gcm_emit_at(buffer,1,0);
-	  gcm_emit_method_at(buffer,2,NV30_3D_VTXFMT(vertexid_index),1);
-	  gcm_emit_at(buffer,3,
-		      0 |
-		      0 |
-		      ((uint32_t)RSXGL_VERTEX_S16_UN & 0x7));
+	  gcm_emit_shadowed1(&buffer,NV30_3D_VTXBUF(vertexid_index),0);
+	  gcm_emit_shadowed1(&buffer,NV30_3D_VTXFMT(vertexid_index),
+			     0 |
+			     0 |
+			     ((uint32_t)RSXGL_VERTEX_S16_UN & 0x7));
 	  
-	  gcm_finish_n_commands(gcm_context,4);
+	  gcm_finish_commands(gcm_context,&buffer);
 	}
 
 	// Draw this stuff:
@@ -706,6 +776,9 @@ namespace {
 	  buffer += 2;
 
 	  gcm_finish_n_commands(gcm_context,ncommands);
+
+	  // The vertex id was sent as VTX_ATTR_2I, which overwrites the attribute's constant value:
+	  gcm_shadow_forget(NV30_3D_VTX_ATTR_4F(vertexid_index),4);
 	}
 	
 	// For the next draw invocation:
@@ -717,6 +790,12 @@ namespace {
 	ctx -> invalid_attribs.set(vertexid_index);
       }
     }
+
+    gcm_record_leave(gcm_context);
+
+    rsxgl_timestamp_batch_post(ctx,timestampCount);
+
+    RSXGL_DRAW_PROFILE_END();
   }
 
   struct ignore_element_range_policy {
@@ -853,7 +932,7 @@ namespace {
     mutable uint32_t migrate_buffer_size;
     mutable uint32_t index_buffer_offset, index_buffer_location;
 
-    void begin(gcmContextData * context,uint32_t timestamp,const GLsizei * count,const GLvoid * const* indices,GLsizei primcount,uint32_t * offsets) const {
+    void begin(gcmContextData * context,uint64_t timestamp,const GLsizei * count,const GLvoid * const* indices,GLsizei primcount,uint32_t * offsets) const {
       static const uint8_t rsxgl_element_type_bytes[RSXGL_MAX_ELEMENT_TYPES] = {
 	sizeof(uint32_t),
 	sizeof(uint16_t),
@@ -901,7 +980,8 @@ namespace {
 	  ++offsets;
 	}
 
-	rsxgl_buffer_validate(ctx,ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER],start,end - start,timestamp + primcount - 1);
+	rsxgl_buffer_validate(ctx,ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER],start,end - start,timestamp);
+	rsxgl_buffer_gpu_read(ctx,ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER]);
 	
 	const buffer_t & index_buffer = ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER];
 	index_buffer_offset = index_buffer.memory.offset;
@@ -1015,6 +1095,14 @@ namespace {
     void beginInstance(gcmContextData * gcm_context,uint32_t nwords) const {
       gcm_reserve(gcm_context,nwords + 2);
 
+      // The instances' CALLs may spill into other segments; keep the body's segment from being
+      // reused until the last of them has been read:
+      gcm_segments_pin();
+
+      // The RSX mustn't be flushed into the middle of the instance body, which starts out
+      // with a jump over it:
+      gcm_autoflush_suspend();
+
       // call location - current position + 1
       // jump location - current position + 1 word + nwords + 1 word
       call_offset = 0;
@@ -1034,6 +1122,11 @@ namespace {
 
     void endInstance(gcmContextData * gcm_context) const {
       gcm_emit_at(gcm_context -> current,0,gcm_return_cmd()); ++gcm_context -> current;
+      gcm_autoflush_resume(gcm_context);
+    }
+
+    void endInstances(gcmContextData * gcm_context) const {
+      gcm_segments_unpin(gcm_context);
     }
 
     void draw(gcmContextData * gcm_context,unsigned int i) const {
@@ -1168,11 +1261,11 @@ namespace {
     
     draw_elements_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,GLsizei _count,const GLvoid * _indices) : element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), count(_count), indices(_indices) {}
     
-    void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
+    void begin(gcmContextData * gcm_context,uint64_t timestamp) const {
       element_draw_policy::begin(gcm_context,timestamp,&count,&indices,1,&offset);
     }
 
-    void draw(gcmContextData * gcm_context,uint32_t timestamp,unsigned int) const {
+    void draw(gcmContextData * gcm_context,uint64_t timestamp,unsigned int) const {
       element_draw_policy::emitIndexBufferCommands(gcm_context,offset);
       element_draw_policy::emitDrawCommands(gcm_context,count);
     }
@@ -1202,7 +1295,7 @@ glDrawElements (GLenum mode, GLsizei count, GLenum type, const GLvoid* indices)
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && rsxgl_buffer_mapped_exclusive(ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER])) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1231,7 +1324,7 @@ glDrawRangeElements (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenu
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && rsxgl_buffer_mapped_exclusive(ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER])) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1252,17 +1345,17 @@ namespace {
     
     draw_elements_base_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,GLsizei _count,const GLvoid * _indices,GLint _basevertex) : element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), count(_count), indices(_indices), basevertex(_basevertex) {}
     
-    void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
+    void begin(gcmContextData * gcm_context,uint64_t timestamp) const {
       element_draw_policy::begin(gcm_context,timestamp,&count,&indices,1,&offset);
     }
     
-    void draw(gcmContextData * gcm_context,uint32_t timestamp,unsigned int) const {
+    void draw(gcmContextData * gcm_context,uint64_t timestamp,unsigned int) const {
       base_element_draw_policy::draw(gcm_context,basevertex);
       element_draw_policy::emitIndexBufferCommands(gcm_context,offset);
       element_draw_policy::emitDrawCommands(gcm_context,count);
     }
     
-    void end(gcmContextData * gcm_context,uint32_t timestamp) const {
+    void end(gcmContextData * gcm_context,uint64_t timestamp) const {
       element_draw_policy::end(gcm_context);
       base_element_draw_policy::end(gcm_context);
     }
@@ -1283,7 +1376,7 @@ glDrawElementsBaseVertex (GLenum mode, GLsizei count, GLenum type, const GLvoid
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && rsxgl_buffer_mapped_exclusive(ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER])) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1312,7 +1405,7 @@ glDrawRangeElementsBaseVertex (GLenum mode, GLuint start, GLuint end, GLsizei co
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && rsxgl_buffer_mapped_exclusive(ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER])) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1337,7 +1430,7 @@ glMultiDrawElements (const GLenum mode, const GLsizei *count, GLenum type, const
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && rsxgl_buffer_mapped_exclusive(ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER])) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1351,11 +1444,11 @@ glMultiDrawElements (const GLenum mode, const GLsizei *count, GLenum type, const
 
       draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,const GLsizei * _count,const GLvoid * const * _indices,GLsizei _primcount) : element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), multi_draw_policy(_ctx), count(_count), indices(_indices), primcount(_primcount), offsets(new uint32_t[primcount]) {}
       
-      void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
+      void begin(gcmContextData * gcm_context,uint64_t timestamp) const {
 	element_draw_policy::begin(gcm_context,timestamp,count,indices,primcount,offsets.get());
       }
       
-      void draw(gcmContextData * gcm_context,uint32_t timestamp,unsigned int i) const {
+      void draw(gcmContextData * gcm_context,uint64_t timestamp,unsigned int i) const {
 	element_draw_policy::emitIndexBufferCommands(gcm_context,offsets.get()[i]);
 	element_draw_policy::emitDrawCommands(gcm_context,count[i]);
 
@@ -1387,7 +1480,7 @@ glMultiDrawElementsBaseVertex (GLenum mode, const GLsizei *count, GLenum type, c
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER].mapped) {
+  if(ctx -> buffer_binding.names[RSXGL_ELEMENT_ARRAY_BUFFER] != 0 && rsxgl_buffer_mapped_exclusive(ctx -> buffer_binding[RSXGL_ELEMENT_ARRAY_BUFFER])) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1402,11 +1495,11 @@ glMultiDrawElementsBaseVertex (GLenum mode, const GLsizei *count, GLenum type, c
 
       draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,const GLsizei * _count,const GLvoid * const * _indices,GLsizei _primcount,const GLint * _basevertex) : element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), multi_draw_policy(_ctx), count(_count), indices(_indices), primcount(_primcount), basevertex(_basevertex), offsets(new uint32_t[primcount]) {}
       
-      void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
+      void begin(gcmContextData * gcm_context,uint64_t timestamp) const {
 	element_draw_policy::begin(gcm_context,timestamp,count,indices,primcount,offsets.get());
       }
       
-      void draw(gcmContextData * gcm_context,uint32_t timestamp,unsigned int i) const {
+      void draw(gcmContextData * gcm_context,uint64_t timestamp,unsigned int i) const {
 	base_element_draw_policy::draw(gcm_context,basevertex[i]);
 	element_draw_policy::emitIndexBufferCommands(gcm_context,offsets.get()[i]);
 	element_draw_policy::emitDrawCommands(gcm_context,count[i]);
@@ -1432,7 +1525,7 @@ glDrawArraysInstanced (GLenum mode, GLint first, GLsizei count, GLsizei primcoun
   gcmContextData * context = ctx -> gcm_context();
 
   RSXGL_FORWARD_ERROR_BEGIN();
-  const uint32_t rsx_primitive_type = rsxgl_check_draw_arrays(ctx,mode);
+  const uint32_t rsx_primitive_type = rsxgl_check_draw_arrays(ctx,mode,primcount);
   RSXGL_FORWARD_ERROR_END();
 
   if(count < 0) {
@@ -1461,7 +1554,9 @@ glDrawArraysInstanced (GLenum mode, GLint first, GLsizei count, GLsizei primcoun
 	instanced_draw_policy::draw(gcm_context,i);
       }
 
-      void end(gcmContextData * gcm_context,uint32_t) const {}
+      void end(gcmContextData * gcm_context,uint32_t) const {
+	instanced_draw_policy::endInstances(gcm_context);
+      }
     };
     
     if(ctx -> program_binding[RSXGL_ACTIVE_PROGRAM].instanceid_index != ~0 && primcount > 1) {
@@ -1482,7 +1577,7 @@ glDrawElementsInstanced (const GLenum mode, const GLsizei count, const GLenum ty
 
   RSXGL_FORWARD_ERROR_BEGIN();
   uint32_t rsx_primitive_type = 0, rsx_element_type = 0;
-  std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
+  std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type,primcount);
   RSXGL_FORWARD_ERROR_END();
 
   if(count < 0) {
@@ -1503,7 +1598,7 @@ glDrawElementsInstanced (const GLenum mode, const GLsizei count, const GLenum ty
       draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,const GLsizei _count,const GLvoid * _indices)
 	: element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), instanced_draw_policy(_ctx), count(_count), indices(_indices) {}
 
-      void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
+      void begin(gcmContextData * gcm_context,uint64_t timestamp) const {
 	element_draw_policy::begin(gcm_context,timestamp,&count,&indices,1,&offset);
 	element_draw_policy::emitIndexBufferCommands(gcm_context,offset);
 
@@ -1518,6 +1613,7 @@ glDrawElementsInstanced (const GLenum mode, const GLsizei count, const GLenum ty
 
       void end(gcmContextData * gcm_context,uint32_t) const {
 	element_draw_policy::end(gcm_context);
+	instanced_draw_policy::endInstances(gcm_context);
       }
     };
 
@@ -1539,7 +1635,7 @@ glDrawElementsInstancedBaseVertex (GLenum mode, GLsizei count, GLenum type, cons
 
   RSXGL_FORWARD_ERROR_BEGIN();
   uint32_t rsx_primitive_type = 0, rsx_element_type = 0;
-  std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type);
+  std::tie(rsx_primitive_type,rsx_element_type) = rsxgl_check_draw_elements(ctx,mode,type,primcount);
   RSXGL_FORWARD_ERROR_END();
 
   if(count < 0) {
@@ -1561,7 +1657,7 @@ glDrawElementsInstancedBaseVertex (GLenum mode, GLsizei count, GLenum type, cons
       draw_policy(rsxgl_context_t * _ctx,uint32_t _rsx_primitive_type,uint32_t _rsx_element_type,GLsizei _count,const GLvoid * _indices,GLint _basevertex)
 	: element_draw_policy(_ctx,_rsx_primitive_type,_rsx_element_type), instanced_draw_policy(_ctx), count(_count), indices(_indices), basevertex(_basevertex) {}
 
-      void begin(gcmContextData * gcm_context,uint32_t timestamp) const {
+      void begin(gcmContextData * gcm_context,uint64_t timestamp) const {
 	element_draw_policy::begin(gcm_context,timestamp,&count,&indices,1,&offset);
 	base_element_draw_policy::draw(gcm_context,basevertex);
 	element_draw_policy::emitIndexBufferCommands(gcm_context,offset);
@@ -1577,6 +1673,7 @@ glDrawElementsInstancedBaseVertex (GLenum mode, GLsizei count, GLenum type, cons
 
       void end(gcmContextData * gcm_context,uint32_t) const {
 	element_draw_policy::end(gcm_context);
+	instanced_draw_policy::endInstances(gcm_context);
       }
     };
 
@@ -1641,3 +1738,44 @@ glEndTransformFeedback (void)
 
   RSXGL_NOERROR_();
 }
+
+GLAPI void APIENTRY
+glGetDrawProfileui64vRSX(GLenum pname,GLuint64 * params)
+{
+#if RSXGL_CONFIG_draw_profile
+  static const uint64_t ticks_per_us = RSXGL_TIMEBASE_FREQUENCY / 1000000;
+
+  if(pname == GL_DRAW_PROFILE_ENABLED_RSX) {
+    *params = 1;
+  }
+  else if(pname == GL_DRAW_PROFILE_DRAWS_RSX) {
+    *params = rsxgl_draw_profile.draws;
+  }
+  else if(pname >= GL_DRAW_PROFILE_STORAGE_TIME_RSX && pname <= GL_DRAW_PROFILE_TOTAL_TIME_RSX) {
+    // Reported in nanoseconds:
+    *params = (rsxgl_draw_profile.ticks[pname - GL_DRAW_PROFILE_STORAGE_TIME_RSX] * 1000) / ticks_per_us;
+  }
+  else {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+#else
+  if(pname <= GL_DRAW_PROFILE_TOTAL_TIME_RSX) {
+    *params = 0;
+  }
+  else {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+#endif
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glResetDrawProfileRSX(void)
+{
+#if RSXGL_CONFIG_draw_profile
+  memset(&rsxgl_draw_profile,0,sizeof(rsxgl_draw_profile));
+#endif
+
+  RSXGL_NOERROR_();
+}
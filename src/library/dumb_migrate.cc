@@ -23,6 +23,9 @@ static void * _rsxgl_vertex_migrate_buffer = 0;
 // Tail position - nothing else:
 static uint32_t rsxgl_vertex_migrate_tail = 0;
 
+// Allocations made since the last reset, and the furthest that the tail has got:
+static uint32_t rsxgl_vertex_migrate_count = 0, rsxgl_vertex_migrate_high_water = 0;
+
 // memalign/free calls do not stack - this is here to ensure that
 #if !defined(NDEBUG)
 static uint32_t rsxgl_vertex_migrate_stack = 0;
@@ -67,6 +70,8 @@ rsxgl_dumb_migrate_memalign(gcmContextData *,const rsx_size_t align,const rsx_si
   }
   else {
     rsxgl_vertex_migrate_tail = new_tail;
+    ++rsxgl_vertex_migrate_count;
+    if(new_tail > rsxgl_vertex_migrate_high_water) rsxgl_vertex_migrate_high_water = new_tail;
     return (uint8_t *)buffer + offset;
   }
 }
@@ -86,4 +91,15 @@ void
 rsxgl_dumb_migrate_reset(gcmContextData *)
 {
   rsxgl_vertex_migrate_tail = 0;
+  rsxgl_vertex_migrate_count = 0;
+}
+
+void
+rsxgl_dumb_migrate_stats(rsxgl_memory_stats_t & stats)
+{
+  stats.size = rsxgl_vertex_migrate_size;
+  stats.allocated = rsxgl_vertex_migrate_tail;
+  stats.free = stats.largest_free = rsxgl_vertex_migrate_size - rsxgl_vertex_migrate_tail;
+  stats.count = rsxgl_vertex_migrate_count;
+  stats.high_water = rsxgl_vertex_migrate_high_water;
 }
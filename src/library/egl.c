@@ -2,6 +2,7 @@
 #include "nv40.h"
 
 #include "egl_types.h"
+#include "gl_fifo.h"
 #include "rsxgl_config.h"
 #include "rsxgl_limits.h"
 
@@ -37,6 +38,7 @@
 #include <sysutil/video.h>
 #endif
 #include <rsx/rsx.h>
+#include <ppu_intrinsics.h>
 
 #include <unistd.h>
 
@@ -133,7 +135,9 @@ struct rsxgl_init_parameters_t rsxgl_init_parameters = {
   .max_swap_wait_iterations = 100000,
   .swap_wait_interval = RSXGL_SYNC_SLEEP_INTERVAL,
   .rsx_mspace_offset = 0,
-  .rsx_mspace_size = 0
+  .rsx_mspace_size = 0,
+  .command_segment_length = RSXGL_CONFIG_default_command_segment_length,
+  .swap_queue_length = RSXGL_CONFIG_default_swap_queue_length
 };
 
 static void * rsx_shared_memory = 0;
@@ -153,11 +157,35 @@ rsxglConfigure(struct rsxgl_init_parameters_t const * parameters)
     RSXEGL_ERROR_(EGL_BAD_PARAMETER);
   }
 
+  // Command buffer segments need to be large enough to hold the largest single reservation,
+  // and small enough that the pool can grow by them. 0 selects the default length:
+  const uint32_t _rsx_command_segment_size = (parameters -> command_segment_length) * sizeof(uint32_t);
+  if(parameters -> command_segment_length != 0 &&
+     (parameters -> command_segment_length < RSXGL_MIN_COMMAND_SEGMENT_LENGTH || _rsx_command_segment_size > RSXGL_COMMAND_SEGMENT_GROWTH_SIZE)) {
+    RSXEGL_ERROR_(EGL_BAD_PARAMETER);
+  }
+
+  // Each queued frame needs a color buffer of its own, as does the one being displayed. 0 selects
+  // the default length:
+  if(parameters -> swap_queue_length >= RSXEGL_MAX_COLOR_BUFFERS) {
+    RSXEGL_ERROR_(EGL_BAD_PARAMETER);
+  }
+
   rsxgl_init_parameters = *parameters;
+
+  if(rsxgl_init_parameters.command_segment_length == 0) {
+    rsxgl_init_parameters.command_segment_length = RSXGL_CONFIG_default_command_segment_length;
+  }
+  if(rsxgl_init_parameters.swap_queue_length == 0) {
+    rsxgl_init_parameters.swap_queue_length = RSXGL_CONFIG_default_swap_queue_length;
+  }
 }
 
 gcmContextData * rsx_gcm_context = 0;
 
+// Flip mode currently set; it follows the draw surface's swap interval:
+static u32 rsxegl_flip_mode = GCM_FLIP_VSYNC;
+
 static struct pipe_screen * rsx_screen = 0;
 
 extern s32 gcmInitBodyEx(gcmContextData* ATTRIBUTE_PRXPTR *ctx,const u32 cmdSize,const u32 ioSize,const void *ioAddress);
@@ -182,7 +210,14 @@ eglInitialize(EGLDisplay dpy,EGLint * major,EGLint * minor)
     }
     rsx_gcm_context = _rsx_gcm_context;
 
+    // Carve the remainder of the shared memory into command buffer segments:
+    {
+      const uint32_t command_buffer_size = rsxgl_init_parameters.command_buffer_length * sizeof(uint32_t);
+      gcm_segments_init(rsx_gcm_context,(uint8_t *)rsx_shared_memory + command_buffer_size,rsxgl_init_parameters.gcm_buffer_size - command_buffer_size,rsxgl_init_parameters.command_segment_length);
+    }
+
     gcmSetFlipMode(GCM_FLIP_VSYNC);
+    rsxegl_flip_mode = GCM_FLIP_VSYNC;
     gcmResetFlipStatus();
 
     //
@@ -202,11 +237,16 @@ eglInitialize(EGLDisplay dpy,EGLint * major,EGLint * minor)
     RSXEGL_ERROR(EGL_NOT_INITIALIZED,(RETURN));	\
   }
 
+// gcmSetFlip & gcmSetWaitFlip check for space in the command buffer on their own, but
+// would wrap it around instead of moving on to the next segment. So make sure that they
+// have room beforehand:
+#define RSXEGL_FLIP_COMMAND_LENGTH 32
+
 void
 rsx_flush()
 {
   gcmControlRegister *control = gcmGetControlRegister();
-  __asm __volatile__("sync"); // Sync, to make sure the command was written;
+  __sync(); // Sync, to make sure the command was written;
   uint32_t offset;
   gcmAddressToOffset(rsx_gcm_context->current, &offset);
   control->put = offset;
@@ -443,6 +483,13 @@ eglGetConfigAttrib(EGLDisplay dpy,EGLConfig _config,EGLint attribute,EGLint *val
     *value = 0;
     break;
 
+  case EGL_MIN_SWAP_INTERVAL:
+    *value = RSXEGL_MIN_SWAP_INTERVAL;
+    break;
+  case EGL_MAX_SWAP_INTERVAL:
+    *value = RSXEGL_MAX_SWAP_INTERVAL;
+    break;
+
   default:
     RSXEGL_ERROR(EGL_BAD_PARAMETER,EGL_FALSE);
     break;
@@ -571,7 +618,16 @@ eglCreateWindowSurface(EGLDisplay _dpy,EGLConfig _config,EGLNativeWindowType win
   surface -> config = config;
 
   surface -> double_buffered = EGL_BACK_BUFFER;
+
+  // The last color buffer is displayed first, and the first one is drawn into:
+  surface -> swap_queue_length = rsxgl_init_parameters.swap_queue_length;
+  surface -> color_buffer_count = surface -> swap_queue_length + 1;
   surface -> buffer = 0;
+  surface -> front = surface -> color_buffer_count - 1;
+  surface -> swap_interval = 1;
+
+  surface -> frame = 0;
+  memset(surface -> frame_fences,0,sizeof(surface -> frame_fences));
 
   surface -> color_pformat = config -> color_pformat;
   surface -> depth_pformat = config -> depth_pformat;
@@ -593,58 +649,46 @@ eglCreateWindowSurface(EGLDisplay _dpy,EGLConfig _config,EGLNativeWindowType win
     color_buffer_size = util_format_get_2d_size(config -> color_pformat,surface -> color_pitch,surface -> height),
     depth_buffer_size = util_format_get_2d_size(config -> depth_pformat,surface -> depth_pitch,surface -> height);
 
-  void * buffers[] = {
-    rsxgl_rsx_memalign(64,color_buffer_size),
-    rsxgl_rsx_memalign(64,color_buffer_size),
-    rsxgl_rsx_memalign(64,depth_buffer_size)
-  };
-  
-  if(buffers[0] == 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
-  }
-  if(buffers[1] == 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
-  }
-  if(buffers[2] == 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
-  }
+  uint32_t i;
+  for(i = 0;i < surface -> color_buffer_count;++i) {
+    uint32_t offset = 0;
 
-  surface -> color_address[0] = buffers[0];
-  surface -> color_address[1] = buffers[1];
-  surface -> depth_address = buffers[2];
-  
-  uint32_t offsets[] = { 0,0,0 };
-  
-  if(gcmAddressToOffset(buffers[0],offsets + 0) != 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
-  }
-  if(gcmAddressToOffset(buffers[1],offsets + 1) != 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
-  }
-  if(gcmAddressToOffset(buffers[2],offsets + 2) != 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
-  }
-  
-  surface -> color_buffer[0].offset = offsets[0];
-  surface -> color_buffer[0].location = 0;
-  
-  surface -> color_buffer[1].offset = offsets[1];
-  surface -> color_buffer[1].location = 0;
-  
-  surface -> depth_buffer.offset = offsets[2];
-  surface -> depth_buffer.location = 0;
-  
-  if(gcmSetDisplayBuffer(0, surface -> color_buffer[0].offset, surface -> color_pitch, surface -> width, surface -> height) != 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
+    surface -> color_address[i] = rsxgl_rsx_memalign(64,color_buffer_size);
+    if(surface -> color_address[i] == 0) {
+      RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
+    }
+    if(gcmAddressToOffset(surface -> color_address[i],&offset) != 0) {
+      RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
+    }
+
+    surface -> color_buffer[i].offset = offset;
+    surface -> color_buffer[i].location = 0;
+
+    if(gcmSetDisplayBuffer(i, surface -> color_buffer[i].offset, surface -> color_pitch, surface -> width, surface -> height) != 0) {
+      RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
+    }
   }
-  if(gcmSetDisplayBuffer(1, surface -> color_buffer[1].offset, surface -> color_pitch, surface -> width, surface -> height) != 0) {
-    RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
+
+  {
+    uint32_t offset = 0;
+
+    surface -> depth_address = rsxgl_rsx_memalign(64,depth_buffer_size);
+    if(surface -> depth_address == 0) {
+      RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
+    }
+    if(gcmAddressToOffset(surface -> depth_address,&offset) != 0) {
+      RSXEGL_ERROR(EGL_BAD_ALLOC,EGL_NO_SURFACE);
+    }
+
+    surface -> depth_buffer.offset = offset;
+    surface -> depth_buffer.location = 0;
   }
   
   gcmResetFlipStatus();
   
   assert(rsx_gcm_context != 0);
-  int r = gcmSetFlip(rsx_gcm_context,1);
+  gcm_reserve(rsx_gcm_context,RSXEGL_FLIP_COMMAND_LENGTH);
+  int r = gcmSetFlip(rsx_gcm_context,surface -> front);
   assert(r == 0);
   rsx_flush(rsx_gcm_context);
   gcmSetWaitFlip(rsx_gcm_context); // Prevent the RSX from continuing until the flip has finished.
@@ -657,14 +701,51 @@ eglCreateWindowSurface(EGLDisplay _dpy,EGLConfig _config,EGLNativeWindowType win
     RSXEGL_ERROR(EGL_BAD_SURFACE,(RETURN));	\
   }
 
+static struct rsxegl_context_t * current_rsxgl_ctx = 0;
+
+// Wait for the RSX to finish everything queued for a surface, then delete its swap queue's
+// fences. This is done, while the context that drew to the surface is still current, whenever that
+// context stops drawing to it - so a surface that no context is drawing to is never still in use
+// by the RSX:
+static void
+rsxegl_surface_finish(struct rsxegl_surface_t * surface)
+{
+  glFinish();
+
+  uint32_t i;
+  for(i = 0;i < surface -> swap_queue_length;++i) {
+    if(surface -> frame_fences[i] != 0) {
+      glDeleteSync(surface -> frame_fences[i]);
+      surface -> frame_fences[i] = 0;
+    }
+  }
+}
+
 EGLAPI EGLBoolean EGLAPIENTRY
-eglDestroySurface(EGLDisplay dpy,EGLSurface surface)
+eglDestroySurface(EGLDisplay dpy,EGLSurface _surface)
 {
   RSXEGL_CHECK_DISPLAY(dpy,EGL_FALSE);
   RSXEGL_CHECK_INITIALIZED(EGL_FALSE);
 
-  if(surface != 0) {
-    // TODO - delete the buffers:
+  if(_surface != 0) {
+    struct rsxegl_surface_t * surface = (struct rsxegl_surface_t *)_surface;
+
+    // The RSX may still be drawing into, or flipping to, any of the queued frames' buffers:
+    if(current_rsxgl_ctx != 0) {
+      rsxegl_surface_finish(surface);
+
+      if(current_rsxgl_ctx -> draw == surface) current_rsxgl_ctx -> draw = 0;
+      if(current_rsxgl_ctx -> read == surface) current_rsxgl_ctx -> read = 0;
+    }
+
+    uint32_t i;
+    for(i = 0;i < surface -> color_buffer_count;++i) {
+      rsxgl_rsx_free(surface -> color_address[i]);
+    }
+    rsxgl_rsx_free(surface -> depth_address);
+
+    free(surface);
+
     RSXEGL_NOERROR(EGL_TRUE);
   }
   else {
@@ -745,8 +826,6 @@ struct rsxgl_object_context_t;
 extern struct rsxegl_context_t * rsxgl_context_create(const struct rsxegl_config_t *,gcmContextData *,struct pipe_screen *,struct rsxgl_object_context_t *);
 extern struct rsxgl_object_context_t * rsxgl_object_context_create();
 
-static struct rsxegl_context_t * current_rsxgl_ctx = 0;
-
 EGLAPI EGLContext EGLAPIENTRY
 eglCreateContext(EGLDisplay dpy,EGLConfig config,EGLContext share_context,const EGLint * attrib_list)
 {
@@ -778,6 +857,17 @@ eglDestroyContext(EGLDisplay dpy,EGLContext _ctx)
       RSXEGL_ERROR(EGL_BAD_CONTEXT,EGL_FALSE);
     }
     else {
+      if(ctx == current_rsxgl_ctx) {
+	if(ctx -> draw != 0) {
+	  rsxegl_surface_finish((struct rsxegl_surface_t *)ctx -> draw);
+	}
+
+	ctx -> draw = 0;
+	ctx -> read = 0;
+
+	current_rsxgl_ctx = 0;
+      }
+
       (*ctx -> callback)(ctx,RSXEGL_DESTROY_CONTEXT);
     }
 
@@ -796,6 +886,11 @@ eglMakeCurrent(EGLDisplay dpy,EGLSurface draw,EGLSurface read,EGLContext _ctx)
 
   if(rsxegl_api == EGL_OPENGL_API) {
     if(current_rsxgl_ctx != 0) {
+      // Making the same context current with the same surface again keeps the swap queue going:
+      if(current_rsxgl_ctx -> draw != 0 && (current_rsxgl_ctx != (struct rsxegl_context_t *)_ctx || current_rsxgl_ctx -> draw != draw)) {
+	rsxegl_surface_finish((struct rsxegl_surface_t *)current_rsxgl_ctx -> draw);
+      }
+
       current_rsxgl_ctx -> draw = 0;
       current_rsxgl_ctx -> read = 0;
 
@@ -950,7 +1045,38 @@ eglWaitNative(EGLint engine)
   }
 }
 
-extern int usleep(unsigned long microseconds);
+EGLAPI EGLBoolean EGLAPIENTRY
+eglSwapInterval(EGLDisplay dpy,EGLint interval)
+{
+  RSXEGL_CHECK_DISPLAY(dpy,EGL_FALSE);
+  RSXEGL_CHECK_INITIALIZED(EGL_FALSE);
+
+  if(current_rsxgl_ctx == 0) {
+    RSXEGL_ERROR(EGL_BAD_CONTEXT,EGL_FALSE);
+  }
+
+  struct rsxegl_surface_t * surface = (struct rsxegl_surface_t *)current_rsxgl_ctx -> draw;
+
+  RSXEGL_CHECK_SURFACE(surface,EGL_FALSE);
+
+  // Silently clamped, as EGL requires:
+  surface -> swap_interval = (interval < RSXEGL_MIN_SWAP_INTERVAL) ? RSXEGL_MIN_SWAP_INTERVAL : (interval > RSXEGL_MAX_SWAP_INTERVAL) ? RSXEGL_MAX_SWAP_INTERVAL : interval;
+
+  RSXEGL_NOERROR(EGL_TRUE);
+}
+
+// How long eglSwapBuffers waits for the oldest queued frame, in nanoseconds:
+static inline GLuint64
+rsxegl_swap_timeout()
+{
+  if(rsxgl_init_parameters.max_swap_wait_iterations == 0) {
+    return GL_TIMEOUT_IGNORED;
+  }
+  else {
+    return (GLuint64)rsxgl_init_parameters.max_swap_wait_iterations * (GLuint64)rsxgl_init_parameters.swap_wait_interval * 1000;
+  }
+}
+
 EGLAPI EGLBoolean eglSwapBuffers(EGLDisplay dpy,EGLSurface _surface)
 {
   RSXEGL_CHECK_DISPLAY(dpy,EGL_FALSE);
@@ -962,25 +1088,50 @@ EGLAPI EGLBoolean eglSwapBuffers(EGLDisplay dpy,EGLSurface _surface)
 
   if(surface -> double_buffered == EGL_BACK_BUFFER) {
     assert(rsx_gcm_context != 0);
+
+    const u32 flip_mode = (surface -> swap_interval == 0) ? GCM_FLIP_HSYNC : GCM_FLIP_VSYNC;
+    if(flip_mode != rsxegl_flip_mode) {
+      gcmSetFlipMode(flip_mode);
+      rsxegl_flip_mode = flip_mode;
+    }
+
+    // Before the RSX draws the next frame, the buffer it draws into must no longer be displayed.
+    // With two buffers, that's the one that's displayed until this flip happens. With more, it
+    // was displayed before the previous flip, so the RSX only needs to wait for that one before
+    // queuing this one:
+    gcm_reserve(rsx_gcm_context,RSXEGL_FLIP_COMMAND_LENGTH);
+    if(surface -> color_buffer_count > 2) {
+      gcmSetWaitFlip(rsx_gcm_context);
+    }
     int r = gcmSetFlip(rsx_gcm_context, surface -> buffer);
     assert(r == 0);
+    if(surface -> color_buffer_count == 2) {
+      gcmSetWaitFlip(rsx_gcm_context);
+    }
 
-    // flush the command buffer:
-    rsx_flush(rsx_gcm_context);
-    gcmSetWaitFlip(rsx_gcm_context); // Prevent the RSX from continuing until the flip has finished.
-    surface -> buffer = !surface -> buffer;
+    surface -> front = surface -> buffer;
+    surface -> buffer = (surface -> buffer + 1) % surface -> color_buffer_count;
     (*current_rsxgl_ctx -> callback)(current_rsxgl_ctx,RSXEGL_POST_CPU_SWAP);
 
-    // wait for the GPU to finish:
-    uint32_t iter = 0;
-    while(((rsxgl_init_parameters.max_swap_wait_iterations == 0) || (iter < rsxgl_init_parameters.max_swap_wait_iterations)) &&
-	  gcmGetFlipStatus()) {
-      usleep(rsxgl_init_parameters.swap_wait_interval);
-      ++iter;
+    // Let the CPU get up to swap_queue_length frames ahead of the RSX. The fence for the frame
+    // that was queued that many frames ago shares a slot with this frame's:
+    EGLBoolean result = EGL_TRUE;
+    GLsync * fence = (GLsync *)surface -> frame_fences + (surface -> frame % surface -> swap_queue_length);
+
+    if(*fence != 0) {
+      if(glClientWaitSync(*fence,GL_SYNC_FLUSH_COMMANDS_BIT,rsxegl_swap_timeout()) == GL_TIMEOUT_EXPIRED) {
+	result = EGL_FALSE;
+      }
+      glDeleteSync(*fence);
     }
+
+    *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+    glFlush();
+
+    ++surface -> frame;
     (*current_rsxgl_ctx -> callback)(current_rsxgl_ctx,RSXEGL_POST_GPU_SWAP);
 
-    RSXEGL_NOERROR(((rsxgl_init_parameters.max_swap_wait_iterations == 0) || (iter < rsxgl_init_parameters.max_swap_wait_iterations)) ? EGL_TRUE : EGL_FALSE);
+    RSXEGL_NOERROR(result);
   }
   else {
     RSXEGL_NOERROR(EGL_FALSE);
@@ -1242,6 +1393,16 @@ static const egl_function egl_function_map[] = {
   PROC(glUseMemoryArenaRSX),
   PROC(glGetMemoryArenaParameterivRSX),
   PROC(glGetMemoryArenaPointervRSX),
+  PROC(glGenCommandListsRSX),
+  PROC(glDeleteCommandListsRSX),
+  PROC(glIsCommandListRSX),
+  PROC(glBeginCommandListRSX),
+  PROC(glEndCommandListRSX),
+  PROC(glCallCommandListRSX),
+  PROC(glGetDrawProfileui64vRSX),
+  PROC(glResetDrawProfileRSX),
+  PROC(glGetStallStatsui64vRSX),
+  PROC(glResetStallStatsRSX),
   PROC(glUniform1f),
   PROC(glUniform1fv),
   PROC(glUniform1i),
@@ -1331,7 +1492,8 @@ static const egl_function egl_function_map[] = {
   PROC(eglGetCurrentDisplay),
   PROC(eglQueryContext),
   PROC(eglWaitClient),
-  PROC(eglWaitNative)
+  PROC(eglWaitNative),
+  PROC(eglSwapInterval)
 };
 #define NUM_PROCS (sizeof(egl_function_map) / sizeof(egl_function_map[0]))
 
@@ -13,6 +13,14 @@ extern "C" {
 #endif
 
   typedef struct _gcmCtxData gcmContextData;
+  struct __GLsync;
+
+// The RSX can be told about this many display buffers:
+#define RSXEGL_MAX_COLOR_BUFFERS 8
+
+// Flips happen immediately (0) or at the next vertical sync (1):
+#define RSXEGL_MIN_SWAP_INTERVAL 0
+#define RSXEGL_MAX_SWAP_INTERVAL 1
 
 struct rsxegl_memory_t {
   uint32_t location:1, offset:30, owner:1;
@@ -40,8 +48,17 @@ struct rsxegl_surface_t {
   // Is it double-buffered or not?
   EGLenum double_buffered;
 
-  // Which buffer is current?
-  uint32_t buffer;
+  // Which buffer is current (being drawn into), and which one was flipped to most recently?
+  // Buffers are flipped to in order:
+  uint32_t buffer, front, color_buffer_count;
+
+  // Most frames that the CPU can queue up before it waits for the RSX to finish one:
+  uint32_t swap_queue_length;
+  EGLint swap_interval;
+
+  // Fences marking the end of the last swap_queue_length frames, indexed by frame % swap_queue_length:
+  uint32_t frame;
+  struct __GLsync * frame_fences[RSXEGL_MAX_COLOR_BUFFERS];
 
   //
   enum pipe_format color_pformat, depth_pformat;
@@ -50,8 +67,8 @@ struct rsxegl_surface_t {
   uint32_t color_pixel_size, depth_pixel_size;
 
   // Address in RSX memory of the color and depth buffers:
-  void * color_address[2], * depth_address;
-  struct rsxegl_memory_t color_buffer[2], depth_buffer;
+  void * color_address[RSXEGL_MAX_COLOR_BUFFERS], * depth_address;
+  struct rsxegl_memory_t color_buffer[RSXEGL_MAX_COLOR_BUFFERS], depth_buffer;
 };
 
 enum rsxegl_context_callbacks {
@@ -74,7 +91,6 @@ struct rsxegl_context_t {
   void (*callback)(struct rsxegl_context_t *,const uint8_t);
 
   struct pipe_screen * screen;
-  uint32_t sync_sleep_interval;
 };
 
 #ifdef __cplusplus
@@ -96,7 +96,7 @@ glDeleteRenderbuffers (GLsizei count, const GLuint *renderbuffers)
       // TODO - orphan it, instead of doing this:
       renderbuffer_t & renderbuffer = renderbuffer_t::storage().at(renderbuffer_name);
       if(renderbuffer.timestamp > 0) {
-	rsxgl_timestamp_wait(ctx,renderbuffer.timestamp);
+	rsxgl_timestamp_wait(ctx,renderbuffer.timestamp,RSXGL_STALL_RENDERBUFFER_DELETE);
 	renderbuffer.timestamp = 0;
       }
 
@@ -171,7 +171,7 @@ rsxgl_renderbuffer_storage(rsxgl_context_t * ctx,const renderbuffer_t::name_type
 
   // TODO - orphan instead of delete:
   if(renderbuffer.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,renderbuffer.timestamp);
+    rsxgl_timestamp_wait(ctx,renderbuffer.timestamp,RSXGL_STALL_RENDERBUFFER_STORAGE);
     renderbuffer.timestamp = 0;
   }
 
@@ -191,6 +191,7 @@ rsxgl_renderbuffer_storage(rsxgl_context_t * ctx,const renderbuffer_t::name_type
     RSXGL_ERROR_(GL_OUT_OF_MEMORY);
   }
 
+  renderbuffer.arena = arena;
   renderbuffer.glformat = glinternalformat;
   renderbuffer.pformat = pformat;
   renderbuffer.size[0] = width;
@@ -1043,20 +1044,15 @@ rsxgl_emit_surface(gcmContextData * context,const uint8_t which,surface_t const
 
   uint32_t * buffer = gcm_reserve(context,6);
 
-  gcm_emit_method_at(buffer,0,rsxgl_dma_methods[which],1);
-  gcm_emit_at(buffer,1,(surface.memory.location == RSXGL_MEMORY_LOCATION_LOCAL) ? RSXGL_DMA_MEMORY_FRAME_BUFFER : RSXGL_DMA_MEMORY_HOST_BUFFER);
+  gcm_emit_shadowed1(&buffer,rsxgl_dma_methods[which],(surface.memory.location == RSXGL_MEMORY_LOCATION_LOCAL) ? RSXGL_DMA_MEMORY_FRAME_BUFFER : RSXGL_DMA_MEMORY_HOST_BUFFER);
+  gcm_emit_shadowed1(&buffer,rsxgl_offset_methods[which],surface.memory.offset);
+  gcm_emit_shadowed1(&buffer,rsxgl_pitch_methods[which],surface.pitch);
   
-  gcm_emit_method_at(buffer,2,rsxgl_offset_methods[which],1);
-  gcm_emit_at(buffer,3,surface.memory.offset);
-  
-  gcm_emit_method_at(buffer,4,rsxgl_pitch_methods[which],1);
-  gcm_emit_at(buffer,5,surface.pitch);
-  
-  gcm_finish_n_commands(context,6);
+  gcm_finish_commands(context,&buffer);
 }
 
 void
-rsxgl_renderbuffer_validate(rsxgl_context_t * ctx,renderbuffer_t & renderbuffer,uint32_t timestamp)
+rsxgl_renderbuffer_validate(rsxgl_context_t * ctx,renderbuffer_t & renderbuffer,uint64_t timestamp)
 {
 }
 
@@ -1327,19 +1323,78 @@ glReadPixels (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GL
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
+  width = std::min(width,(GLsizei)framebuffer.size[0] - x);
+  height = std::min(height,(GLsizei)framebuffer.size[1] - y);
+
   if(ctx -> buffer_binding.is_anything_bound(RSXGL_PIXEL_PACK_BUFFER)) {
     buffer_t & buffer = ctx -> buffer_binding[RSXGL_PIXEL_PACK_BUFFER];
 
-    if(buffer.mapped) {
+    if(rsxgl_buffer_mapped_exclusive(buffer)) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    const uint32_t offset = rsxgl_pointer_to_offset(pixels);
+    const uint32_t linelength = util_format_get_stride(pdstformat,width);
+    const uint32_t pitch = rsxgl_pixel_store_aligned(ctx -> state.pixelstore_pack,linelength);
+    const uint32_t nbytes = (height > 0) ? (pitch * (height - 1) + linelength) : 0;
+
+    if((offset + nbytes) > buffer.size) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    if(nbytes == 0) {
+      RSXGL_NOERROR_();
+    }
+
+    // The RSX copies the pixels into the buffer, behind the rendering that produced them, so
+    // nothing waits here; glReadbackBufferRangeRSX and a fence let the application collect them
+    // later on. Only color pixels whose format matches the read buffer's can be copied this way,
+    // and there's no other way to fill a pack buffer:
+    rsxgl_framebuffer_validate_complete(ctx,framebuffer);
+
+    if(format == GL_STENCIL_INDEX || format == GL_DEPTH_COMPONENT || format == GL_DEPTH_STENCIL ||
+       framebuffer.color_pformat == PIPE_FORMAT_NONE ||
+       !util_is_format_compatible(util_format_description(framebuffer.color_pformat),util_format_description(pdstformat))) {
+      RSXGL_ERROR_(GL_INVALID_OPERATION);
+    }
+
+    const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+    rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
+
+    if(!framebuffer.read_surface.memory) {
       RSXGL_ERROR_(GL_INVALID_OPERATION);
     }
+
+    const uint32_t blocksize = util_format_get_blocksize(pdstformat);
+    memory_t dst = buffer.memory + offset, src = framebuffer.read_surface.memory + (x * blocksize + y * framebuffer.read_surface.pitch);
+
+    // The number of lines in one transfer is limited:
+    for(uint32_t i = 0;i < (uint32_t)height;) {
+      const uint32_t lines = std::min((uint32_t)height - i,(uint32_t)RSXGL_MEMORY_COPY_MAX_LINES);
+
+      rsxgl_memory_transfer(ctx -> gcm_context(),
+			    dst,pitch,1,
+			    src,framebuffer.read_surface.pitch,1,
+			    linelength,lines);
+
+      dst += lines * pitch;
+      src += lines * framebuffer.read_surface.pitch;
+      i += lines;
+    }
+
+    rsxgl_buffer_validate(ctx,buffer,offset,nbytes,timestamp);
+    rsxgl_buffer_invalidate_readback(buffer);
+
+    rsxgl_timestamp_batch_post(ctx,1);
   }
   else {
   }
+
+  RSXGL_NOERROR_();
 }
 
 void
-rsxgl_framebuffer_validate(rsxgl_context_t * ctx,framebuffer_t & framebuffer,uint32_t timestamp)
+rsxgl_framebuffer_validate(rsxgl_context_t * ctx,framebuffer_t & framebuffer,uint64_t timestamp)
 {
   if(!framebuffer.is_default) {
     for(framebuffer_t::attachment_types_t::const_iterator it = framebuffer.attachment_types.begin();!it.done();it.next(framebuffer.attachment_types)) {
@@ -1367,7 +1422,7 @@ rsxgl_framebuffer_validate(rsxgl_context_t * ctx,framebuffer_t & framebuffer,uin
 	const write_mask_t mask = framebuffer.write_masks[0];
 
 	if(framebuffer.attachment_types.get(0) != RSXGL_ATTACHMENT_TYPE_NONE && framebuffer.draw_buffer_mapping.get(0) < RSXGL_MAX_COLOR_ATTACHMENTS) {
-	  const uint32_t buffer = (framebuffer.draw_buffer_mapping.get(0) == 0) ? ctx -> base.draw -> buffer : !ctx -> base.draw -> buffer;
+	  const uint32_t buffer = (framebuffer.draw_buffer_mapping.get(0) == 0) ? ctx -> base.draw -> buffer : ctx -> base.draw -> front;
 	  draw_surfaces[RSXGL_FRAMEBUFFER_SURFACE_COLOR0].pitch = ctx -> base.draw -> color_pitch;
 	  draw_surfaces[RSXGL_FRAMEBUFFER_SURFACE_COLOR0].memory.location = ctx -> base.draw -> color_buffer[buffer].location;
 	  draw_surfaces[RSXGL_FRAMEBUFFER_SURFACE_COLOR0].memory.offset = ctx -> base.draw -> color_buffer[buffer].offset;
@@ -1395,7 +1450,7 @@ rsxgl_framebuffer_validate(rsxgl_context_t * ctx,framebuffer_t & framebuffer,uin
 	}
 
 	if(framebuffer.read_buffer_mapping != RSXGL_MAX_COLOR_ATTACHMENTS) {
-	  const uint32_t buffer = (framebuffer.read_buffer_mapping == 0) ? ctx -> base.read -> buffer : !ctx -> base.read -> buffer;
+	  const uint32_t buffer = (framebuffer.read_buffer_mapping == 0) ? ctx -> base.read -> buffer : ctx -> base.read -> front;
 	  read_surface.pitch = ctx -> base.read -> color_pitch;
 	  read_surface.memory.location = ctx -> base.read -> color_buffer[buffer].location;
 	  read_surface.memory.offset = ctx -> base.read -> color_buffer[buffer].offset;
@@ -1514,7 +1569,7 @@ rsxgl_framebuffer_validate(rsxgl_context_t * ctx,framebuffer_t & framebuffer,uin
 }
 
 void
-rsxgl_draw_framebuffer_validate(rsxgl_context_t * ctx,uint32_t timestamp)
+rsxgl_draw_framebuffer_validate(rsxgl_context_t * ctx,uint64_t timestamp)
 {
   framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_DRAW_FRAMEBUFFER];
 
@@ -1544,37 +1599,22 @@ rsxgl_draw_framebuffer_validate(rsxgl_context_t * ctx,uint32_t timestamp)
 	
 	uint32_t * buffer = gcm_reserve(context,15);
 	
-	gcm_emit_method_at(buffer,0,NV30_3D_RT_FORMAT,1);
-	gcm_emit_at(buffer,1,format | ((31 - __builtin_clz(w)) << NV30_3D_RT_FORMAT_LOG2_WIDTH__SHIFT) | ((31 - __builtin_clz(h)) << NV30_3D_RT_FORMAT_LOG2_HEIGHT__SHIFT));
-	
-	gcm_emit_method_at(buffer,2,NV30_3D_RT_HORIZ,2);
-	gcm_emit_at(buffer,3,w << 16);
-	gcm_emit_at(buffer,4,h << 16);
+	gcm_emit_shadowed1(&buffer,NV30_3D_RT_FORMAT,format | ((31 - __builtin_clz(w)) << NV30_3D_RT_FORMAT_LOG2_WIDTH__SHIFT) | ((31 - __builtin_clz(h)) << NV30_3D_RT_FORMAT_LOG2_HEIGHT__SHIFT));
+	gcm_emit_shadowed2(&buffer,NV30_3D_RT_HORIZ,w << 16,h << 16);
+	gcm_emit_shadowed1(&buffer,NV30_3D_COORD_CONVENTIONS,h | NV30_3D_COORD_CONVENTIONS_ORIGIN_NORMAL);
+	gcm_emit_shadowed1(&buffer,NV30_3D_RT_ENABLE,color_targets);
+	gcm_emit_shadowed1(&buffer,NV30_3D_COLOR_MASK,color_mask);
+	gcm_emit_shadowed1(&buffer,NV40_3D_MRT_COLOR_MASK,color_mask_mrt);
+	gcm_emit_shadowed1(&buffer,NV30_3D_DEPTH_WRITE_ENABLE,depth_mask);
 	
-	gcm_emit_method_at(buffer,5,NV30_3D_COORD_CONVENTIONS,1);
-	gcm_emit_at(buffer,6,h | NV30_3D_COORD_CONVENTIONS_ORIGIN_NORMAL);
-	
-	gcm_emit_method_at(buffer,7,NV30_3D_RT_ENABLE,1);
-	gcm_emit_at(buffer,8,color_targets);
-
-	gcm_emit_method_at(buffer,9,NV30_3D_COLOR_MASK,1);
-	gcm_emit_at(buffer,10,color_mask);
-
-	gcm_emit_method_at(buffer,11,NV40_3D_MRT_COLOR_MASK,1);
-	gcm_emit_at(buffer,12,color_mask_mrt);
-
-	gcm_emit_method_at(buffer,13,NV30_3D_DEPTH_WRITE_ENABLE,1);
-	gcm_emit_at(buffer,14,depth_mask);
-	
-	gcm_finish_n_commands(context,15);
+	gcm_finish_commands(context,&buffer);
       }
       else {
 	uint32_t * buffer = gcm_reserve(context,2);
 	
-	gcm_emit_method_at(buffer,0,NV30_3D_RT_ENABLE,1);
-	gcm_emit_at(buffer,1,0);
+	gcm_emit_shadowed1(&buffer,NV30_3D_RT_ENABLE,0);
 	
-	gcm_finish_n_commands(context,2);
+	gcm_finish_commands(context,&buffer);
       }
 
       ctx -> invalid.parts.draw_framebuffer = 0;
@@ -1604,7 +1644,7 @@ rsxgl_feedback_framebuffer_check(rsxgl_context_t * ctx,uint32_t offset,uint32_t
 }
 
 void
-rsxgl_feedback_framebuffer_validate(rsxgl_context_t * ctx,uint32_t offset,uint32_t count,uint32_t timestamp)
+rsxgl_feedback_framebuffer_validate(rsxgl_context_t * ctx,uint32_t offset,uint32_t count,uint64_t timestamp)
 {
   gcmContextData * context = ctx -> gcm_context();
 
@@ -1658,27 +1698,13 @@ rsxgl_feedback_framebuffer_validate(rsxgl_context_t * ctx,uint32_t offset,uint32
 
   uint32_t * buffer = gcm_reserve(context,15);
   
-  gcm_emit_method_at(buffer,0,NV30_3D_RT_FORMAT,1);
-  gcm_emit_at(buffer,1,format | ((31 - __builtin_clz(w)) << NV30_3D_RT_FORMAT_LOG2_WIDTH__SHIFT) | ((31 - __builtin_clz(h)) << NV30_3D_RT_FORMAT_LOG2_HEIGHT__SHIFT));
-  
-  gcm_emit_method_at(buffer,2,NV30_3D_RT_HORIZ,2);
-  gcm_emit_at(buffer,3,w << 16);
-  gcm_emit_at(buffer,4,h << 16);
-  
-  gcm_emit_method_at(buffer,5,NV30_3D_COORD_CONVENTIONS,1);
-  gcm_emit_at(buffer,6,h | NV30_3D_COORD_CONVENTIONS_ORIGIN_NORMAL | NV30_3D_COORD_CONVENTIONS_CENTER_INTEGER);
-  
-  gcm_emit_method_at(buffer,7,NV30_3D_RT_ENABLE,1);
-  gcm_emit_at(buffer,8,color_targets);
-  
-  gcm_emit_method_at(buffer,9,NV30_3D_COLOR_MASK,1);
-  gcm_emit_at(buffer,10,color_mask);
-  
-  gcm_emit_method_at(buffer,11,NV40_3D_MRT_COLOR_MASK,1);
-  gcm_emit_at(buffer,12,color_mask_mrt);
-  
-  gcm_emit_method_at(buffer,13,NV30_3D_DEPTH_WRITE_ENABLE,1);
-  gcm_emit_at(buffer,14,depth_mask);
+  gcm_emit_shadowed1(&buffer,NV30_3D_RT_FORMAT,format | ((31 - __builtin_clz(w)) << NV30_3D_RT_FORMAT_LOG2_WIDTH__SHIFT) | ((31 - __builtin_clz(h)) << NV30_3D_RT_FORMAT_LOG2_HEIGHT__SHIFT));
+  gcm_emit_shadowed2(&buffer,NV30_3D_RT_HORIZ,w << 16,h << 16);
+  gcm_emit_shadowed1(&buffer,NV30_3D_COORD_CONVENTIONS,h | NV30_3D_COORD_CONVENTIONS_ORIGIN_NORMAL | NV30_3D_COORD_CONVENTIONS_CENTER_INTEGER);
+  gcm_emit_shadowed1(&buffer,NV30_3D_RT_ENABLE,color_targets);
+  gcm_emit_shadowed1(&buffer,NV30_3D_COLOR_MASK,color_mask);
+  gcm_emit_shadowed1(&buffer,NV40_3D_MRT_COLOR_MASK,color_mask_mrt);
+  gcm_emit_shadowed1(&buffer,NV30_3D_DEPTH_WRITE_ENABLE,depth_mask);
   
-  gcm_finish_n_commands(context,15);
+  gcm_finish_commands(context,&buffer);
 }
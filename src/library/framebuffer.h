@@ -61,7 +61,8 @@ struct renderbuffer_t {
 
   binding_bitfield_type binding_bitfield;
 
-  uint32_t deleted:1, timestamp:31;
+  uint32_t deleted:1;
+  uint64_t timestamp;
   uint32_t ref_count;
 
   uint32_t glformat;
@@ -149,10 +150,10 @@ struct framebuffer_t {
 
 struct rsxgl_context_t;
 
-void rsxgl_renderbuffer_validate(rsxgl_context_t *,renderbuffer_t &,uint32_t);
-void rsxgl_framebuffer_validate(rsxgl_context_t *,framebuffer_t &,uint32_t);
-void rsxgl_draw_framebuffer_validate(rsxgl_context_t *,uint32_t);
+void rsxgl_renderbuffer_validate(rsxgl_context_t *,renderbuffer_t &,uint64_t);
+void rsxgl_framebuffer_validate(rsxgl_context_t *,framebuffer_t &,uint64_t);
+void rsxgl_draw_framebuffer_validate(rsxgl_context_t *,uint64_t);
 bool rsxgl_feedback_framebuffer_check(rsxgl_context_t *,uint32_t,uint32_t);
-void rsxgl_feedback_framebuffer_validate(rsxgl_context_t *,uint32_t,uint32_t,uint32_t);
+void rsxgl_feedback_framebuffer_validate(rsxgl_context_t *,uint32_t,uint32_t,uint64_t);
 
 #endif
@@ -1,8 +1,63 @@
 #include "gl_fifo.h"
 
+#include <ppu_intrinsics.h>
+#include <string.h>
+
+#if RSXGL_CONFIG_fifo_capture
+#include <stdio.h>
+#endif
+
+struct gcm_autoflush_t gcm_autoflush = { 0, 0, RSXGL_AUTO_FLUSH_WORDS, 0, 0, 0 };
+
+struct gcm_record_t gcm_record = { 0, 0, 0, 0, 0 };
+
+struct gcm_shadow_t gcm_shadow;
+
+void
+gcm_shadow_invalidate()
+{
+  memset(gcm_shadow.valid,0,sizeof(gcm_shadow.valid));
+}
+
+#if !defined(NDEBUG)
+uint32_t * gcm_unchecked_end = 0;
+#endif
+
+#if RSXGL_CONFIG_fifo_capture
+static FILE * gcm_capture_file = 0;
+static const uint32_t * gcm_capture_from = 0;
+static int gcm_capture_failed = 0;
+
+void
+gcm_capture(const uint32_t * to)
+{
+  if(gcm_capture_file == 0 && !gcm_capture_failed) {
+    gcm_capture_file = fopen(RSXGL_CONFIG_fifo_capture_path,"wb");
+    gcm_capture_failed = (gcm_capture_file == 0);
+  }
+
+  if(gcm_capture_file != 0 && gcm_capture_from != 0 && to > gcm_capture_from) {
+    fwrite(gcm_capture_from,sizeof(uint32_t),to - gcm_capture_from,gcm_capture_file);
+    fflush(gcm_capture_file);
+  }
+
+  gcm_capture_from = to;
+}
+
+void
+gcm_capture_restart(const uint32_t * from)
+{
+  gcm_capture_from = from;
+}
+#endif
+
 int32_t __attribute__((noinline))
 gcm_reserve_callback(gcmContextData *context,uint32_t count)
 {
+#if defined(RSXGL_HOSTGCM)
+  // The host stand-in's callback is an ordinary function:
+  return (*context -> callback)(context,count);
+#else
   register int32_t result asm("r3");
   __asm__ __volatile__ (
 		"stdu	1,-128(1)\n"
@@ -18,4 +73,92 @@ gcm_reserve_callback(gcmContextData *context,uint32_t count)
 		: "r30", "r0", "lr"
 		);
   return result;
+#endif
+}
+
+static inline void
+gcm_autoflush_update_limit(gcmContextData * context)
+{
+  uint32_t * limit = gcm_autoflush.put + gcm_autoflush.words;
+  gcm_autoflush.limit = (gcm_autoflush.suspended || limit > context -> end) ? context -> end : limit;
+}
+
+void
+gcm_autoflush_reset(gcmContextData * context)
+{
+  gcm_autoflush.put = gcm_live_current(context);
+  gcm_autoflush.draws = 0;
+  gcm_autoflush.time = __mftb();
+  gcm_autoflush_update_limit(context);
+}
+
+static void
+gcm_autoflush_flush(gcmContextData * context)
+{
+  gcmControlRegister volatile *control = gcmGetControlRegister();
+
+  // If the RSX already consumed everything from the last flush then it has been sitting
+  // idle, so flush sooner next time. Otherwise it's keeping busy, and fewer put updates
+  // are needed:
+  uint32_t last_offset = 0;
+  gcmAddressToOffset(gcm_autoflush.put,&last_offset);
+
+  if(control -> get == last_offset) {
+    gcm_autoflush.words = (gcm_autoflush.words >> 1) < RSXGL_AUTO_FLUSH_MIN_WORDS ? RSXGL_AUTO_FLUSH_MIN_WORDS : (gcm_autoflush.words >> 1);
+  }
+  else {
+    gcm_autoflush.words = (gcm_autoflush.words << 1) > RSXGL_AUTO_FLUSH_MAX_WORDS ? RSXGL_AUTO_FLUSH_MAX_WORDS : (gcm_autoflush.words << 1);
+  }
+
+#if RSXGL_CONFIG_fifo_capture
+  gcm_capture(context -> current);
+#endif
+
+  uint32_t offset = 0;
+  __sync();
+  gcmAddressToOffset(context -> current,&offset);
+  control -> put = offset;
+
+  gcm_autoflush_reset(context);
+}
+
+void __attribute__((noinline))
+gcm_reserve_slow(gcmContextData * context,uint32_t length)
+{
+  // A command list being recorded has run out of room - chain another chunk onto it:
+  if(gcm_record.active) {
+    if((context -> current + length) > context -> end) {
+      gcm_record_next(context,length);
+    }
+    gcm_autoflush.limit = context -> end;
+  }
+  // Out of room - jump to the next segment, or, if there aren't any, let the callback
+  // wrap the command buffer (flushing in the process):
+  else if((context -> current + length) > context -> end) {
+    if(gcm_segments_initialized()) {
+      gcm_segments_next(context,length);
+    }
+    else {
+#if RSXGL_CONFIG_fifo_capture
+      gcm_capture(context -> current);
+#endif
+      int32_t r = gcm_reserve_callback(context,length);
+      rsxgl_assert(r == 0);
+#if RSXGL_CONFIG_fifo_capture
+      gcm_capture_restart(context -> current);
+#endif
+    }
+    gcm_autoflush_reset(context);
+  }
+  // A command list is being built; hold off until it's finished:
+  else if(gcm_autoflush.suspended) {
+    gcm_autoflush.limit = context -> end;
+  }
+  // Enough has been emitted since the last flush:
+  else if(gcm_autoflush.put == 0 || (context -> current + length) > (gcm_autoflush.put + gcm_autoflush.words)) {
+    gcm_autoflush_flush(context);
+  }
+  else {
+    gcm_autoflush_update_limit(context);
+  }
 }
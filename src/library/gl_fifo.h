@@ -5,6 +5,8 @@
 
 #include "debug.h"
 #include "rsxgl_assert.h"
+#include "rsxgl_limits.h"
+#include "rsxgl_config.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,19 +14,173 @@ extern "C" {
 
 int32_t __attribute__((noinline)) gcm_reserve_callback(gcmContextData *,uint32_t);
 
-// TODO - Compile-time option to make the command buffer length checking in gcm_reserve
-// a no-op. The application would need to make sure that it creates an adequately-sized
-// command buffer that is flushed regularly.
+// Automatic flushing. The library updates the put register on its own once enough
+// words have been emitted since the last update, so that the RSX can start consuming
+// work while the PPU is still building the rest of the frame. The word threshold is
+// folded into limit, which gcm_reserve compares against instead of context -> end, so
+// the common case still costs a single comparison. Draw count and elapsed time are
+// checked by rsxgl_gcm_autoflush_draw() after each draw call.
+struct gcm_autoflush_t {
+  // gcm_reserve takes the slow path once the current position would pass this:
+  uint32_t * limit;
+
+  // Position written to the put register by the last flush:
+  uint32_t * put;
+
+  // Number of words to emit before flushing. Adapts between RSXGL_AUTO_FLUSH_MIN_WORDS
+  // and RSXGL_AUTO_FLUSH_MAX_WORDS depending upon whether the RSX was found idle:
+  uint32_t words;
+
+  // Draw calls since the last flush, and the timebase value at the last flush:
+  uint32_t draws;
+  uint64_t time;
+
+  // Non-zero while a command list is being built; the RSX mustn't be allowed to run
+  // into it until its leading jump has been written:
+  uint32_t suspended;
+};
+
+extern struct gcm_autoflush_t gcm_autoflush;
+
+void __attribute__((noinline)) gcm_reserve_slow(gcmContextData *,uint32_t);
+
+// Segmented command buffer (see gl_fifo_segments.cc). gcm_segments_init hands the pool
+// the command buffer that context currently points to, along with the remainder of the
+// RSX-mapped region that it was allocated from:
+void gcm_segments_init(gcmContextData *,void *,uint32_t,uint32_t);
+int gcm_segments_initialized();
+
+// Chain to a fresh segment with room for at least length words:
+void gcm_segments_next(gcmContextData *,uint32_t);
+
+// Keep the current segment from being reused until gcm_segments_unpin, which emits a semaphore
+// release that the RSX must pass first. Commands that are CALLed from later on in the command
+// buffer (instanced draws do this) must be pinned, since the CALLs may land in other segments:
+void gcm_segments_pin();
+void gcm_segments_unpin(gcmContextData *);
+void gcm_autoflush_reset(gcmContextData *);
+
+// Command buffer capture. Whenever the put register is updated, the words emitted since the last
+// update are appended to the file at RSXGL_CONFIG_fifo_capture_path, in the order that the RSX
+// reads them; src/fifodecode decodes them on the host. gcm_capture writes everything up to the
+// given position, and gcm_capture_restart is called after a jump to somewhere else:
+#if RSXGL_CONFIG_fifo_capture
+void gcm_capture(const uint32_t *);
+void gcm_capture_restart(const uint32_t *);
+#endif
+
 static inline uint32_t *
 gcm_reserve(gcmContextData * context,const uint32_t length)
 {
-  if((context -> current + length) > context -> end) {
-    int32_t r = gcm_reserve_callback(context,length);
-    rsxgl_assert(r == 0);
+  if((context -> current + length) > gcm_autoflush.limit) {
+    gcm_reserve_slow(context,length);
   }
   return context -> current;
 }
 
+// Unchecked emission. A caller that has already reserved enough room for a whole
+// sequence of commands (rsxgl_draw does this for the validators) can skip the space check
+// for each of them. Debug builds remember the extent of the reservation, and assert that
+// unchecked reservations stay within it.
+#if !defined(NDEBUG)
+extern uint32_t * gcm_unchecked_end;
+#endif
+
+static inline void
+gcm_reserve_all(gcmContextData * context,const uint32_t length)
+{
+  gcm_reserve(context,length);
+#if !defined(NDEBUG)
+  gcm_unchecked_end = context -> current + length;
+#endif
+}
+
+static inline uint32_t *
+gcm_reserve_unchecked(gcmContextData * context,const uint32_t length)
+{
+#if !defined(NDEBUG)
+  rsxgl_assert((context -> current + length) <= gcm_unchecked_end);
+#endif
+  return context -> current;
+}
+
+static inline void
+gcm_autoflush_suspend()
+{
+  ++gcm_autoflush.suspended;
+}
+
+// Once the last suspension is lifted, force the next gcm_reserve onto the slow path so
+// that it can decide whether a flush is overdue:
+static inline void
+gcm_autoflush_resume(gcmContextData * context)
+{
+  rsxgl_assert(gcm_autoflush.suspended > 0);
+  if(--gcm_autoflush.suspended == 0) {
+    gcm_autoflush.limit = context -> current;
+  }
+}
+
+// Command list recording (see command_list.cc). While a list is open, the commands emitted
+// by draw calls are redirected into it, by swapping the context's buffer pointers with the
+// ones held here. Everything else - uploads, copies, timestamps - still goes to the command
+// buffer that the RSX is reading from.
+struct gcm_record_t {
+  // Whichever buffer the context isn't currently pointing at - the list being recorded
+  // when active is 0, the RSX's command buffer when active is 1:
+  uint32_t * begin, * end, * current;
+
+  uint32_t open:1, active:1;
+};
+
+extern struct gcm_record_t gcm_record;
+
+// Chain the list being recorded to a fresh chunk with room for at least length words:
+void gcm_record_next(gcmContextData *,uint32_t);
+
+static inline void
+gcm_record_swap(gcmContextData * context)
+{
+  uint32_t * begin = context -> begin, * end = context -> end, * current = context -> current;
+  context -> begin = gcm_record.begin;
+  context -> end = gcm_record.end;
+  context -> current = gcm_record.current;
+  gcm_record.begin = begin;
+  gcm_record.end = end;
+  gcm_record.current = current;
+}
+
+// Position in the command buffer that the RSX reads from, regardless of recording:
+static inline uint32_t *
+gcm_live_current(gcmContextData * context)
+{
+  return gcm_record.active ? gcm_record.current : context -> current;
+}
+
+// Start sending commands to the open command list, if there is one:
+static inline void
+gcm_record_enter(gcmContextData * context)
+{
+  if(gcm_record.open && !gcm_record.active) {
+    gcm_autoflush_suspend();
+    gcm_record_swap(context);
+    gcm_record.active = 1;
+    gcm_autoflush.limit = context -> end;
+  }
+}
+
+// Go back to sending commands to the RSX's command buffer:
+static inline void
+gcm_record_leave(gcmContextData * context)
+{
+  if(gcm_record.active) {
+    gcm_record_swap(context);
+    gcm_record.active = 0;
+    gcm_autoflush_resume(context);
+    if(gcm_autoflush.suspended) gcm_autoflush.limit = context -> end;
+  }
+}
+
 static inline void
 gcm_emit(uint32_t ** buffer,const uint32_t word)
 {
@@ -88,6 +244,79 @@ gcm_finish_n_commands(gcmContextData * context,uint32_t n)
   context -> current += n;
 }
 
+// Shadow of the 3D object's method state, indexed by method offset / 4. Methods that only set
+// state can be sent with gcm_emit_shadowed(), which leaves them out if the RSX already holds
+// the same values. Any place that emits a shadowed method some other way, or that leaves the
+// RSX's state unknown, has to call gcm_shadow_invalidate().
+#define GCM_SHADOW_METHODS (0x2000 >> 2)
+
+struct gcm_shadow_t {
+  uint32_t values[GCM_SHADOW_METHODS];
+  uint32_t valid[GCM_SHADOW_METHODS >> 5];
+};
+
+extern struct gcm_shadow_t gcm_shadow;
+
+void gcm_shadow_invalidate();
+
+// Mark n consecutive methods as unknown, for when they've been changed as a side effect of
+// some other method:
+static inline void
+gcm_shadow_forget(const uint32_t method,const uint32_t n)
+{
+  uint32_t i = method >> 2, j = 0;
+  for(;j < n;++i,++j) {
+    gcm_shadow.valid[i >> 5] &= ~(1U << (i & 31));
+  }
+}
+
+// Compare n consecutive method arguments against the shadow, and update it. Returns non-zero
+// if any of them differ:
+static inline int
+gcm_shadow_update(const uint32_t method,const uint32_t * values,const uint32_t n)
+{
+  uint32_t i = method >> 2, j = 0;
+  int changed = 0;
+
+  rsxgl_assert((i + n) <= GCM_SHADOW_METHODS);
+
+  for(;j < n;++i,++j) {
+    const uint32_t bit = 1U << (i & 31);
+    if(!(gcm_shadow.valid[i >> 5] & bit) || gcm_shadow.values[i] != values[j]) {
+      gcm_shadow.values[i] = values[j];
+      gcm_shadow.valid[i >> 5] |= bit;
+      changed = 1;
+    }
+  }
+
+  return changed;
+}
+
+static inline void
+gcm_emit_shadowed(uint32_t ** buffer,const uint32_t method,const uint32_t * values,const uint32_t n)
+{
+  if(gcm_shadow_update(method,values,n)) {
+    uint32_t j = 0;
+    gcm_emit_method(buffer,method,n);
+    for(;j < n;++j) {
+      gcm_emit(buffer,values[j]);
+    }
+  }
+}
+
+static inline void
+gcm_emit_shadowed1(uint32_t ** buffer,const uint32_t method,const uint32_t value)
+{
+  gcm_emit_shadowed(buffer,method,&value,1);
+}
+
+static inline void
+gcm_emit_shadowed2(uint32_t ** buffer,const uint32_t method,const uint32_t value0,const uint32_t value1)
+{
+  const uint32_t values[2] = { value0, value1 };
+  gcm_emit_shadowed(buffer,method,values,2);
+}
+
 static inline uint32_t
 gcm_jump_cmd(const uint32_t offset)
 {
@@ -117,6 +346,7 @@ gcm_begin_list(gcmContextData * context)
   rsxgl_assert(s == 0);
 
   // Add a nop - this gets replaced by gcm_finish_list with a "jump" method:
+  gcm_autoflush_suspend();
   uint32_t * buffer = gcm_reserve(context,1);
   rsxgl_debug_printf("%s: jump buffer:%lu call_offset:%u\n",__PRETTY_FUNCTION__,(unsigned long)buffer,call_offset);
 
@@ -139,6 +369,7 @@ gcm_finish_list(gcmContextData * context,const uint32_t call_offset,const bool c
   rsxgl_debug_printf("%s: call_offset:%u call buffer:%lu jump buffer:%lu jump_offset:%u\n",__PRETTY_FUNCTION__,call_offset,(unsigned long)context -> current,(unsigned long)buffer,jump_offset);
 
   gcm_emit_at(buffer,0,gcm_jump_cmd(jump_offset));
+  gcm_autoflush_resume(context);
 
   // Insert the "return" method, and optionally a "call" method to invoke the list immediately:
   const uint32_t n = call ? 2 : 1;
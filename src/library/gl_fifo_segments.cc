@@ -0,0 +1,277 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// gl_fifo_segments.cc - Segmented command buffer. Rather than wrapping around a single
+// fixed buffer (and waiting for the RSX to catch up whenever it fills), commands are
+// written into a chain of segments linked by jump commands. A segment is handed back to
+// the pool once the RSX has read past a semaphore released at its end. The pool grows
+// by mapping more main memory when every segment is still in flight.
+
+#include "gl_fifo.h"
+#include "sync.h"
+#include "rsxgl_assert.h"
+#include "rsxgl_limits.h"
+#include "debug.h"
+
+#include <malloc.h>
+#include <stdint.h>
+
+// Words at the end of each segment that are set aside for the semaphore release and the
+// jump to the next segment:
+#define RSXGL_COMMAND_SEGMENT_TAIL 5
+
+struct gcm_segment_t {
+  uint32_t * begin, * end;
+  uint32_t offset;
+
+  // Value that the segment's semaphore is set to once the RSX has read all of it:
+  uint32_t timestamp;
+};
+
+typedef boost::uint_value_t< RSXGL_MAX_COMMAND_SEGMENTS >::least gcm_segment_index_type;
+
+static struct gcm_segment_pool_t {
+  gcm_segment_t segments[RSXGL_MAX_COMMAND_SEGMENTS];
+  uint32_t nsegments;
+
+  // Segments that may be written to:
+  gcm_segment_index_type free[RSXGL_MAX_COMMAND_SEGMENTS];
+  uint32_t nfree;
+
+  // Segments that the RSX may still be reading from, oldest first:
+  gcm_segment_index_type retire[RSXGL_MAX_COMMAND_SEGMENTS];
+  uint32_t retire_head, nretire;
+
+  gcm_segment_index_type current;
+
+  // Length, in words, of segments created by growing the pool:
+  uint32_t segment_length;
+
+  rsxgl_sync_object_index_type sync;
+  uint32_t next_timestamp;
+
+  // Segment that's kept off of the free list by gcm_segments_pin, or RSXGL_MAX_COMMAND_SEGMENTS.
+  // pinned_retired is set once the RSX has read past the end of it:
+  gcm_segment_index_type pinned;
+  uint32_t pinned_retired;
+} gcm_segments = { { }, 0, { }, 0, { }, 0, 0, 0, 0, RSXGL_MAX_SYNC_OBJECTS, 1, RSXGL_MAX_COMMAND_SEGMENTS, 0 };
+
+static inline bool
+gcm_segment_passed(const uint32_t timestamp)
+{
+  return (int32_t)(rsxgl_sync_value(gcm_segments.sync) - timestamp) >= 0;
+}
+
+struct gcm_segment_passed_predicate {
+  const uint32_t timestamp;
+
+  gcm_segment_passed_predicate(const uint32_t _timestamp) : timestamp(_timestamp) {}
+
+  bool operator()() const {
+    return gcm_segment_passed(timestamp);
+  }
+};
+
+static void
+gcm_segments_add(uint32_t * address,const uint32_t length,const bool make_free)
+{
+  if(gcm_segments.nsegments == RSXGL_MAX_COMMAND_SEGMENTS) return;
+
+  gcm_segment_t & segment = gcm_segments.segments[gcm_segments.nsegments];
+  segment.begin = address;
+  segment.end = address + length;
+  segment.timestamp = 0;
+
+  int32_t s = gcmAddressToOffset(address,&segment.offset);
+  rsxgl_assert(s == 0);
+
+  if(make_free) {
+    gcm_segments.free[gcm_segments.nfree++] = gcm_segments.nsegments;
+  }
+
+  ++gcm_segments.nsegments;
+}
+
+// Split an RSX-mapped region of main memory into segments:
+static void
+gcm_segments_add_region(uint8_t * address,uint32_t size)
+{
+  const uint32_t segment_size = gcm_segments.segment_length * sizeof(uint32_t);
+
+  for(;size >= segment_size && gcm_segments.nsegments < RSXGL_MAX_COMMAND_SEGMENTS;address += segment_size,size -= segment_size) {
+    gcm_segments_add((uint32_t *)address,gcm_segments.segment_length,true);
+  }
+}
+
+// Map another chunk of main memory for use by the RSX:
+static bool
+gcm_segments_grow()
+{
+  if(gcm_segments.nsegments == RSXGL_MAX_COMMAND_SEGMENTS) return false;
+
+  const uint32_t size = RSXGL_COMMAND_SEGMENT_GROWTH_SIZE;
+  void * address = memalign(1024 * 1024,size);
+  if(address == 0) return false;
+
+  uint32_t offset = 0;
+  if(gcmMapMainMemory(address,size,&offset) != 0) {
+    free(address);
+    return false;
+  }
+
+  rsxgl_debug_printf("%s: %u bytes at %lx\n",__PRETTY_FUNCTION__,size,(unsigned long)address);
+
+  gcm_segments_add_region((uint8_t *)address,size);
+  return true;
+}
+
+// Move segments that the RSX has finished reading onto the free list:
+static void
+gcm_segments_retire()
+{
+  while(gcm_segments.nretire > 0) {
+    const gcm_segment_index_type i = gcm_segments.retire[gcm_segments.retire_head];
+    if(!gcm_segment_passed(gcm_segments.segments[i].timestamp)) break;
+
+    // A pinned segment may still be CALLed; it's put back in the retire list by gcm_segments_unpin:
+    if(i == gcm_segments.pinned) {
+      gcm_segments.pinned_retired = 1;
+    }
+    else {
+      gcm_segments.free[gcm_segments.nfree++] = i;
+    }
+    gcm_segments.retire_head = (gcm_segments.retire_head + 1) % RSXGL_MAX_COMMAND_SEGMENTS;
+    --gcm_segments.nretire;
+  }
+}
+
+static inline void
+gcm_segments_retire_push(const gcm_segment_index_type i)
+{
+  gcm_segments.retire[(gcm_segments.retire_head + gcm_segments.nretire) % RSXGL_MAX_COMMAND_SEGMENTS] = i;
+  ++gcm_segments.nretire;
+}
+
+static gcm_segment_index_type
+gcm_segments_acquire(gcmContextData * context)
+{
+  gcm_segments_retire();
+
+  // Every segment is in use, and no more can be made; wait for the oldest one (again, if that
+  // turned out to be the pinned segment):
+  while(gcm_segments.nfree == 0 && !gcm_segments_grow()) {
+    rsxgl_assert(gcm_segments.nretire > 0);
+    const uint32_t timestamp = gcm_segments.segments[gcm_segments.retire[gcm_segments.retire_head]].timestamp;
+
+    rsxgl_gcm_flush(context);
+    rsxgl_wait(RSXGL_STALL_COMMAND_BUFFER,gcm_segment_passed_predicate(timestamp));
+
+    gcm_segments_retire();
+  }
+
+  rsxgl_assert(gcm_segments.nfree > 0);
+  return gcm_segments.free[--gcm_segments.nfree];
+}
+
+extern "C" void
+gcm_segments_init(gcmContextData * context,void * address,const uint32_t size,const uint32_t segment_length)
+{
+  rsxgl_assert(gcm_segments.nsegments == 0);
+
+  gcm_segments.sync = rsxgl_sync_object_allocate();
+  rsxgl_assert(gcm_segments.sync != RSXGL_MAX_SYNC_OBJECTS);
+  rsxgl_sync_cpu_signal(gcm_segments.sync,0);
+
+  gcm_segments.segment_length = segment_length;
+
+  // The command buffer that gcmInitBodyEx set up is the first segment:
+  gcm_segments.current = 0;
+  gcm_segments_add(context -> begin,context -> end - context -> begin,false);
+
+  // Whatever remains of the region that was mapped by gcmInitBodyEx:
+  gcm_segments_add_region((uint8_t *)address,size);
+
+  context -> end = gcm_segments.segments[gcm_segments.current].end - RSXGL_COMMAND_SEGMENT_TAIL;
+}
+
+extern "C" int
+gcm_segments_initialized()
+{
+  return gcm_segments.nsegments > 0;
+}
+
+extern "C" void
+gcm_segments_next(gcmContextData * context,const uint32_t length)
+{
+  rsxgl_assert(length <= (gcm_segments.segment_length - RSXGL_COMMAND_SEGMENT_TAIL));
+
+  const gcm_segment_index_type next = gcm_segments_acquire(context);
+  gcm_segment_t & segment = gcm_segments.segments[gcm_segments.current];
+
+  // Finish off the current segment - release its semaphore, then jump to the next one:
+  segment.timestamp = gcm_segments.next_timestamp++;
+
+  uint32_t * buffer = context -> current;
+  gcm_emit_method_at(buffer,0,NV406ETCL_SEMAPHORE_OFFSET,1);
+  gcm_emit_at(buffer,1,gcm_segments.sync << 4);
+  gcm_emit_method_at(buffer,2,NV406ETCL_SEMAPHORE_RELEASE,1);
+  gcm_emit_at(buffer,3,segment.timestamp);
+  gcm_emit_at(buffer,4,gcm_jump_cmd(gcm_segments.segments[next].offset));
+
+#if RSXGL_CONFIG_fifo_capture
+  gcm_capture(buffer + RSXGL_COMMAND_SEGMENT_TAIL);
+  gcm_capture_restart(gcm_segments.segments[next].begin);
+#endif
+
+  gcm_segments_retire_push(gcm_segments.current);
+
+  // Start writing into the next segment:
+  gcm_segments.current = next;
+  context -> begin = gcm_segments.segments[next].begin;
+  context -> current = gcm_segments.segments[next].begin;
+  context -> end = gcm_segments.segments[next].end - RSXGL_COMMAND_SEGMENT_TAIL;
+
+  rsxgl_gcm_flush(context);
+}
+
+extern "C" void
+gcm_segments_pin()
+{
+  if(!gcm_segments_initialized()) return;
+
+  rsxgl_assert(gcm_segments.pinned == RSXGL_MAX_COMMAND_SEGMENTS);
+  gcm_segments.pinned = gcm_segments.current;
+  gcm_segments.pinned_retired = 0;
+}
+
+extern "C" void
+gcm_segments_unpin(gcmContextData * context)
+{
+  if(gcm_segments.pinned == RSXGL_MAX_COMMAND_SEGMENTS) return;
+
+  // Nothing after the current position can be read before the commands that precede it, so a
+  // segment that's still current doesn't need anything more:
+  if(gcm_segments.pinned != gcm_segments.current) {
+    // Release a semaphore after the last command that might refer to the pinned segment. If this
+    // spills into yet another segment, the pinned one is still held back:
+    uint32_t * buffer = gcm_reserve(context,4);
+    const uint32_t timestamp = gcm_segments.next_timestamp++;
+
+    gcm_emit_method_at(buffer,0,NV406ETCL_SEMAPHORE_OFFSET,1);
+    gcm_emit_at(buffer,1,gcm_segments.sync << 4);
+    gcm_emit_method_at(buffer,2,NV406ETCL_SEMAPHORE_RELEASE,1);
+    gcm_emit_at(buffer,3,timestamp);
+    gcm_finish_n_commands(context,4);
+
+    // If it's still waiting to be retired, its timestamp is just pushed back; a later one in
+    // the retire list can't be reused until it has passed, which only costs a little time:
+    gcm_segments.segments[gcm_segments.pinned].timestamp = timestamp;
+    if(gcm_segments.pinned_retired) {
+      gcm_segments_retire_push(gcm_segments.pinned);
+    }
+  }
+
+  gcm_segments.pinned = RSXGL_MAX_COMMAND_SEGMENTS;
+  gcm_segments.pinned_retired = 0;
+}
@@ -2,6 +2,7 @@
 #include "GL3/rsxgl.h"
 #include "debug.h"
 #include "mem.h"
+#include "tlsf.h"
 
 #include <rsx/gcm_sys.h>
 
@@ -16,17 +17,20 @@
 #undef malloc_getpagesize
 
 #include <assert.h>
-
-//uint32_t rsxgl_rsx_mspace_offset = 0, rsxgl_rsx_mspace_size = 0;
+#include <malloc.h>
+#include <string.h>
 
 extern struct rsxgl_init_parameters_t rsxgl_init_parameters;
 
-mspace
-rsxgl_rsx_mspace()
-{
-  static mspace _rsx_mspace = 0;
+// RSX local memory is managed by a TLSF allocator (see tlsf.h), whose bookkeeping is kept in
+// main memory, so allocating and freeing never touch the RSX's memory:
+static struct rsxgl_tlsf_t * _rsx_heap = 0;
+static uint8_t * _rsx_heap_address = 0;
 
-  if(_rsx_mspace == 0) {
+struct rsxgl_tlsf_t *
+rsxgl_rsx_heap()
+{
+  if(_rsx_heap == 0) {
     gcmConfiguration config;
     gcmGetConfiguration(&config);
 
@@ -38,34 +42,69 @@ rsxgl_rsx_mspace()
 		       __PRETTY_FUNCTION__,
 		       size,available,offset,(uint64_t)config.localAddress + offset);
 
-    _rsx_mspace = create_mspace_with_base((uint8_t *)config.localAddress + offset,size,0);
-  }
+    _rsx_heap_address = (uint8_t *)config.localAddress + offset;
+    _rsx_heap = rsxgl_tlsf_create(size);
+    assert(_rsx_heap != 0);
 
-  assert(_rsx_mspace != 0);
+    // An offset of 0 means "no memory" to the rest of RSXGL, so the heap's first block is
+    // never handed out:
+    rsxgl_tlsf_memalign(_rsx_heap,RSXGL_TLSF_ALIGN,RSXGL_TLSF_ALIGN);
+  }
 
-  return _rsx_mspace;
+  return _rsx_heap;
 }
 
 void *
 rsxgl_rsx_malloc(rsx_size_t size)
 {  
-  return mspace_malloc(rsxgl_rsx_mspace(),size);
+  return rsxgl_rsx_memalign(RSXGL_TLSF_ALIGN,size);
 }
 
 void *
 rsxgl_rsx_memalign(rsx_size_t alignment,rsx_size_t size)
 {
-  return mspace_memalign(rsxgl_rsx_mspace(),alignment,size);
+  const uint32_t offset = rsxgl_tlsf_memalign(rsxgl_rsx_heap(),alignment,size);
+  return (offset == RSXGL_TLSF_NONE) ? 0 : (_rsx_heap_address + offset);
 }
 
 void *
 rsxgl_rsx_realloc(void * mem,rsx_size_t size)
 {
-  return mspace_realloc(rsxgl_rsx_mspace(),mem,size);
+  if(mem == 0) return rsxgl_rsx_malloc(size);
+
+  const uint32_t old_size = rsxgl_tlsf_block_size(rsxgl_rsx_heap(),(uint8_t *)mem - _rsx_heap_address);
+  if(size <= old_size) return mem;
+
+  void * new_mem = rsxgl_rsx_malloc(size);
+  if(new_mem != 0) {
+    memcpy(new_mem,mem,old_size);
+    rsxgl_rsx_free(mem);
+  }
+  return new_mem;
 }
 
 void
 rsxgl_rsx_free(void * mem)
 {
-  mspace_free(rsxgl_rsx_mspace(),mem);
+  if(mem == 0) return;
+  rsxgl_tlsf_free(rsxgl_rsx_heap(),(uint8_t *)mem - _rsx_heap_address);
+}
+
+void
+rsxgl_tlsf_memory_stats(const struct rsxgl_tlsf_t * tlsf,struct rsxgl_memory_stats_t * stats)
+{
+  stats -> size = tlsf -> size;
+  stats -> allocated = tlsf -> used_size;
+  stats -> free = tlsf -> size - tlsf -> used_size;
+  stats -> largest_free = rsxgl_tlsf_largest_free(tlsf);
+  stats -> count = tlsf -> used_count;
+  stats -> high_water = tlsf -> high_water;
+}
+
+void
+rsxgl_mspace_memory_stats(mspace space,struct rsxgl_memory_stats_t * stats)
+{
+  const struct mallinfo info = mspace_mallinfo(space);
+  stats -> free = info.fordblks;
+  stats -> largest_free = info.keepcost;
 }
@@ -19,6 +19,40 @@ extern "C" {
 
 typedef uint32_t rsx_size_t;
 
+// What an allocator has handed out, and what it has left. Everything is in bytes, except for
+// count, which is the number of allocations outstanding. high_water is the most that allocated
+// has ever been:
+struct rsxgl_memory_stats_t {
+  rsx_size_t size, allocated, free, largest_free, count, high_water;
+};
+
+// Allocators that don't keep these figures themselves (dlmalloc) keep them with these:
+static inline void
+rsxgl_memory_stats_allocate(struct rsxgl_memory_stats_t * stats,const rsx_size_t size)
+{
+  stats -> allocated += size;
+  ++stats -> count;
+  if(stats -> allocated > stats -> high_water) stats -> high_water = stats -> allocated;
+}
+
+static inline void
+rsxgl_memory_stats_free(struct rsxgl_memory_stats_t * stats,const rsx_size_t size)
+{
+  stats -> allocated -= size;
+  --stats -> count;
+}
+
+struct rsxgl_tlsf_t;
+struct rsxgl_tlsf_t * rsxgl_rsx_heap();
+
+// Fill in stats from a TLSF allocator:
+void rsxgl_tlsf_memory_stats(const struct rsxgl_tlsf_t *,struct rsxgl_memory_stats_t *);
+
+// Fill in free and largest_free from a dlmalloc mspace; the rest come from counters kept with
+// the functions above. dlmalloc doesn't track its largest free chunk, so largest_free is the
+// size of the untouched space at the top of the mspace, which is a lower bound:
+void rsxgl_mspace_memory_stats(mspace,struct rsxgl_memory_stats_t *);
+
 void * rsxgl_rsx_malloc(rsx_size_t);
 void * rsxgl_rsx_memalign(rsx_size_t,rsx_size_t);
 void * rsxgl_rsx_realloc(void *,rsx_size_t);
@@ -17,17 +17,21 @@ typedef struct _gcmCtxData gcmContextData;
 void * rsxgl_ringbuffer_migrate_memalign(gcmContextData *,const rsx_size_t,const rsx_size_t);
 void rsxgl_ringbuffer_migrate_free(gcmContextData *,const void *,const rsx_size_t);
 void rsxgl_ringbuffer_migrate_reset(gcmContextData *);
+void rsxgl_ringbuffer_migrate_stats(rsxgl_memory_stats_t &);
 
 void * rsxgl_dumb_migrate_memalign(gcmContextData *,const rsx_size_t,const rsx_size_t);
 void rsxgl_dumb_migrate_free(gcmContextData *,const void *,const rsx_size_t);
 void rsxgl_dumb_migrate_reset(gcmContextData *);
+void rsxgl_dumb_migrate_stats(rsxgl_memory_stats_t &);
 
 //#define rsxgl_vertex_migrate_memalign rsxgl_dumb_migrate_memalign
 //#define rsxgl_vertex_migrate_free rsxgl_dumb_migrate_free
 //#define rsxgl_vertex_migrate_reset rsxgl_dumb_migrate_reset
+//#define rsxgl_vertex_migrate_stats rsxgl_dumb_migrate_stats
 
 #define rsxgl_vertex_migrate_memalign rsxgl_ringbuffer_migrate_memalign
 #define rsxgl_vertex_migrate_free rsxgl_ringbuffer_migrate_free
 #define rsxgl_vertex_migrate_reset rsxgl_ringbuffer_migrate_reset
+#define rsxgl_vertex_migrate_stats rsxgl_ringbuffer_migrate_stats
 
 #endif
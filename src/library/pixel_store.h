@@ -8,6 +8,8 @@
 #ifndef rsxgl_pixel_store_H
 #define rsxgl_pixel_store_H
 
+#include "cxxutil.h"
+
 #include <stdint.h>
 
 enum pixel_store_alignment {
@@ -24,4 +26,21 @@ struct pixel_store_t {
   pixel_store_t();
 };
 
+static inline uint32_t
+rsxgl_pixel_store_aligned(const pixel_store_t & store,uint32_t value)
+{
+  switch(store.alignment) {
+  case RSXGL_PIXEL_STORE_ALIGNMENT_1:
+    return value;
+  case RSXGL_PIXEL_STORE_ALIGNMENT_2:
+    return align_pot< uint32_t, 2 >(value);
+  case RSXGL_PIXEL_STORE_ALIGNMENT_4:
+    return align_pot< uint32_t, 4 >(value);
+  case RSXGL_PIXEL_STORE_ALIGNMENT_8:
+    return align_pot< uint32_t, 8 >(value);
+  default:
+    return value;
+  }
+}
+
 #endif
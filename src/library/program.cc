@@ -289,7 +289,7 @@ glReleaseShaderCompiler (void)
 // Program functions:
 program_t::program_t()
   : deleted(0), timestamp(0),
-    linked(0), validated(0), invalid_uniforms(0), ref_count(0),
+    linked(0), validated(0), invalid_uniforms(0), ref_count(0), pinned(0),
     attrib_name_max_length(0), uniform_name_max_length(0),
     mesa_program(0), nvfx_vp(0), nvfx_fp(0), nvfx_streamvp(0), nvfx_streamfp(0),
     vp_ucode_offset(~0), fp_ucode_offset(~0), vp_num_insn(0), fp_num_insn(0), 
@@ -298,7 +298,8 @@ program_t::program_t()
     fp_control(0),
     streamvp_input_mask(0), streamvp_output_mask(0), streamvp_num_internal_const(0),
     streamfp_control(0), streamfp_num_outputs(0),
-    streamvp_vertexid_index(~0), instanceid_index(~0), point_sprite_control(0)
+    streamvp_vertexid_index(~0), instanceid_index(~0), point_sprite_control(0),
+    uniforms_validate_words(0)
 {
 }
 
@@ -332,7 +333,7 @@ glDeleteProgram (GLuint program_name)
   // TODO: orphan it, instead of doing this:
   program_t & program = program_t::storage().at(program_name);
   if(program.timestamp > 0) {
-    rsxgl_timestamp_wait(current_ctx(),program.timestamp);
+    rsxgl_timestamp_wait(current_ctx(),program.timestamp,RSXGL_STALL_PROGRAM_DELETE);
     program.timestamp = 0;
   }
 
@@ -525,10 +526,12 @@ rsxgl_vp_ucode_offset(const struct nvfx_vertex_program_exec * address)
   return ((uint8_t *)address - (uint8_t *)main_ucode_address) / (sizeof(struct nvfx_vertex_program_exec));
 }
 
+static const size_t rsxgl_main_ucode_size = 1024 * 1024;
+
 static mspace
 rsxgl_main_ucode_mspace()
 {
-  static const size_t size = 1024 * 1024;
+  static const size_t size = rsxgl_main_ucode_size;
   static mspace space = 0;
 
   if(space == 0) {
@@ -542,6 +545,24 @@ rsxgl_main_ucode_mspace()
   return space;
 }
 
+// Microcode allocations from both mspaces are counted, for glGetMemoryArenaParameterivRSX:
+static rsxgl_memory_stats_t rsxgl_main_ucode_stats, rsxgl_rsx_ucode_stats;
+
+static void *
+rsxgl_ucode_memalign(mspace space,rsxgl_memory_stats_t & stats,const size_t size)
+{
+  void * address = mspace_memalign(space,RSXGL_CACHE_LINE_SIZE,size);
+  if(address != 0) rsxgl_memory_stats_allocate(&stats,mspace_usable_size(address));
+  return address;
+}
+
+static void
+rsxgl_ucode_free(mspace space,rsxgl_memory_stats_t & stats,void * address)
+{
+  rsxgl_memory_stats_free(&stats,mspace_usable_size(address));
+  mspace_free(space,address);
+}
+
 //
 void * rsx_ucode_address = 0;
 uint32_t rsx_ucode_offset = 0;
@@ -566,10 +587,12 @@ rsxgl_rsx_ucode_offset(const uint32_t * address)
   return ((uint8_t *)address - (uint8_t *)rsx_ucode_address) / (sizeof(uint32_t) * 4);
 }
 
+static const size_t rsxgl_rsx_ucode_size = 4 * 1024 * 1024;
+
 static mspace
 rsxgl_rsx_ucode_mspace()
 {
-  static const size_t size = 4 * 1024 * 1024;
+  static const size_t size = rsxgl_rsx_ucode_size;
   static mspace space = 0;
 
   if(space == 0) {
@@ -585,6 +608,21 @@ rsxgl_rsx_ucode_mspace()
   return space;
 }
 
+void
+rsxgl_program_ucode_stats(const uint32_t location,rsxgl_memory_stats_t & stats)
+{
+  if(location == RSXGL_MEMORY_LOCATION_LOCAL) {
+    stats = rsxgl_rsx_ucode_stats;
+    stats.size = rsxgl_rsx_ucode_size;
+    rsxgl_mspace_memory_stats(rsxgl_rsx_ucode_mspace(),&stats);
+  }
+  else {
+    stats = rsxgl_main_ucode_stats;
+    stats.size = rsxgl_main_ucode_size;
+    rsxgl_mspace_memory_stats(rsxgl_main_ucode_mspace(),&stats);
+  }
+}
+
 static inline uint8_t
 rsxgl_glsl_type_to_rsxgl_type(const glsl_type * type)
 {
@@ -642,9 +680,14 @@ glLinkProgram (GLuint program_name)
 
   program_t & program = program_t::storage().at(program_name);
 
+  // Relinking would move the microcode that recorded command lists call into:
+  if(program.pinned != 0) {
+    RSXGL_ERROR_(GL_INVALID_OPERATION);
+  }
+
   // TODO: orphan it, instead of doing this:
   if(program.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,program.timestamp);
+    rsxgl_timestamp_wait(ctx,program.timestamp,RSXGL_STALL_PROGRAM_LINK);
     program.timestamp = 0;
   }
 
@@ -654,19 +697,19 @@ glLinkProgram (GLuint program_name)
 
   // Destroy other tables, etc:
   if(program.vp_ucode_offset != ~0U) {
-    mspace_free(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_address(program.vp_ucode_offset));
+    rsxgl_ucode_free(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_stats,rsxgl_main_ucode_address(program.vp_ucode_offset));
     program.vp_ucode_offset = ~0U;
   }
   if(program.fp_ucode_offset != ~0U) {
-    mspace_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_address(program.fp_ucode_offset));
+    rsxgl_ucode_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_stats,rsxgl_rsx_ucode_address(program.fp_ucode_offset));
     program.fp_ucode_offset = ~0U;
   }
   if(program.streamvp_ucode_offset != ~0U) {
-    mspace_free(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_address(program.streamvp_ucode_offset));
+    rsxgl_ucode_free(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_stats,rsxgl_main_ucode_address(program.streamvp_ucode_offset));
     program.streamvp_ucode_offset = ~0U;
   }
   if(program.streamfp_ucode_offset != ~0U) {
-    mspace_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_address(program.streamfp_ucode_offset));
+    rsxgl_ucode_free(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_stats,rsxgl_rsx_ucode_address(program.streamfp_ucode_offset));
     program.streamfp_ucode_offset = ~0U;
   }
   program.uniform_values.release();
@@ -726,7 +769,7 @@ glLinkProgram (GLuint program_name)
       {
 	static const std::string kVPUcodeAllocFail("Failed to allocate space for vertex program microcode");
 	
-	struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)mspace_memalign(rsxgl_main_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_vp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
+	struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)rsxgl_ucode_memalign(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_stats,program.nvfx_vp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
 	if(address == 0) {
 	  info += kVPUcodeAllocFail;
 	  //goto fail;
@@ -745,7 +788,7 @@ glLinkProgram (GLuint program_name)
       {
 	static const std::string kFPUcodeAllocFail("Failed to allocate space for fragment program microcode");
 	
-	uint32_t * address = (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_fp -> insn_len * sizeof(uint32_t));
+	uint32_t * address = (uint32_t *)rsxgl_ucode_memalign(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_stats,program.nvfx_fp -> insn_len * sizeof(uint32_t));
 	if(address == 0) {
 	  info += kFPUcodeAllocFail;
 	  //goto fail;
@@ -778,6 +821,9 @@ glLinkProgram (GLuint program_name)
     std::deque< ieee32_t > uniform_values;
     std::deque< uint32_t > program_offsets;
 
+    // FP_ACTIVE_PROGRAM, emitted after fragment program constants are updated:
+    program.uniforms_validate_words = 2;
+
     struct cstr_less {
       bool operator()(const char * lhs,const char * rhs) const {
 	return strcmp(lhs,rhs) < 0;
@@ -907,6 +953,9 @@ glLinkProgram (GLuint program_name)
 	      if(it != nvfx_vp_constant_map.end()) {
 		uniform.enabled.set(RSXGL_VERTEX_SHADER);
 		uniform.vp_index = it -> second;
+
+		// VP_UPLOAD_CONST_ID for each column:
+		program.uniforms_validate_words += 6 * uniform.count;
 	      }
 	      break;
 	    }
@@ -932,6 +981,9 @@ glLinkProgram (GLuint program_name)
 		for(std::deque< uint32_t >::const_iterator jt = offsets.begin(),jt_end = offsets.end();jt != jt_end;++jt) {
 		  program_offsets.push_back(*jt / 4);
 		}
+
+		// An inline transfer of up to 4 words for each column, at each offset:
+		program.uniforms_validate_words += (12 + 4) * uniform.count * offsets.size();
 	      }
 	      break;
 	    }
@@ -1167,7 +1219,7 @@ glLinkProgram (GLuint program_name)
       {
 	static const std::string kVPUcodeAllocFail("Failed to allocate space for stream vertex program microcode");
 	
-	struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)mspace_memalign(rsxgl_main_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_streamvp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
+	struct nvfx_vertex_program_exec * address = (struct nvfx_vertex_program_exec *)rsxgl_ucode_memalign(rsxgl_main_ucode_mspace(),rsxgl_main_ucode_stats,program.nvfx_streamvp -> nr_insns * sizeof(struct nvfx_vertex_program_exec));
 	if(address == 0) {
 	  info += kVPUcodeAllocFail;
 	  //goto fail;
@@ -1186,7 +1238,7 @@ glLinkProgram (GLuint program_name)
       {
 	static const std::string kFPUcodeAllocFail("Failed to allocate space for stream fragment program microcode");
 	
-	uint32_t * address = (uint32_t *)mspace_memalign(rsxgl_rsx_ucode_mspace(),RSXGL_CACHE_LINE_SIZE,program.nvfx_streamfp -> insn_len * sizeof(uint32_t));
+	uint32_t * address = (uint32_t *)rsxgl_ucode_memalign(rsxgl_rsx_ucode_mspace(),rsxgl_rsx_ucode_stats,program.nvfx_streamfp -> insn_len * sizeof(uint32_t));
 	if(address == 0) {
 	  info += kFPUcodeAllocFail;
 	  //goto fail;
@@ -1614,7 +1666,7 @@ glGetTransformFeedbackVarying (GLuint program_name, GLuint index, GLsizei bufSiz
 }
 
 void
-rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
+rsxgl_program_validate(rsxgl_context_t * ctx,const uint64_t timestamp)
 {
   gcmContextData * context = ctx -> base.gcm_context;
 
@@ -1816,7 +1868,7 @@ rsxgl_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
 // It therefore does not re-send uniform variable values. Also does not set texture control,
 // because stream programs don't use textures.
 void
-rsxgl_feedback_program_validate(rsxgl_context_t * ctx,const uint32_t timestamp)
+rsxgl_feedback_program_validate(rsxgl_context_t * ctx,const uint64_t timestamp)
 {
   gcmContextData * context = ctx -> base.gcm_context;
 
@@ -84,10 +84,15 @@ struct program_t {
 
   // --- cold:
   //
-  uint32_t deleted:1,timestamp:31;
+  uint32_t deleted:1;
+  uint64_t timestamp;
 
   uint32_t linked:1,validated:1,invalid_uniforms:1,ref_count:28;
 
+  // Number of recorded command lists that have the program's microcode offsets baked into them.
+  // While it's nonzero, the program can't be relinked:
+  uint16_t pinned;
+
   boost::container::flat_set< shader_t::name_type > attached_shaders, linked_shaders;
 
   // Information returned from glLinkProgram():
@@ -194,6 +199,9 @@ struct program_t {
   textures_bitfield_type textures_enabled;
   texture_assignments_type texture_assignments;
 
+  // Number of words that rsxgl_uniforms_validate emits if every uniform variable is invalid:
+  uint32_t uniforms_validate_words;
+
   // Storage for uniform variable values:
   std::unique_ptr< ieee32_t[] > uniform_values;
 
@@ -202,8 +210,12 @@ struct program_t {
 };
 
 struct rsxgl_context_t;
+struct rsxgl_memory_stats_t;
+
+void rsxgl_program_validate(rsxgl_context_t *,const uint64_t);
+void rsxgl_feedback_program_validate(rsxgl_context_t *,const uint64_t);
 
-void rsxgl_program_validate(rsxgl_context_t *,const uint32_t);
-void rsxgl_feedback_program_validate(rsxgl_context_t *,const uint32_t);
+// Vertex program microcode is kept in main memory, fragment program microcode in RSX memory:
+void rsxgl_program_ucode_stats(const uint32_t,rsxgl_memory_stats_t &);
 
 #endif
@@ -335,7 +335,7 @@ rsxgl_get_query_object_value(rsxgl_context_t * ctx,query_t & query)
     if(query.type == RSXGL_QUERY_SAMPLES_PASSED) {
       rsxgl_assert(query.indices[0] != RSXGL_MAX_QUERY_OBJECTS);
 
-      rsxgl_timestamp_wait(ctx,query.timestamps[1]);
+      rsxgl_timestamp_wait(ctx,query.timestamps[1],RSXGL_STALL_QUERY_RESULT);
       query.value = rsxgl_query_object_get_value(query.indices[0]);
 
       rsxgl_query_object_free(query.indices[0]);
@@ -345,9 +345,9 @@ rsxgl_get_query_object_value(rsxgl_context_t * ctx,query_t & query)
       rsxgl_assert(query.indices[0] != RSXGL_MAX_QUERY_OBJECTS);
 
       uint32_t samples = 0;
-      const uint32_t last_timestamp = query.timestamps[1];
-      for(uint32_t timestamp = query.timestamps[0];(timestamp <= last_timestamp) && (samples == 0);++timestamp) {
-	rsxgl_timestamp_wait(ctx,timestamp);
+      const uint64_t last_timestamp = query.timestamps[1];
+      for(uint64_t timestamp = query.timestamps[0];(timestamp <= last_timestamp) && (samples == 0);++timestamp) {
+	rsxgl_timestamp_wait(ctx,timestamp,RSXGL_STALL_QUERY_RESULT);
 	samples += rsxgl_query_object_get_value(query.indices[0]);
       }
       query.value = (samples > 0);
@@ -358,7 +358,7 @@ rsxgl_get_query_object_value(rsxgl_context_t * ctx,query_t & query)
     else if(query.type == RSXGL_QUERY_TIME_ELAPSED) {
       rsxgl_assert(query.indices[0] != RSXGL_MAX_QUERY_OBJECTS && query.indices[1] != RSXGL_MAX_QUERY_OBJECTS);      
 
-      rsxgl_timestamp_wait(ctx,query.timestamps[1]);
+      rsxgl_timestamp_wait(ctx,query.timestamps[1],RSXGL_STALL_QUERY_RESULT);
       query.value = rsxgl_query_object_get_timestamp(query.indices[1]) - rsxgl_query_object_get_timestamp(query.indices[0]);
 
       rsxgl_query_object_free(query.indices[0]);
@@ -367,7 +367,7 @@ rsxgl_get_query_object_value(rsxgl_context_t * ctx,query_t & query)
       query.indices[1] = RSXGL_MAX_QUERY_OBJECTS;
     }
     else if(query.type == RSXGL_QUERY_TIMESTAMP) {
-      rsxgl_timestamp_wait(ctx,query.timestamps[0]);
+      rsxgl_timestamp_wait(ctx,query.timestamps[0],RSXGL_STALL_QUERY_RESULT);
       query.value = rsxgl_query_object_get_timestamp(query.indices[0]);
 
       rsxgl_query_object_free(query.indices[0]);
@@ -108,7 +108,7 @@ struct query_t {
 
   //
   /// \brief Timestamp - point in the command stream when the query will be finished:
-  uint32_t timestamps[2];
+  uint64_t timestamps[2];
 
   /// \brief Cached value:
   uint64_t value;
@@ -15,6 +15,8 @@
 
 #include <rsx/gcm_sys.h>
 
+#include <algorithm>
+
 // Size of migration buffer:
 static uint32_t rsxgl_vertex_migrate_size = RSXGL_CONFIG_vertex_migrate_buffer_size, rsxgl_vertex_migrate_align = RSXGL_VERTEX_MIGRATE_BUFFER_ALIGN;
 
@@ -25,11 +27,21 @@ static uint8_t rsxgl_vertex_migrate_sync = 0;
 // Head and tail position of the buffer:
 static uint32_t rsxgl_vertex_migrate_head = 0, rsxgl_vertex_migrate_tail = 0;
 
+// Allocations made since the last reset, and the most of the buffer that they've had in use:
+static uint32_t rsxgl_vertex_migrate_count = 0, rsxgl_vertex_migrate_high_water = 0;
+
 // memalign/free calls do not stack - this is here to ensure that
 #if !defined(NDEBUG)
 static uint32_t rsxgl_vertex_migrate_stack = 0;
 #endif
 
+// Bytes between head and tail:
+static inline uint32_t
+rsxgl_vertex_migrate_used(const uint32_t head,const uint32_t tail)
+{
+  return (tail >= head) ? (tail - head) : (rsxgl_vertex_migrate_size - head + tail);
+}
+
 static inline
 void * rsxgl_vertex_migrate_buffer()
 {
@@ -54,7 +66,21 @@ void * rsxgl_vertex_migrate_buffer()
   return _rsxgl_vertex_migrate_buffer;
 }
 
-extern int usleep(unsigned long microseconds);
+// Predicate for rsxgl_wait - true once the RSX has read enough of the buffer to make room:
+struct rsxgl_vertex_migrate_room {
+  volatile uint32_t * phead;
+  const bool wrap;
+  const uint32_t size, new_tail;
+
+  rsxgl_vertex_migrate_room(volatile uint32_t * _phead,const bool _wrap,const uint32_t _size,const uint32_t _new_tail)
+    : phead(_phead), wrap(_wrap), size(_size), new_tail(_new_tail) {}
+
+  bool operator()() const {
+    const uint32_t head = *phead;
+    return !((wrap) ? (head < size) : (head < new_tail) && (head != rsxgl_vertex_migrate_tail));
+  }
+};
+
 void *
 rsxgl_ringbuffer_migrate_memalign(gcmContextData *,const rsx_size_t align,const rsx_size_t size)
 {
@@ -86,11 +112,8 @@ rsxgl_ringbuffer_migrate_memalign(gcmContextData *,const rsx_size_t align,const
     rsxgl_assert(phead != 0);
 
     // TODO - see if an actual mutex is needed here:
-    uint32_t head = *phead;
-    while((wrap) ? (head < size) : (head < new_tail) && (head != rsxgl_vertex_migrate_tail)) {
-      usleep(RSXGL_SYNC_SLEEP_INTERVAL);
-      head = *phead;
-    }
+    rsxgl_wait(RSXGL_STALL_VERTEX_MIGRATE,rsxgl_vertex_migrate_room(phead,wrap,size,new_tail));
+    const uint32_t head = *phead;
 
     if(head == rsxgl_vertex_migrate_tail) {
       rsxgl_vertex_migrate_head = 0;
@@ -126,6 +149,9 @@ rsxgl_ringbuffer_migrate_free(gcmContextData * context,const void * ptr,const rs
   const uint32_t offset = (uint8_t *)ptr - (uint8_t *)_rsxgl_vertex_migrate_buffer + size;
 
   rsxgl_emit_sync_gpu_signal_read(context,rsxgl_vertex_migrate_sync,offset);
+
+  ++rsxgl_vertex_migrate_count;
+  rsxgl_vertex_migrate_high_water = std::max(rsxgl_vertex_migrate_high_water,rsxgl_vertex_migrate_used(rsxgl_vertex_migrate_head,rsxgl_vertex_migrate_tail));
 }
 
 void
@@ -134,9 +160,26 @@ rsxgl_ringbuffer_migrate_reset(gcmContextData * context)
   if(rsxgl_vertex_migrate_sync != 0) {
     rsxgl_vertex_migrate_head = 0;
     rsxgl_vertex_migrate_tail = 0;
+    rsxgl_vertex_migrate_count = 0;
 
     volatile uint32_t * phead = gcmGetLabelAddress(rsxgl_vertex_migrate_sync);
     rsxgl_assert(phead != 0);
     *phead = 0;
   }
 }
+
+// The RSX's progress through the buffer is read from its label, so allocated is what it has yet
+// to read:
+void
+rsxgl_ringbuffer_migrate_stats(rsxgl_memory_stats_t & stats)
+{
+  const uint32_t head = (rsxgl_vertex_migrate_sync != 0) ? *gcmGetLabelAddress(rsxgl_vertex_migrate_sync) : 0;
+  const uint32_t tail = rsxgl_vertex_migrate_tail;
+
+  stats.size = rsxgl_vertex_migrate_size;
+  stats.allocated = rsxgl_vertex_migrate_used(head,tail);
+  stats.free = stats.size - stats.allocated;
+  stats.largest_free = (tail >= head) ? std::max(stats.size - tail,head) : (head - tail);
+  stats.count = rsxgl_vertex_migrate_count;
+  stats.high_water = rsxgl_vertex_migrate_high_water;
+}
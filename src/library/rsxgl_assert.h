@@ -45,6 +45,10 @@ extern "C" {
 # define _EXFUN(N,P) N P
 #endif
 
+#ifndef _ATTRIBUTE
+# define _ATTRIBUTE(attrs) __attribute__ (attrs)
+#endif
+
 void _EXFUN(__rsxgl_assert_func, (const char *, int, const char *, const char *)
 	    _ATTRIBUTE ((__noreturn__)));
 
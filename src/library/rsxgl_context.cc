@@ -42,7 +42,7 @@ rsxgl_object_context_create()
 }
 
 rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContextData * gcm_context,struct pipe_screen * screen,struct rsxgl_object_context_t * _object_context)
-  : m_object_context(_object_context), active_texture(0), any_samples_passed_query(RSXGL_MAX_QUERY_OBJECTS), ref(0), timestamp_sync(0), next_timestamp(1), last_timestamp(0), cached_timestamp(0), m_compiler_context(0)
+  : m_object_context(_object_context), m_compiler_context(0), active_texture(0), any_samples_passed_query(RSXGL_MAX_QUERY_OBJECTS), command_list(0), ref(0), timestamp_sync(0), next_timestamp(1), last_timestamp(0), cached_timestamp(0), batch_timestamp(0), batch_timestamp_ops(0), frame(0)
 {
   base.api = EGL_OPENGL_API;
   base.config = config;
@@ -52,7 +52,6 @@ rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContex
   base.valid = 1;
   base.callback = rsxgl_context_t::egl_callback;
   base.screen = screen;
-  base.sync_sleep_interval = RSXGL_SYNC_SLEEP_INTERVAL;
 
   m_pctx = nvfx_create(screen,0);
   rsxgl_debug_printf("m_pctx: %lx\n",(unsigned long)m_pctx);
@@ -70,6 +69,8 @@ rsxgl_context_t::rsxgl_context_t(const struct rsxegl_config_t * config,gcmContex
 
 rsxgl_context_t::~rsxgl_context_t()
 {
+  rsxgl_arena_release_deferred(this);
+
   --m_object_context -> m_refCount;
   if(m_object_context -> m_refCount == 0) {
     delete m_object_context;
@@ -85,109 +86,175 @@ rsxgl_context_t::egl_callback(struct rsxegl_context_t * egl_ctx,const uint8_t op
 {
   rsxgl_context_t * ctx = (rsxgl_context_t *)egl_ctx;
 
-  if(op == RSXEGL_MAKE_CONTEXT_CURRENT || op == RSXEGL_POST_GPU_SWAP) {
+  if(op == RSXEGL_MAKE_CONTEXT_CURRENT) {
     framebuffer_t & framebuffer = ctx -> object_context() -> framebuffer_storage().at(0);
 
-    if(op == RSXEGL_MAKE_CONTEXT_CURRENT) {
-      framebuffer.attachment_types.set(RSXGL_COLOR_ATTACHMENT0,ctx -> base.draw -> color_pformat != PIPE_FORMAT_NONE ? RSXGL_ATTACHMENT_TYPE_RENDERBUFFER : RSXGL_ATTACHMENT_TYPE_NONE);
-      framebuffer.attachment_types.set(RSXGL_DEPTH_STENCIL_ATTACHMENT,ctx -> base.draw -> depth_pformat != PIPE_FORMAT_NONE ? RSXGL_ATTACHMENT_TYPE_RENDERBUFFER : RSXGL_ATTACHMENT_TYPE_NONE);
-
-      if(ctx -> state.viewport.width == 0 && ctx -> state.viewport.height == 0) {
-	ctx -> state.viewport.x = 0;
-	ctx -> state.viewport.y = 0;
-	ctx -> state.viewport.width = ctx -> base.draw -> width;
-	ctx -> state.viewport.height = ctx -> base.draw -> height;
-	ctx -> state.viewport.depthRange[0] = 0.0f;
-	ctx -> state.viewport.depthRange[1] = 1.0f;
-      }
+    framebuffer.attachment_types.set(RSXGL_COLOR_ATTACHMENT0,ctx -> base.draw -> color_pformat != PIPE_FORMAT_NONE ? RSXGL_ATTACHMENT_TYPE_RENDERBUFFER : RSXGL_ATTACHMENT_TYPE_NONE);
+    framebuffer.attachment_types.set(RSXGL_DEPTH_STENCIL_ATTACHMENT,ctx -> base.draw -> depth_pformat != PIPE_FORMAT_NONE ? RSXGL_ATTACHMENT_TYPE_RENDERBUFFER : RSXGL_ATTACHMENT_TYPE_NONE);
 
-      rsxgl_ctx = ctx;
+    if(ctx -> state.viewport.width == 0 && ctx -> state.viewport.height == 0) {
+      ctx -> state.viewport.x = 0;
+      ctx -> state.viewport.y = 0;
+      ctx -> state.viewport.width = ctx -> base.draw -> width;
+      ctx -> state.viewport.height = ctx -> base.draw -> height;
+      ctx -> state.viewport.depthRange[0] = 0.0f;
+      ctx -> state.viewport.depthRange[1] = 1.0f;
     }
 
-    //
+    // The surfaces may have changed:
     framebuffer.invalid = 1;
     framebuffer.invalid_complete = 1;
 
-    ctx -> state.invalid.all = ~0;
-    ctx -> invalid.all = ~0;
+    ctx -> invalid.parts.draw_framebuffer = 1;
+    ctx -> invalid.parts.read_framebuffer = 1;
+    ctx -> state.invalid.parts.draw_framebuffer = 1;
+
+    // If another context has been using the RSX, then none of its state can be relied upon:
+    if(rsxgl_ctx != ctx) {
+      rsxgl_ctx = ctx;
+
+      gcm_shadow_invalidate();
+
+      ctx -> state.invalid.all = ~0;
+      ctx -> invalid.all = ~0;
     
-    ctx -> invalid_attribs.set();
-    ctx -> invalid_textures.set();
-    ctx -> invalid_samplers.set();
+      ctx -> invalid_attribs.set();
+      ctx -> invalid_textures.set();
+      ctx -> invalid_samplers.set();
+    }
+  }
+  else if(op == RSXEGL_POST_GPU_SWAP) {
+    // A swap only flips the display to another color buffer; the 3D object's state is left
+    // alone, so only the default framebuffer's surface setup needs to be emitted again. Its
+    // completeness, and the depth & stencil state that depends on it, haven't changed:
+    framebuffer_t & framebuffer = ctx -> object_context() -> framebuffer_storage().at(0);
+    framebuffer.invalid = 1;
+
+    if(ctx -> framebuffer_binding.is_bound(RSXGL_DRAW_FRAMEBUFFER,0)) {
+      ctx -> invalid.parts.draw_framebuffer = 1;
+    }
+    if(ctx -> framebuffer_binding.is_bound(RSXGL_READ_FRAMEBUFFER,0)) {
+      ctx -> invalid.parts.read_framebuffer = 1;
+    }
+
+    // Once a frame, return orphaned memory that the RSX has finished with, move buffers to
+    // wherever suits the way they're being used, and chip away at fragmentation:
+    ++ctx -> frame;
+    rsxgl_arena_reclaim(ctx);
+    rsxgl_buffer_placement_update(ctx);
+    rsxgl_arena_compact(ctx);
   }
   else if(op == RSXEGL_DESTROY_CONTEXT) {
+    // Orphaned storage would otherwise never be returned to its arena:
+    rsxgl_arena_release_deferred(ctx);
+
     ctx -> base.valid = 0;
+
+    if(rsxgl_ctx == ctx) {
+      rsxgl_ctx = 0;
+    }
   }
 }
 
-uint32_t
+uint64_t
 rsxgl_timestamp_create(rsxgl_context_t * ctx,const uint32_t count)
 {
-  const uint32_t max_timestamp = RSXGL_MAX_TIMESTAMP;
+  // Timestamps are posted in order, so the batched one has to go first:
+  rsxgl_timestamp_batch_flush(ctx);
 
-  const uint32_t current_timestamp = ctx -> next_timestamp;
+  const uint64_t current_timestamp = ctx -> next_timestamp;
   rsxgl_assert(current_timestamp == (ctx -> last_timestamp + 1));
 
-  const uint32_t next_timestamp = current_timestamp + count;
+  const uint64_t next_timestamp = current_timestamp + count;
 
-  // check for overflow:
-  if(next_timestamp > max_timestamp || next_timestamp < current_timestamp) {
-    // block until last_timestamp is reached:
-    rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> last_timestamp,ctx -> base.sync_sleep_interval);
+  // The GPU's 32-bit copy of the timestamp can only be told apart from older values if it
+  // doesn't fall too far behind; this is rare, and waiting for it is cheap:
+  if((next_timestamp - ctx -> cached_timestamp) > RSXGL_MAX_TIMESTAMP_DISTANCE) {
+    rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,ctx -> last_timestamp);
 
-    // Buffers:
-    {
-      const buffer_t::name_type n = ctx -> object_context() -> buffer_storage().contents().size;
-      for(buffer_t::name_type i = 0;i < n;++i) {
-	if(!ctx -> object_context() -> buffer_storage().is_object(i)) continue;
-	ctx -> object_context() -> buffer_storage().at(i).timestamp = 0;
-      }
+    if((next_timestamp - ctx -> cached_timestamp) > RSXGL_MAX_TIMESTAMP_DISTANCE) {
+      rsxgl_timestamp_wait(ctx,ctx -> last_timestamp,RSXGL_STALL_TIMESTAMP_OVERFLOW);
     }
-    
-    // Textures:
-    {
-      const texture_t::name_type n = ctx -> object_context() -> texture_storage().contents().size;
-      for(texture_t::name_type i = 0;i < n;++i) {
-	if(!ctx -> object_context() -> texture_storage().is_object(i)) continue;
-	ctx -> object_context() -> texture_storage().at(i).timestamp = 0;
-      }
-    }
-
-    //
-    ctx -> cached_timestamp = 0;
-    ctx -> next_timestamp = 1 + count;
-    return 1;
-  }
-  //
-  else {
-    ctx -> next_timestamp = next_timestamp;
-    return current_timestamp;
   }
+
+  ctx -> next_timestamp = next_timestamp;
+  return current_timestamp;
 }
 
 void
-rsxgl_timestamp_post(rsxgl_context_t * ctx,const uint32_t timestamp)
+rsxgl_timestamp_post(rsxgl_context_t * ctx,const uint64_t timestamp)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
+  // Timestamps always go to the RSX's own command buffer, even while a command list is
+  // being recorded - objects used by the list are in use from this point onwards:
+  const bool recording = gcm_record.active;
+  gcm_record_leave(ctx -> base.gcm_context);
+
   rsxgl_emit_sync_gpu_signal_write(ctx -> base.gcm_context,ctx -> timestamp_sync,timestamp);
   ctx -> last_timestamp = timestamp;
+
+  if(recording) gcm_record_enter(ctx -> base.gcm_context);
+}
+
+// Draw calls, and other operations that the RSX performs on GL objects, share a timestamp
+// with the operations around them. It's posted after RSXGL_TIMESTAMP_BATCH_OPS operations,
+// when the command buffer is flushed, or as soon as something needs to know when it's passed:
+uint64_t
+rsxgl_timestamp_batch(rsxgl_context_t * ctx)
+{
+  if(ctx -> batch_timestamp == 0) {
+    ctx -> batch_timestamp = rsxgl_timestamp_create(ctx,1);
+    ctx -> batch_timestamp_ops = 0;
+  }
+  return ctx -> batch_timestamp;
+}
+
+// Count operations against the batched timestamp:
+void
+rsxgl_timestamp_batch_post(rsxgl_context_t * ctx,const uint32_t ops)
+{
+  rsxgl_assert(ctx -> batch_timestamp != 0);
+
+  ctx -> batch_timestamp_ops += ops;
+  if(ctx -> batch_timestamp_ops >= RSXGL_TIMESTAMP_BATCH_OPS) {
+    rsxgl_timestamp_batch_flush(ctx);
+  }
 }
 
 void
-rsxgl_timestamp_wait(rsxgl_context_t * ctx,const uint32_t timestamp)
+rsxgl_timestamp_batch_flush(rsxgl_context_t * ctx)
+{
+  if(ctx -> batch_timestamp != 0) {
+    const uint64_t timestamp = ctx -> batch_timestamp;
+    ctx -> batch_timestamp = 0;
+    ctx -> batch_timestamp_ops = 0;
+    rsxgl_timestamp_post(ctx,timestamp);
+  }
+}
+
+void
+rsxgl_timestamp_wait(rsxgl_context_t * ctx,const uint64_t timestamp,const rsxgl_stall_site site)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
+  if(timestamp > ctx -> last_timestamp) {
+    rsxgl_timestamp_batch_flush(ctx);
+  }
+
   rsxgl_gcm_flush(ctx -> gcm_context());
-  rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp,ctx -> base.sync_sleep_interval);
+  rsxgl_timestamp_wait(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp,site);
 }
 
 bool
-rsxgl_timestamp_passed(rsxgl_context_t * ctx,const uint32_t timestamp)
+rsxgl_timestamp_passed(rsxgl_context_t * ctx,const uint64_t timestamp)
 {
   rsxgl_assert(ctx -> timestamp_sync != 0);
 
+  if(timestamp > ctx -> last_timestamp) {
+    rsxgl_timestamp_batch_flush(ctx);
+  }
+
   rsxgl_gcm_flush(ctx -> gcm_context());
   return rsxgl_timestamp_passed(ctx -> cached_timestamp,ctx -> timestamp_sync,timestamp);
 }
@@ -19,11 +19,14 @@
 #include "framebuffer.h"
 #include "sync.h"
 #include "query.h"
+#include "command_list.h"
 
 #include "bit_set.h"
 
 #include "pipe/p_context.h"
 
+#include <vector>
+
 struct rsxgl_context_t {
   rsxegl_context_t base;
 
@@ -69,21 +72,39 @@ public:
   program_t::attribs_bitfield_type invalid_attrib_assignments;
   program_t::textures_bitfield_type invalid_texture_assignments;
 
+  // Command list being recorded, if any:
+  command_list_t::name_type command_list;
+
   // Used by glFinish():
   uint32_t ref;
 
   rsxgl_sync_object_index_type timestamp_sync;
 
+  // Timestamps are 64 bits wide, and never wrap around; the sync object only holds the low
+  // 32 bits, and the CPU tracks the rest (see timestamp.h).
+
   // Next timestamp to be given out when draw functions are initiated.
   // Should be initialized to 1:
-  uint32_t next_timestamp;
+  uint64_t next_timestamp;
 
   // The last timestamp that was posted to the command stream:
-  uint32_t last_timestamp;
+  uint64_t last_timestamp;
 
   // Cached copy of the current timestamp on the GPU.
   // Should be initialized to 0:
-  uint32_t cached_timestamp;
+  uint64_t cached_timestamp;
+
+  // Timestamp shared by the draw calls (and other RSX operations) issued since the last one
+  // was posted, or 0 if there aren't any; and the number of operations that are sharing it:
+  uint64_t batch_timestamp;
+  uint32_t batch_timestamp_ops;
+
+  // Memory waiting for the RSX to finish with it (see arena.h):
+  std::vector< rsxgl_deferred_free_t > deferred_frees;
+
+  // Number of buffer swaps so far, and the buffers whose placement is due to be reconsidered:
+  uint32_t frame;
+  std::vector< buffer_t::name_type > placement_queue;
 
   rsxgl_context_t(const struct rsxegl_config_t *,gcmContextData *,struct pipe_screen *,struct rsxgl_object_context_t *);
   ~rsxgl_context_t();
@@ -141,9 +162,13 @@ current_object_ctx()
   return rsxgl_ctx -> object_context();
 }
 
-uint32_t rsxgl_timestamp_create(rsxgl_context_t *,const uint32_t);
-void rsxgl_timestamp_wait(rsxgl_context_t *,const uint32_t);
-bool rsxgl_timestamp_passed(rsxgl_context_t *,const uint32_t);
-void rsxgl_timestamp_post(rsxgl_context_t *,const uint32_t);
+uint64_t rsxgl_timestamp_create(rsxgl_context_t *,const uint32_t);
+void rsxgl_timestamp_wait(rsxgl_context_t *,const uint64_t,const rsxgl_stall_site);
+bool rsxgl_timestamp_passed(rsxgl_context_t *,const uint64_t);
+void rsxgl_timestamp_post(rsxgl_context_t *,const uint64_t);
+
+uint64_t rsxgl_timestamp_batch(rsxgl_context_t *);
+void rsxgl_timestamp_batch_post(rsxgl_context_t *,const uint32_t);
+void rsxgl_timestamp_batch_flush(rsxgl_context_t *);
 
 #endif
@@ -11,6 +11,10 @@
 #define RSXGL_MEMORY_LOCATION_LOCAL 0
 #define RSXGL_MEMORY_LOCATION_MAIN 1
 
+// Large copies done by the RSX's memory-to-memory engine are split into lines of this length:
+#define RSXGL_MEMORY_COPY_LINE_LENGTH 4096
+#define RSXGL_MEMORY_COPY_MAX_LINES 2047
+
 // Limits of the hardware (Cell & RSX) go here. These shouldn't be changed:
 #define RSXGL_CACHE_LINE_SIZE 128
 #define RSXGL_CACHE_LINE_BITS 7
@@ -24,6 +28,9 @@
 #define RSXGL_MAX_TRANSFORM_FEEDBACK_SEPARATE_COMPONENTS 16
 #define RSXGL_MAX_TRANSFORM_FEEDBACK_INTERLEAVED_COMPONENTS 0
 
+// Frequency of the PPU's timebase register:
+#define RSXGL_TIMEBASE_FREQUENCY 79800000
+
 // End hardware limits
 
 // These limits are arbitrary, but they ought to correspond to the maximum value of various
@@ -33,6 +40,14 @@
 
 #define RSXGL_MAX_BUFFERS 65536
 
+// Number of separately-timestamped ranges tracked for each buffer:
+#define RSXGL_MAX_BUFFER_RANGES 16
+
+// Number of frames over which a buffer's use is observed before it may be moved, and the most
+// buffers that are moved in one frame:
+#define RSXGL_BUFFER_PLACEMENT_FRAMES 8
+#define RSXGL_BUFFER_PLACEMENT_MAX_MIGRATIONS 4
+
 #define RSXGL_MAX_VERTEX_ARRAYS 65536
 
 #define RSXGL_MAX_SHADERS 512
@@ -45,21 +60,57 @@
 #define RSXGL_MAX_FRAMEBUFFERS 65536
 
 #define RSXGL_MAX_QUERIES 65536
+#define RSXGL_MAX_FENCES 65536
 
-// For glFinish, number of iterations to wait before giving up on the GPU.
-#define RSXGL_FINISH_SLEEP_ITERATIONS 100000
+// For glFinish, microseconds to wait before giving up on the GPU (0 waits forever).
+#define RSXGL_FINISH_TIMEOUT 3000000
 
-// Time interval, in microseconds, to sleep while waiting to sync with the RSX
+// Time interval, in microseconds, to sleep while waiting for a flip to finish
 #define RSXGL_SYNC_SLEEP_INTERVAL 30
 
+// Waiting for the RSX: microseconds to spin before sleeping, and the range of intervals, in
+// microseconds, that the sleeps back off over:
+#define RSXGL_WAIT_SPIN_TIME 20
+#define RSXGL_WAIT_MIN_SLEEP 2
+#define RSXGL_WAIT_MAX_SLEEP 1000
+
+// Automatic command buffer flushing. The put register is updated once this many words
+// have been emitted since the last update; the threshold starts at RSXGL_AUTO_FLUSH_WORDS,
+// and adapts within the min & max according to whether the RSX is keeping up:
+#define RSXGL_AUTO_FLUSH_WORDS 4096
+#define RSXGL_AUTO_FLUSH_MIN_WORDS 512
+#define RSXGL_AUTO_FLUSH_MAX_WORDS 32768
+
+// Also flush after this many draw calls, or after this many microseconds have elapsed
+// since the last flush, whichever comes first:
+#define RSXGL_AUTO_FLUSH_DRAWS 64
+#define RSXGL_AUTO_FLUSH_INTERVAL 500
+
+// Maximum number of command buffer segments, and the amount of main memory that is
+// mapped each time that the pool of segments needs to grow (must be a multiple of 1MB):
+#define RSXGL_MAX_COMMAND_SEGMENTS 64
+#define RSXGL_COMMAND_SEGMENT_GROWTH_SIZE (1024 * 1024)
+#define RSXGL_MIN_COMMAND_SEGMENT_LENGTH 4096
+
+// Recorded command lists. Lists are built out of chunks of this many words, which are
+// allocated from pools of main memory mapped for the RSX (pool size must be a multiple of 1MB):
+#define RSXGL_MAX_COMMAND_LISTS 4096
+#define RSXGL_COMMAND_LIST_CHUNK_LENGTH 4096
+#define RSXGL_MAX_COMMAND_LIST_POOLS 16
+#define RSXGL_COMMAND_LIST_POOL_SIZE (1024 * 1024)
+
 #define RSXGL_VERTEX_MIGRATE_BUFFER_ALIGN 16
 #define RSXGL_VERTEX_MIGRATE_BUFFER_LOCATION 0
 
 #define RSXGL_TEXTURE_MIGRATE_BUFFER_ALIGN 1024 * 1024
 #define RSXGL_TEXTURE_MIGRATE_BUFFER_LOCATION RSXGL_MEMORY_LOCATION_LOCAL
 
-// Maximum value for a drawing timestamp. It's set this way so that GL objects
-// can have 1 bit for a deleted flag, and the remaining 31 bits for a timestamp.
-#define RSXGL_MAX_TIMESTAMP (((uint32_t)1 << 31) - 1)
+// Drawing timestamps are 64 bits wide, but the RSX only sees their low 32 bits. This is the
+// most that the timestamps handed out can get ahead of the last one known to have been
+// passed by the GPU:
+#define RSXGL_MAX_TIMESTAMP_DISTANCE ((uint32_t)1 << 30)
+
+// Number of draw calls (or other RSX operations) that can share one timestamp:
+#define RSXGL_TIMESTAMP_BATCH_OPS 32
 
 #endif
@@ -1,7 +1,5 @@
 #include "rsxgl_object_context.h"
 
-extern "C" mspace rsxgl_rsx_mspace();
-
 static void
 rsxgl_init_default_arena(void * ptr)
 {
@@ -15,7 +13,7 @@ rsxgl_init_default_arena(void * ptr)
   memory_arena_t & arena = storage -> at(0);
   
   arena.address = config.localAddress;
-  arena.space = rsxgl_rsx_mspace();
+  rsxgl_arena_init_rsx_heap(arena);
   arena.memory.location = RSXGL_MEMORY_LOCATION_LOCAL;
   arena.memory.offset = offset;
   arena.size = config.localSize;
@@ -30,6 +28,6 @@ rsxgl_init_default_framebuffer(void * ptr)
 }
 
 rsxgl_object_context_t::rsxgl_object_context_t()
-  : m_refCount(0), m_arena_storage(0,rsxgl_init_default_arena), m_attribs_storage(0,0), m_sampler_storage(0,0), m_texture_storage(0,0), m_framebuffer_storage(0,rsxgl_init_default_framebuffer)
+  : m_refCount(0), main_buffer_arena(0), m_arena_storage(0,rsxgl_init_default_arena), m_attribs_storage(0,0), m_sampler_storage(0,0), m_texture_storage(0,0), m_framebuffer_storage(0,rsxgl_init_default_framebuffer)
 {
 }
@@ -11,10 +11,14 @@
 #include "program.h"
 #include "framebuffer.h"
 #include "query.h"
+#include "command_list.h"
 
 struct rsxgl_object_context_t {
   uint32_t m_refCount;
 
+  // Main memory arena for buffers that RSXGL places there, created when it's first needed:
+  memory_arena_t::name_type main_buffer_arena;
+
   rsxgl_object_context_t();
 
   inline
@@ -67,6 +71,11 @@ struct rsxgl_object_context_t {
     return m_query_storage;
   }
 
+  inline
+  command_list_t::storage_type & command_list_storage() {
+    return m_command_list_storage;
+  }
+
 private:
 
   memory_arena_t::storage_type m_arena_storage;
@@ -79,6 +88,7 @@ private:
   renderbuffer_t::storage_type m_renderbuffer_storage;
   framebuffer_t::storage_type m_framebuffer_storage;
   query_t::storage_type m_query_storage;
+  command_list_t::storage_type m_command_list_storage;
 };
 
 #endif
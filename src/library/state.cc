@@ -222,18 +222,84 @@ nv40_blend_equation(uint32_t x)
   };
 };
 
-static inline
-void rsxgl_emit_scissor(gcmContextData * context,uint16_t x,uint16_t y,uint16_t w,uint16_t h)
+static inline uint32_t
+nv40_depth_func(uint32_t x)
 {
-  uint32_t * buffer = gcm_reserve(context,3);
+  switch(x) {
+  case RSXGL_NEVER:
+    return NV30_3D_DEPTH_FUNC_NEVER;
+  case RSXGL_LESS:
+    return NV30_3D_DEPTH_FUNC_LESS;
+  case RSXGL_EQUAL:
+    return NV30_3D_DEPTH_FUNC_EQUAL;
+  case RSXGL_LEQUAL:
+    return NV30_3D_DEPTH_FUNC_LEQUAL;
+  case RSXGL_GREATER:
+    return NV30_3D_DEPTH_FUNC_GREATER;
+  case RSXGL_NOTEQUAL:
+    return NV30_3D_DEPTH_FUNC_NOTEQUAL;
+  case RSXGL_GEQUAL:
+    return NV30_3D_DEPTH_FUNC_GEQUAL;
+  case RSXGL_ALWAYS:
+    return NV30_3D_DEPTH_FUNC_ALWAYS;
+  default:
+    rsxgl_assert(0);
+  };
+}
 
-  gcm_emit_method(&buffer,NV30_3D_SCISSOR_HORIZ,2);
-  gcm_emit(&buffer,((uint32_t)w << 16) | ((uint32_t)x));
-  gcm_emit(&buffer,((uint32_t)h << 16) | ((uint32_t)y));
+static inline uint32_t
+nv40_cull_face(uint32_t x)
+{
+  switch(x) {
+  case RSXGL_CULL_FRONT:
+    return NV30_3D_CULL_FACE_FRONT;
+  case RSXGL_CULL_BACK:
+    return NV30_3D_CULL_FACE_BACK;
+  case RSXGL_CULL_FRONT_AND_BACK:
+    return NV30_3D_CULL_FACE_FRONT_AND_BACK;
+  default:
+    rsxgl_assert(0);
+  };
+}
+
+static inline uint32_t
+nv40_polygon_mode(uint32_t x)
+{
+  switch(x) {
+  case RSXGL_POLYGON_MODE_POINT:
+    return NV30_3D_POLYGON_MODE_FRONT_POINT;
+  case RSXGL_POLYGON_MODE_LINE:
+    return NV30_3D_POLYGON_MODE_FRONT_LINE;
+  case RSXGL_POLYGON_MODE_FILL:
+    return NV30_3D_POLYGON_MODE_FRONT_FILL;
+  default:
+    rsxgl_assert(0);
+  };
+}
+
+// Emission done by rsxgl_state_validate doesn't check for space in the command buffer; the caller
+// needs to have reserved rsxgl_state_validate_words(ctx) beforehand. Every method it sends goes
+// through the shadow, so state that the RSX already has is left out:
+static inline void
+rsxgl_emit_scissor(gcmContextData * context,uint16_t x,uint16_t y,uint16_t w,uint16_t h)
+{
+  uint32_t * buffer = gcm_reserve_unchecked(context,3);
+
+  gcm_emit_shadowed2(&buffer,NV30_3D_SCISSOR_HORIZ,((uint32_t)w << 16) | ((uint32_t)x),((uint32_t)h << 16) | ((uint32_t)y));
 
   gcm_finish_commands(context,&buffer);  
 }
 
+uint32_t
+rsxgl_state_validate_words(rsxgl_context_t * ctx)
+{
+  // viewport (17), scissor (3), clear values (4), depth (4), blend (9), stencil (4 + 16), polygon (4 + 2 + 3 + 3),
+  // primitive restart (4), line width & point size (4):
+  static const uint32_t max_words = 77;
+
+  return ctx -> state.invalid.all ? max_words : 0;
+}
+
 void
 rsxgl_state_validate(rsxgl_context_t * ctx)
 {
@@ -244,41 +310,26 @@ rsxgl_state_validate(rsxgl_context_t * ctx)
   
   // viewport & depth range:
   if(s -> invalid.parts.viewport || s -> invalid.parts.depth_range) {
-    _ieee32_t scale[4] = {
-      s -> viewport.width * 0.5f,
-      s -> viewport.height * -0.5f,
-      (s -> viewport.depthRange[1] - s -> viewport.depthRange[0]) * 0.5f,
-      0.0f
+    // translate, then scale:
+    const uint32_t transform[8] = {
+      _ieee32_t(s -> viewport.x + (s -> viewport.width * 0.5f)).u,
+      _ieee32_t(s -> viewport.y + (s -> viewport.height * 0.5f)).u,
+      _ieee32_t((s -> viewport.depthRange[1] + s -> viewport.depthRange[0]) * 0.5f).u,
+      _ieee32_t(0.0f).u,
+      _ieee32_t(s -> viewport.width * 0.5f).u,
+      _ieee32_t(s -> viewport.height * -0.5f).u,
+      _ieee32_t((s -> viewport.depthRange[1] - s -> viewport.depthRange[0]) * 0.5f).u,
+      _ieee32_t(0.0f).u
     };
-    _ieee32_t offset[4] = {
-      s -> viewport.x + (s -> viewport.width * 0.5f),
-      s -> viewport.y + (s -> viewport.height * 0.5f),
-      (s -> viewport.depthRange[1] + s -> viewport.depthRange[0]) * 0.5f,
-      0.0f
-    };
-
-    buffer = gcm_reserve(context,17);
 
-    gcm_emit_method(&buffer,NV30_3D_VIEWPORT_HORIZ,2);
-    gcm_emit(&buffer,((uint32_t)s -> viewport.width << 16) | ((uint32_t)s -> viewport.x));
-    gcm_emit(&buffer,((uint32_t)s -> viewport.height << 16) | ((uint32_t)s -> viewport.y));
+    buffer = gcm_reserve_unchecked(context,17);
 
-    gcm_emit_method(&buffer,NV30_3D_DEPTH_RANGE_NEAR,2);
-    gcm_emit(&buffer,_ieee32_t(s -> viewport.depthRange[0]).u);
-    gcm_emit(&buffer,_ieee32_t(s -> viewport.depthRange[1]).u);
-
-    gcm_emit_method(&buffer,NV30_3D_VIEWPORT_TRANSLATE,8);
-    gcm_emit(&buffer,offset[0].u);
-    gcm_emit(&buffer,offset[1].u);
-    gcm_emit(&buffer,offset[2].u);
-    gcm_emit(&buffer,offset[3].u);
-    gcm_emit(&buffer,scale[0].u);
-    gcm_emit(&buffer,scale[1].u);
-    gcm_emit(&buffer,scale[2].u);
-    gcm_emit(&buffer,scale[3].u);
-
-    gcm_emit_method(&buffer,NV30_3D_DEPTH_CONTROL,1);
-    gcm_emit(&buffer,((uint32_t)s -> viewport.cullNearFar) | ((uint32_t)s -> viewport.clampZ << 4) | ((uint32_t)s -> viewport.cullIgnoreW << 8));
+    gcm_emit_shadowed2(&buffer,NV30_3D_VIEWPORT_HORIZ,
+		       ((uint32_t)s -> viewport.width << 16) | ((uint32_t)s -> viewport.x),
+		       ((uint32_t)s -> viewport.height << 16) | ((uint32_t)s -> viewport.y));
+    gcm_emit_shadowed2(&buffer,NV30_3D_DEPTH_RANGE_NEAR,_ieee32_t(s -> viewport.depthRange[0]).u,_ieee32_t(s -> viewport.depthRange[1]).u);
+    gcm_emit_shadowed(&buffer,NV30_3D_VIEWPORT_TRANSLATE,transform,8);
+    gcm_emit_shadowed1(&buffer,NV30_3D_DEPTH_CONTROL,((uint32_t)s -> viewport.cullNearFar) | ((uint32_t)s -> viewport.clampZ << 4) | ((uint32_t)s -> viewport.cullIgnoreW << 8));
 
     gcm_finish_commands(context,&buffer);
   }
@@ -295,64 +346,35 @@ rsxgl_state_validate(rsxgl_context_t * ctx)
 
   if(s -> invalid.parts.clear_color) {
     // clear color:
-    buffer = gcm_reserve(context,2);
+    buffer = gcm_reserve_unchecked(context,2);
     
-    gcm_emit_method(&buffer,NV30_3D_CLEAR_COLOR_VALUE,1);
-    gcm_emit(&buffer,s -> color.clear);
+    gcm_emit_shadowed1(&buffer,NV30_3D_CLEAR_COLOR_VALUE,s -> color.clear);
     
     gcm_finish_commands(context,&buffer);
   }
 
   if(s -> invalid.parts.clear_depth_stencil) {
     // clear color:
-    buffer = gcm_reserve(context,2);
+    buffer = gcm_reserve_unchecked(context,2);
     
-    gcm_emit_method(&buffer,NV30_3D_CLEAR_DEPTH_VALUE,1);
-    gcm_emit(&buffer,((uint32_t)s -> depth.clear << 8) | ((uint32_t)s -> stencil.clear));
+    gcm_emit_shadowed1(&buffer,NV30_3D_CLEAR_DEPTH_VALUE,((uint32_t)s -> depth.clear << 8) | ((uint32_t)s -> stencil.clear));
     
     gcm_finish_commands(context,&buffer);
   }
   
   if(s -> invalid.parts.draw_framebuffer || s -> invalid.parts.depth) {
-    buffer = gcm_reserve(context,2);
+    buffer = gcm_reserve_unchecked(context,2);
 
-    gcm_emit_method_at(buffer,0,NV30_3D_DEPTH_TEST_ENABLE,1);
-    gcm_emit_at(buffer,1,ctx -> framebuffer_binding[RSXGL_DRAW_FRAMEBUFFER].complete_write_mask.parts.depth && s -> enable.depth_test);
+    gcm_emit_shadowed1(&buffer,NV30_3D_DEPTH_TEST_ENABLE,ctx -> framebuffer_binding[RSXGL_DRAW_FRAMEBUFFER].complete_write_mask.parts.depth && s -> enable.depth_test);
 
-    gcm_finish_n_commands(context,2);
+    gcm_finish_commands(context,&buffer);
   }
 
   if(s -> invalid.parts.depth) {
     // depth-related:
-    buffer = gcm_reserve(context,2);
+    buffer = gcm_reserve_unchecked(context,2);
     
-    gcm_emit_method(&buffer,NV30_3D_DEPTH_FUNC,1);
-    switch(s -> depth.func) {
-    case RSXGL_NEVER:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_NEVER);
-      break;
-    case RSXGL_LESS:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_LESS);
-      break;
-    case RSXGL_EQUAL:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_EQUAL);
-      break;
-    case RSXGL_LEQUAL:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_LEQUAL);
-      break;
-    case RSXGL_GREATER:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_GREATER);
-      break;
-    case RSXGL_NOTEQUAL:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_NOTEQUAL);
-      break;
-    case RSXGL_GEQUAL:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_GEQUAL);
-      break;
-    case RSXGL_ALWAYS:
-      gcm_emit(&buffer,NV30_3D_DEPTH_FUNC_ALWAYS);
-      break;
-    };
+    gcm_emit_shadowed1(&buffer,NV30_3D_DEPTH_FUNC,nv40_depth_func(s -> depth.func));
     
     gcm_finish_commands(context,&buffer);
   }
@@ -360,28 +382,19 @@ rsxgl_state_validate(rsxgl_context_t * ctx)
   // blending:
   if(s -> invalid.parts.blend) {
     if(s -> enable.blend) {
-      buffer = gcm_reserve(context,9);
-      
-      gcm_emit_method(&buffer,NV30_3D_BLEND_FUNC_ENABLE,1);
-      gcm_emit(&buffer,1);
-      
-      gcm_emit_method(&buffer,NV30_3D_BLEND_COLOR,1);
-      gcm_emit(&buffer,s -> blend.color);
-      
-      gcm_emit_method(&buffer,NV30_3D_BLEND_FUNC_SRC,2);
+      buffer = gcm_reserve_unchecked(context,9);
       
-      gcm_emit(&buffer,nv40_blend_func(s -> blend.src_rgb_func) | nv40_blend_func(s -> blend.src_alpha_func) << NV30_3D_BLEND_FUNC_SRC_ALPHA__SHIFT);
-      gcm_emit(&buffer,nv40_blend_func(s -> blend.dst_rgb_func) | nv40_blend_func(s -> blend.dst_alpha_func) << NV30_3D_BLEND_FUNC_SRC_ALPHA__SHIFT);
-      
-      gcm_emit_method(&buffer,NV40_3D_BLEND_EQUATION,1);
-      
-      gcm_emit(&buffer,nv40_blend_equation(s -> blend.rgb_equation) | nv40_blend_equation(s -> blend.alpha_equation) << NV40_3D_BLEND_EQUATION_ALPHA__SHIFT);
+      gcm_emit_shadowed1(&buffer,NV30_3D_BLEND_FUNC_ENABLE,1);
+      gcm_emit_shadowed1(&buffer,NV30_3D_BLEND_COLOR,s -> blend.color);
+      gcm_emit_shadowed2(&buffer,NV30_3D_BLEND_FUNC_SRC,
+			 nv40_blend_func(s -> blend.src_rgb_func) | nv40_blend_func(s -> blend.src_alpha_func) << NV30_3D_BLEND_FUNC_SRC_ALPHA__SHIFT,
+			 nv40_blend_func(s -> blend.dst_rgb_func) | nv40_blend_func(s -> blend.dst_alpha_func) << NV30_3D_BLEND_FUNC_SRC_ALPHA__SHIFT);
+      gcm_emit_shadowed1(&buffer,NV40_3D_BLEND_EQUATION,nv40_blend_equation(s -> blend.rgb_equation) | nv40_blend_equation(s -> blend.alpha_equation) << NV40_3D_BLEND_EQUATION_ALPHA__SHIFT);
     }
     else {
-      buffer = gcm_reserve(context,2);
+      buffer = gcm_reserve_unchecked(context,2);
       
-      gcm_emit_method(&buffer,NV30_3D_BLEND_FUNC_ENABLE,1);
-      gcm_emit(&buffer,0);
+      gcm_emit_shadowed1(&buffer,NV30_3D_BLEND_FUNC_ENABLE,0);
     }
     
     gcm_finish_commands(context,&buffer);
@@ -391,31 +404,32 @@ rsxgl_state_validate(rsxgl_context_t * ctx)
   if(s -> invalid.parts.draw_framebuffer || s -> invalid.parts.stencil) {
     const bool framebuffer_stencil = ctx -> framebuffer_binding[RSXGL_DRAW_FRAMEBUFFER].complete_write_mask.parts.stencil;
 
-    buffer = gcm_reserve(context,4);
+    buffer = gcm_reserve_unchecked(context,4);
 
-    gcm_emit_method_at(buffer,0,NV30_3D_STENCIL_ENABLE(0),1);
-    gcm_emit_at(buffer,1,framebuffer_stencil && s -> stencil.face[0].enable);
-    gcm_emit_method_at(buffer,2,NV30_3D_STENCIL_ENABLE(1),1);
-    gcm_emit_at(buffer,3,framebuffer_stencil && s -> stencil.face[1].enable);
+    gcm_emit_shadowed1(&buffer,NV30_3D_STENCIL_ENABLE(0),framebuffer_stencil && s -> stencil.face[0].enable);
+    gcm_emit_shadowed1(&buffer,NV30_3D_STENCIL_ENABLE(1),framebuffer_stencil && s -> stencil.face[1].enable);
 
-    gcm_finish_n_commands(context,4);
+    gcm_finish_commands(context,&buffer);
   }
 
   if(s -> invalid.parts.stencil) {
     for(int f = 0;f < 2;++f) {
       if(s -> stencil.face[f].enable) {
-	buffer = gcm_reserve(context,8);
+	const uint32_t values[7] = {
+	  s -> stencil.face[f].writemask,
+	  s -> stencil.face[f].func,
+	  s -> stencil.face[f].ref,
+	  s -> stencil.face[f].mask,
+	  s -> stencil.face[f].fail_op,
+	  s -> stencil.face[f].zfail_op,
+	  s -> stencil.face[f].pass_op
+	};
+
+	buffer = gcm_reserve_unchecked(context,8);
 	
-	gcm_emit_method_at(buffer,0,NV30_3D_STENCIL_MASK(f),7);
-	gcm_emit_at(buffer,1,s -> stencil.face[f].writemask);
-	gcm_emit_at(buffer,2,s -> stencil.face[f].func);
-	gcm_emit_at(buffer,3,s -> stencil.face[f].ref);
-	gcm_emit_at(buffer,4,s -> stencil.face[f].mask);
-	gcm_emit_at(buffer,5,s -> stencil.face[f].fail_op);
-	gcm_emit_at(buffer,6,s -> stencil.face[f].zfail_op);
-	gcm_emit_at(buffer,7,s -> stencil.face[f].pass_op);
-
-	gcm_finish_n_commands(context,8);
+	gcm_emit_shadowed(&buffer,NV30_3D_STENCIL_MASK(f),values,7);
+
+	gcm_finish_commands(context,&buffer);
       }
     }
   }
@@ -423,31 +437,17 @@ rsxgl_state_validate(rsxgl_context_t * ctx)
   // polygon culling:
   if(s -> invalid.parts.polygon_cull) {
     if(s -> polygon.cullEnable) {
-      buffer = gcm_reserve(context,4);
-      
-      gcm_emit_method(&buffer,NV30_3D_CULL_FACE_ENABLE,1);
-      gcm_emit(&buffer,1);
+      buffer = gcm_reserve_unchecked(context,4);
       
-      gcm_emit_method(&buffer,NV30_3D_CULL_FACE,1);
-      switch(s -> polygon.cullFace) {
-      case RSXGL_CULL_FRONT:
-	gcm_emit(&buffer,NV30_3D_CULL_FACE_FRONT);
-	break;
-      case RSXGL_CULL_BACK:
-	gcm_emit(&buffer,NV30_3D_CULL_FACE_BACK);
-	break;
-      case RSXGL_CULL_FRONT_AND_BACK:
-	gcm_emit(&buffer,NV30_3D_CULL_FACE_FRONT_AND_BACK);
-	break;
-      };
+      gcm_emit_shadowed1(&buffer,NV30_3D_CULL_FACE_ENABLE,1);
+      gcm_emit_shadowed1(&buffer,NV30_3D_CULL_FACE,nv40_cull_face(s -> polygon.cullFace));
       
       gcm_finish_commands(context,&buffer);
     }
     else {
-      buffer = gcm_reserve(context,2);
+      buffer = gcm_reserve_unchecked(context,2);
       
-      gcm_emit_method(&buffer,NV30_3D_CULL_FACE_ENABLE,1);
-      gcm_emit(&buffer,0);
+      gcm_emit_shadowed1(&buffer,NV30_3D_CULL_FACE_ENABLE,0);
       
       gcm_finish_commands(context,&buffer);
     }
@@ -457,100 +457,67 @@ rsxgl_state_validate(rsxgl_context_t * ctx)
   //
   // polygon winding mode:
   if(s -> invalid.parts.polygon_winding_mode) {
-    buffer = gcm_reserve(context,2);
+    buffer = gcm_reserve_unchecked(context,2);
       
-    gcm_emit_method_at(buffer,0,NV30_3D_FRONT_FACE,1);
-    gcm_emit_at(buffer,1,s -> polygon.frontFace == RSXGL_FACE_CW ? NV30_3D_FRONT_FACE_CW : NV30_3D_FRONT_FACE_CCW);
+    gcm_emit_shadowed1(&buffer,NV30_3D_FRONT_FACE,s -> polygon.frontFace == RSXGL_FACE_CW ? NV30_3D_FRONT_FACE_CW : NV30_3D_FRONT_FACE_CCW);
     
     gcm_finish_commands(context,&buffer);
   }
     
     // polygon fill mode:
   if(s -> invalid.parts.polygon_fill_mode) {
-    buffer = gcm_reserve(context,3);
+    buffer = gcm_reserve_unchecked(context,3);
     
-    gcm_emit_method_at(buffer,0,NV30_3D_POLYGON_MODE_FRONT,2);
-    
-    switch(s -> polygon.frontMode) {
-    case RSXGL_POLYGON_MODE_POINT:
-      gcm_emit_at(buffer,1,NV30_3D_POLYGON_MODE_FRONT_POINT);
-      break;
-    case RSXGL_POLYGON_MODE_LINE:
-      gcm_emit_at(buffer,1,NV30_3D_POLYGON_MODE_FRONT_LINE);
-      break;
-    case RSXGL_POLYGON_MODE_FILL:
-      gcm_emit_at(buffer,1,NV30_3D_POLYGON_MODE_FRONT_FILL);
-      break;
-    };
+    gcm_emit_shadowed2(&buffer,NV30_3D_POLYGON_MODE_FRONT,nv40_polygon_mode(s -> polygon.frontMode),nv40_polygon_mode(s -> polygon.backMode));
     
-    switch(s -> polygon.backMode) {
-    case RSXGL_POLYGON_MODE_POINT:
-      gcm_emit_at(buffer,2,NV30_3D_POLYGON_MODE_FRONT_POINT);
-      break;
-    case RSXGL_POLYGON_MODE_LINE:
-      gcm_emit_at(buffer,2,NV30_3D_POLYGON_MODE_FRONT_LINE);
-      break;
-    case RSXGL_POLYGON_MODE_FILL:
-      gcm_emit_at(buffer,2,NV30_3D_POLYGON_MODE_FRONT_FILL);
-      break;
-    };
-    
-    gcm_finish_n_commands(context,3);
+    gcm_finish_commands(context,&buffer);
   }
     
   // polygon offset:
   if(s -> invalid.parts.polygon_offset) {
-    buffer = gcm_reserve(context,3);
+    buffer = gcm_reserve_unchecked(context,3);
     
-    gcm_emit_method_at(buffer,0,NV30_3D_POLYGON_OFFSET_FACTOR,2);
-    gcm_emit_at(buffer,1,_ieee32_t(s -> polygon.offsetFactor).u);
-    gcm_emit_at(buffer,2,_ieee32_t(s -> polygon.offsetUnits).u);
+    gcm_emit_shadowed2(&buffer,NV30_3D_POLYGON_OFFSET_FACTOR,_ieee32_t(s -> polygon.offsetFactor).u,_ieee32_t(s -> polygon.offsetUnits).u);
     
-    gcm_finish_n_commands(context,3);
+    gcm_finish_commands(context,&buffer);
   }
   
   // primitive restart:
   if(s -> invalid.parts.primitive_restart) {
     if(s -> enable.primitive_restart) {
-      buffer = gcm_reserve(context,4);
-      
-      gcm_emit_method_at(buffer,0,0x1dac,1);
-      gcm_emit_at(buffer,1,1);
+      buffer = gcm_reserve_unchecked(context,4);
       
-      gcm_emit_method_at(buffer,2,0x1db0,1);
-      gcm_emit_at(buffer,3,s -> primitiveRestartIndex);
+      gcm_emit_shadowed1(&buffer,0x1dac,1);
+      gcm_emit_shadowed1(&buffer,0x1db0,s -> primitiveRestartIndex);
       
-      gcm_finish_n_commands(context,4);
+      gcm_finish_commands(context,&buffer);
     }
     else {
-      buffer = gcm_reserve(context,2);
-      gcm_emit_method_at(buffer,0,0x1dac,1);
-      gcm_emit_at(buffer,1,0);
-      gcm_finish_n_commands(context,2);
+      buffer = gcm_reserve_unchecked(context,2);
+      gcm_emit_shadowed1(&buffer,0x1dac,0);
+      gcm_finish_commands(context,&buffer);
     }
   }
   
   // line width
   if(s -> invalid.parts.line_width) {
-    buffer = gcm_reserve(context,2);
+    buffer = gcm_reserve_unchecked(context,2);
     
     // fixed-point:
     const uint32_t lineWidth = (uint32_t)(s -> lineWidth * (1 << 3)) & ((1 << 9) - 1);
     
-    gcm_emit_method_at(buffer,0,NV30_3D_LINE_WIDTH,1);
-    gcm_emit_at(buffer,1,lineWidth);
+    gcm_emit_shadowed1(&buffer,NV30_3D_LINE_WIDTH,lineWidth);
     
-    gcm_finish_n_commands(context,2);
+    gcm_finish_commands(context,&buffer);
   }
     
   // point size
   if(s -> invalid.parts.point_size) {
-    buffer = gcm_reserve(context,2);
+    buffer = gcm_reserve_unchecked(context,2);
     
-    gcm_emit_method_at(buffer,0,NV30_3D_POINT_SIZE,1);
-    gcm_emit_at(buffer,1,_ieee32_t(s -> pointSize).u);
+    gcm_emit_shadowed1(&buffer,NV30_3D_POINT_SIZE,_ieee32_t(s -> pointSize).u);
     
-    gcm_finish_n_commands(context,2);
+    gcm_finish_commands(context,&buffer);
   }
 
   s -> invalid.all = 0;
@@ -163,6 +163,7 @@ struct state_t {
 
 struct rsxgl_context_t;
 
+uint32_t rsxgl_state_validate_words(rsxgl_context_t *);
 void rsxgl_state_validate(rsxgl_context_t *);
 
 #endif
@@ -14,8 +14,10 @@
 #include "attribs.h"
 #include "uniforms.h"
 #include "gl_object.h"
+#include "timestamp.h"
 
 #include <GL3/gl3.h>
+#include "GL3/rsxgl3ext.h"
 #include "error.h"
 
 #if defined(GLAPI)
@@ -26,6 +28,8 @@
 static inline void
 rsxgl_flush(rsxgl_context_t * ctx)
 {
+  // Post the timestamp that draw calls have been sharing, so that the RSX gets to it:
+  rsxgl_timestamp_batch_flush(ctx);
   rsxgl_gcm_flush(ctx -> gcm_context());
 }
 
@@ -37,7 +41,18 @@ glFlush (void)
   RSXGL_NOERROR_();
 }
 
-extern int usleep(unsigned long microseconds);
+// Predicate for rsxgl_wait - true once the RSX has set its reference register to some value:
+struct rsxgl_wait_ref_equal {
+  gcmControlRegister volatile * control;
+  const uint32_t ref;
+
+  rsxgl_wait_ref_equal(gcmControlRegister volatile * _control,const uint32_t _ref) : control(_control), ref(_ref) {}
+
+  bool operator()() const {
+    return control -> ref == ref;
+  }
+};
+
 GLAPI void APIENTRY
 glFinish (void)
 {
@@ -52,26 +67,59 @@ glFinish (void)
 
   __sync();
 
-  const useconds_t timeout = RSXGL_SYNC_SLEEP_INTERVAL * RSXGL_FINISH_SLEEP_ITERATIONS;
-  const useconds_t timeout_interval = ctx -> base.sync_sleep_interval;
+  // Wait some interval for the GPU to finish, or forever if RSXGL_FINISH_TIMEOUT is 0:
+  rsxgl_wait(RSXGL_STALL_FINISH,rsxgl_wait_ref_equal(control,ref),(RSXGL_FINISH_TIMEOUT > 0) ? rsxgl_wait_ticks(RSXGL_FINISH_TIMEOUT) : rsxgl_wait_forever);
 
-  // Wait some interval for the GPU to finish:
-  if(timeout > 0) {
-    useconds_t remaining_timeout = timeout;
-    while(control -> ref != ref && remaining_timeout > 0) {
-      if(timeout_interval > 0) {
-	usleep(timeout_interval);
-	remaining_timeout -= timeout_interval;
-      }
-    }
+  RSXGL_NOERROR_();
+}
+
+// Stall accounting for rsxgl_wait:
+rsxgl_stall_stats_t rsxgl_stall_stats[RSXGL_MAX_STALL_SITES];
+
+GLAPI void APIENTRY
+glGetStallStatsui64vRSX(GLenum site,GLenum pname,GLuint64 * params)
+{
+  if(site > GL_STALL_ALL_RSX) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
   }
-  // Wait forever:
-  else {
-    while(control -> ref != ref) {
-      if(timeout_interval > 0) {
-	usleep(timeout_interval);
-      }
-    }
+
+  if(pname > GL_STALL_MAX_TIME_RSX) {
+    RSXGL_ERROR_(GL_INVALID_ENUM);
+  }
+
+  // GL_STALL_ALL_RSX sums every site (and takes the maximum of their maximums):
+  const size_t first = (site == GL_STALL_ALL_RSX) ? 0 : site, last = (site == GL_STALL_ALL_RSX) ? RSXGL_MAX_STALL_SITES : site + 1;
+
+  uint64_t count = 0, ticks = 0, max_ticks = 0;
+  for(size_t i = first;i < last;++i) {
+    count += rsxgl_stall_stats[i].count;
+    ticks += rsxgl_stall_stats[i].ticks;
+    max_ticks = std::max(max_ticks,rsxgl_stall_stats[i].max_ticks);
+  }
+
+  // Times are reported in nanoseconds:
+  static const uint64_t ticks_per_us = RSXGL_TIMEBASE_FREQUENCY / 1000000;
+
+  if(pname == GL_STALL_COUNT_RSX) {
+    *params = count;
+  }
+  else if(pname == GL_STALL_TIME_RSX) {
+    *params = (ticks * 1000) / ticks_per_us;
+  }
+  else if(pname == GL_STALL_MAX_TIME_RSX) {
+    *params = (max_ticks * 1000) / ticks_per_us;
+  }
+
+  RSXGL_NOERROR_();
+}
+
+GLAPI void APIENTRY
+glResetStallStatsRSX(void)
+{
+  for(size_t i = 0;i < RSXGL_MAX_STALL_SITES;++i) {
+    rsxgl_stall_stats[i].count = 0;
+    rsxgl_stall_stats[i].ticks = 0;
+    rsxgl_stall_stats[i].max_ticks = 0;
   }
 
   RSXGL_NOERROR_();
@@ -111,37 +159,69 @@ rsxgl_sync_object_free(const rsxgl_sync_object_index_type index)
 // Sync objects are not considered true "GL objects," but they do require library-generated names.
 // So we re-use that capability from gl_object<>. But since they can't be bound or orphaned, etc.,
 // this class does not use the CRTP the way that other GL objects do.
+//
+// A fence is a point on the timestamp timeline of the context that created it; it's signaled once
+// the RSX has passed its timestamp. Fences don't use up any of the RSX's semaphores, so there's no
+// limit on how many of them can be outstanding, other than RSXGL_MAX_FENCES. The GLsync handed back
+// to the application is the fence's name.
+//
+// Fences are shared between contexts, but each context has a timeline of its own, so a fence
+// remembers which sync object its timestamp is written to. It also keeps its own cached copy of
+// that timeline, for contexts other than its creator to extend the sync object's value against.
 struct rsxgl_sync_object_t {
-  typedef gl_object< rsxgl_sync_object_t, RSXGL_MAX_SYNC_OBJECTS > gl_object_type;
+  typedef gl_object< rsxgl_sync_object_t, RSXGL_MAX_FENCES > gl_object_type;
   typedef typename gl_object_type::name_type name_type;
   typedef typename gl_object_type::storage_type storage_type;
 
   static storage_type & storage();
 
-  name_type name;
-  rsxgl_sync_object_index_type index;
-  uint32_t status:1, value:31;
+  uint32_t status;
+  uint64_t timestamp;
+
+  rsxgl_sync_object_index_type timestamp_sync;
+  uint64_t cached_timestamp;
 
   rsxgl_sync_object_t()
-    : name(0), index(RSXGL_MAX_SYNC_OBJECTS), status(0), value(0) {
+    : status(0), timestamp(0), timestamp_sync(0), cached_timestamp(0) {
   }
 };
 
 rsxgl_sync_object_t::storage_type &
 rsxgl_sync_object_t::storage()
 {
-  static rsxgl_sync_object_t::storage_type _storage(RSXGL_MAX_SYNC_OBJECTS);
+  static rsxgl_sync_object_t::storage_type _storage;
   return _storage;
 }
 
-static const uint32_t rsxgl_sync_token_max = (1 << 23);
-static const uint32_t RSXGL_SYNC_UNSIGNALED_TOKEN = (1 << 24);
-static uint32_t _rsxgl_sync_token = 0;
+static inline bool
+rsxgl_sync_is_object(GLsync sync)
+{
+  const uintptr_t name = (uintptr_t)sync;
+  return (name != 0) && (name < RSXGL_MAX_FENCES) && rsxgl_sync_object_t::storage().is_object(name);
+}
+
+static inline rsxgl_sync_object_t &
+rsxgl_sync_object(GLsync sync)
+{
+  return rsxgl_sync_object_t::storage().at((uintptr_t)sync);
+}
 
-static uint32_t
-rsxgl_sync_token()
+// The cached timestamp to check a fence against - the context's own, if it created the fence,
+// since that's the most up to date:
+static inline uint64_t &
+rsxgl_sync_cached_timestamp(rsxgl_context_t * ctx,rsxgl_sync_object_t & sync_object)
 {
-  return (_rsxgl_sync_token = (_rsxgl_sync_token + 1) & rsxgl_sync_token_max);
+  return (sync_object.timestamp_sync == ctx -> timestamp_sync) ? ctx -> cached_timestamp : sync_object.cached_timestamp;
+}
+
+// See if a fence has been passed, without flushing or waiting:
+static inline bool
+rsxgl_sync_passed(rsxgl_context_t * ctx,rsxgl_sync_object_t & sync_object)
+{
+  if(!sync_object.status && rsxgl_timestamp_passed(rsxgl_sync_cached_timestamp(ctx,sync_object),sync_object.timestamp_sync,sync_object.timestamp)) {
+    sync_object.status = 1;
+  }
+  return sync_object.status;
 }
 
 GLAPI GLsync APIENTRY
@@ -155,54 +235,46 @@ glFenceSync (GLenum condition, GLbitfield flags)
     RSXGL_ERROR(GL_INVALID_VALUE,0);
   }
 
-  const rsxgl_sync_object_t::name_type name = rsxgl_sync_object_t::storage().create_name_and_object();
+  rsxgl_context_t * ctx = current_ctx();
 
-  const rsxgl_sync_object_index_type index = rsxgl_sync_object_allocate();
-  const uint32_t token = rsxgl_sync_token();
+  const rsxgl_sync_object_t::name_type name = rsxgl_sync_object_t::storage().create_name_and_object();
+  rsxgl_sync_object_t & sync_object = rsxgl_sync_object_t::storage().at(name);
 
-  if(index != RSXGL_MAX_SYNC_OBJECTS) {
-    rsxgl_sync_object_t * sync_object = &rsxgl_sync_object_t::storage().at(name);
-    sync_object -> name = name;
-    sync_object -> status = 0;
-    sync_object -> index = index;
-    sync_object -> value = token;
-  
-    rsxgl_sync_cpu_signal(index,RSXGL_SYNC_UNSIGNALED_TOKEN);
-    rsxgl_emit_sync_gpu_signal_read(current_ctx() -> base.gcm_context,sync_object -> index,token);
+  sync_object.status = 0;
+  sync_object.timestamp = rsxgl_timestamp_create(ctx,1);
+  sync_object.timestamp_sync = ctx -> timestamp_sync;
+  sync_object.cached_timestamp = ctx -> cached_timestamp;
+  rsxgl_timestamp_post(ctx,sync_object.timestamp);
 
-    RSXGL_NOERROR((GLsync)sync_object);
-  }
-  else {
-    RSXGL_ERROR(GL_OUT_OF_MEMORY,0);
-  }
+  RSXGL_NOERROR((GLsync)(uintptr_t)name);
 }
 
 GLAPI GLboolean APIENTRY
 glIsSync (GLsync sync)
 {
-  return (sync != 0) && (rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name));
+  return rsxgl_sync_is_object(sync);
 }
 
 GLAPI void APIENTRY
 glDeleteSync (GLsync sync)
 {
-  if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
-    RSXGL_ERROR_(GL_INVALID_VALUE);
+  if(sync == 0) {
+    RSXGL_NOERROR_();
   }
 
-  rsxgl_sync_object_t * sync_object = reinterpret_cast< rsxgl_sync_object_t * >(sync);
-
-  if(sync_object -> index != RSXGL_MAX_SYNC_OBJECTS) {
-    rsxgl_sync_object_free(sync_object -> index);
+  if(!rsxgl_sync_is_object(sync)) {
+    RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  rsxgl_sync_object_t::storage().destroy(sync_object -> name);
+  rsxgl_sync_object_t::storage().destroy((uintptr_t)sync);
+
+  RSXGL_NOERROR_();
 }
 
 GLAPI GLenum APIENTRY
 glClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 {
-  if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
+  if(!rsxgl_sync_is_object(sync)) {
     RSXGL_ERROR(GL_INVALID_VALUE,GL_WAIT_FAILED);
   }
 
@@ -213,25 +285,30 @@ glClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 
   rsxgl_context_t * ctx = current_ctx();
 
-  rsxgl_sync_object_t * sync_object = reinterpret_cast< rsxgl_sync_object_t * >(sync);
+  rsxgl_sync_object_t & sync_object = rsxgl_sync_object(sync);
 
   // Flush it all:
   if(flags & GL_SYNC_FLUSH_COMMANDS_BIT) {
     rsxgl_flush(ctx);
   }
 
-  // Maybe it's already been set?
-  if(sync_object -> status) {
+  // Maybe it's already been passed?
+  if(rsxgl_sync_passed(ctx,sync_object)) {
     RSXGL_NOERROR(GL_ALREADY_SIGNALED);
   }
 
-  // timeout is nanoseconds - convert to microseconds:
-  const useconds_t timeout_usec = timeout / 1000;
+  // A timeout of 0 only polls:
+  if(timeout == 0) {
+    RSXGL_NOERROR(GL_TIMEOUT_EXPIRED);
+  }
 
-  const int result = rsxgl_sync_cpu_wait(sync_object -> index,sync_object -> value,timeout_usec,RSXGL_SYNC_SLEEP_INTERVAL);
+  // timeout is nanoseconds - convert to time base ticks, rounding up. Timeouts too long to
+  // represent are as good as forever:
+  static const uint64_t max_timeout = rsxgl_wait_forever / ((uint64_t)RSXGL_TIMEBASE_FREQUENCY / 1000000) * 1000;
+  const uint64_t timeout_ticks = (timeout < max_timeout) ? rsxgl_wait_ticks((timeout + 999) / 1000) : rsxgl_wait_forever;
 
-  if(result) {
-    sync_object -> status = 1;
+  if(rsxgl_timestamp_wait(rsxgl_sync_cached_timestamp(ctx,sync_object),sync_object.timestamp_sync,sync_object.timestamp,RSXGL_STALL_CLIENT_WAIT_SYNC,timeout_ticks)) {
+    sync_object.status = 1;
     RSXGL_NOERROR(GL_CONDITION_SATISFIED);
   }
   else {
@@ -242,7 +319,7 @@ glClientWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 GLAPI void APIENTRY
 glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 {
-  if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
+  if(!rsxgl_sync_is_object(sync)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
@@ -250,7 +327,28 @@ glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
-  // TODO - Do something here. Not sure what.
+  rsxgl_context_t * ctx = current_ctx();
+
+  rsxgl_sync_object_t & sync_object = rsxgl_sync_object(sync);
+
+  // The RSX waits on its own, so the CPU is free to carry on. Its semaphore acquire only
+  // tests for equality, and the timestamp sync object may have moved past the fence's value
+  // by the time the acquire is reached; so wait instead for a new timestamp, which nothing
+  // after the acquire can move past. This also waits for anything posted after the fence:
+  if(!rsxgl_sync_passed(ctx,sync_object)) {
+    if(sync_object.timestamp_sync == ctx -> timestamp_sync) {
+      const uint64_t timestamp = rsxgl_timestamp_create(ctx,1);
+      rsxgl_timestamp_post(ctx,timestamp);
+      rsxgl_sync_gpu_wait(ctx -> gcm_context(),ctx -> timestamp_sync,(uint32_t)timestamp);
+    }
+    // This context can't post to another one's timeline, so the CPU has to wait for that:
+    else {
+      rsxgl_flush(ctx);
+      if(rsxgl_timestamp_wait(sync_object.cached_timestamp,sync_object.timestamp_sync,sync_object.timestamp,RSXGL_STALL_CLIENT_WAIT_SYNC)) {
+	sync_object.status = 1;
+      }
+    }
+  }
 
   RSXGL_NOERROR_();
 }
@@ -258,7 +356,7 @@ glWaitSync (GLsync sync, GLbitfield flags, GLuint64 timeout)
 GLAPI void APIENTRY
 glGetSynciv (GLsync sync, GLenum pname, GLsizei bufSize, GLsizei *length, GLint *values)
 {
-  if(sync == 0 || !rsxgl_sync_object_t::storage().is_object(reinterpret_cast< rsxgl_sync_object_t * >(sync) -> name)) {
+  if(!rsxgl_sync_is_object(sync)) {
     RSXGL_ERROR_(GL_INVALID_VALUE);
   }
 
@@ -267,13 +365,13 @@ glGetSynciv (GLsync sync, GLenum pname, GLsizei bufSize, GLsizei *length, GLint
     RSXGL_NOERROR_();
   }
 
-  rsxgl_sync_object_t * sync_object = reinterpret_cast< rsxgl_sync_object_t * >(sync);
+  rsxgl_sync_object_t & sync_object = rsxgl_sync_object(sync);
 
   if(pname == GL_OBJECT_TYPE) {
     *values = GL_SYNC_FENCE;
   }
   else if(pname == GL_SYNC_STATUS) {
-    *values = (sync_object -> status) ? GL_SIGNALED : GL_UNSIGNALED;
+    *values = rsxgl_sync_passed(current_ctx(),sync_object) ? GL_SIGNALED : GL_UNSIGNALED;
   }
   else if(pname == GL_SYNC_CONDITION) {
     *values = GL_SYNC_GPU_COMMANDS_COMPLETE;
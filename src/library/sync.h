@@ -36,12 +36,147 @@ rsxgl_gcm_flush(gcmContextData * context)
   uint32_t offset;
   gcmControlRegister volatile *control = gcmGetControlRegister();
 
+#if RSXGL_CONFIG_fifo_capture
+  gcm_capture(gcm_live_current(context));
+#endif
+
   __sync();
   
-  gcmAddressToOffset(context -> current, &offset);
+  gcmAddressToOffset(gcm_live_current(context), &offset);
   control->put = offset;
+
+  gcm_autoflush_reset(context);
+}
+
+// Called after each draw call; flushes if enough draws have been issued, or enough time
+// has passed, since the last flush:
+static inline void
+rsxgl_gcm_autoflush_draw(gcmContextData * context)
+{
+  static const uint64_t interval = ((uint64_t)RSXGL_TIMEBASE_FREQUENCY / 1000000) * RSXGL_AUTO_FLUSH_INTERVAL;
+
+  if(gcm_autoflush.suspended) return;
+
+  if(++gcm_autoflush.draws >= RSXGL_AUTO_FLUSH_DRAWS || (__mftb() - gcm_autoflush.time) >= interval) {
+    rsxgl_gcm_flush(context);
+  }
+}
+
+// Waiting for the RSX. Most waits are short, so the CPU spins on whatever it's waiting for at
+// first; if that goes on for more than RSXGL_WAIT_SPIN_TIME, it sleeps for intervals that double
+// from RSXGL_WAIT_MIN_SLEEP up to RSXGL_WAIT_MAX_SLEEP. Every wait that doesn't succeed straight
+// away is counted, and timed, against the operation that had to wait; glGetStallStatsui64vRSX
+// reports these.
+enum rsxgl_stall_site {
+  RSXGL_STALL_FINISH = 0,
+  RSXGL_STALL_CLIENT_WAIT_SYNC,
+  RSXGL_STALL_BUFFER_DELETE,
+  RSXGL_STALL_BUFFER_DATA,
+  RSXGL_STALL_BUFFER_SUBDATA,
+  RSXGL_STALL_BUFFER_MAP,
+  RSXGL_STALL_TEXTURE_DELETE,
+  RSXGL_STALL_TEXTURE_STORAGE,
+  RSXGL_STALL_TEXTURE_SUBIMAGE,
+  RSXGL_STALL_RENDERBUFFER_DELETE,
+  RSXGL_STALL_RENDERBUFFER_STORAGE,
+  RSXGL_STALL_PROGRAM_DELETE,
+  RSXGL_STALL_PROGRAM_LINK,
+  RSXGL_STALL_QUERY_RESULT,
+  RSXGL_STALL_COMMAND_LIST,
+  RSXGL_STALL_TIMESTAMP_OVERFLOW,
+  RSXGL_STALL_COMMAND_BUFFER,
+  RSXGL_STALL_VERTEX_MIGRATE,
+  // glDeleteSync no longer waits for the RSX, since fences became timestamps; the site is kept
+  // so that the sites after it keep their values:
+  RSXGL_STALL_SYNC_DELETE,
+  RSXGL_STALL_BUFFER_READBACK,
+  RSXGL_MAX_STALL_SITES
+};
+
+struct rsxgl_stall_stats_t {
+  // Time is in time base ticks:
+  uint64_t count, ticks, max_ticks;
+};
+
+extern rsxgl_stall_stats_t rsxgl_stall_stats[RSXGL_MAX_STALL_SITES];
+
+#if !defined(RSXGL_HOSTGCM)
+extern int usleep(unsigned long microseconds);
+#endif
+
+static const uint64_t rsxgl_wait_forever = ~(uint64_t)0;
+
+static inline uint64_t
+rsxgl_wait_ticks(const uint64_t usec)
+{
+  return ((uint64_t)RSXGL_TIMEBASE_FREQUENCY / 1000000) * usec;
+}
+
+// Wait until predicate() returns true, or until timeout time base ticks have passed. Returns
+// the last value returned by predicate():
+template< typename Predicate >
+static inline bool
+rsxgl_wait(const rsxgl_stall_site site,const Predicate & predicate,const uint64_t timeout = rsxgl_wait_forever)
+{
+  if(predicate()) return true;
+
+  // A zero timeout only polls, which doesn't hold anything up, so it isn't counted as a stall:
+  if(timeout == 0) return false;
+
+  static const uint64_t ticks_per_us = (uint64_t)RSXGL_TIMEBASE_FREQUENCY / 1000000;
+  static const uint64_t spin_ticks = ticks_per_us * RSXGL_WAIT_SPIN_TIME;
+
+  const uint64_t start = __mftb();
+  uint64_t elapsed = 0;
+  useconds_t interval = RSXGL_WAIT_MIN_SLEEP;
+  bool result = false;
+
+  while(!(result = predicate())) {
+    elapsed = __mftb() - start;
+    if(elapsed >= timeout) break;
+
+    if(elapsed >= spin_ticks) {
+      // Don't sleep past the timeout:
+      const uint64_t remaining = (timeout - elapsed) / ticks_per_us;
+      usleep((remaining < interval) ? (useconds_t)remaining + 1 : interval);
+      interval = std::min(interval * 2,(useconds_t)RSXGL_WAIT_MAX_SLEEP);
+    }
+  }
+
+  elapsed = __mftb() - start;
+
+  rsxgl_stall_stats_t & stats = rsxgl_stall_stats[site];
+  ++stats.count;
+  stats.ticks += elapsed;
+  stats.max_ticks = std::max(stats.max_ticks,elapsed);
+
+  return result;
 }
 
+// Predicates for rsxgl_wait:
+struct rsxgl_wait_label_equal {
+  volatile uint32_t * label;
+  const uint32_t value;
+
+  rsxgl_wait_label_equal(volatile uint32_t * _label,const uint32_t _value) : label(_label), value(_value) {}
+
+  bool operator()() const {
+    return *label == value;
+  }
+};
+
+struct rsxgl_wait_label_reached {
+  volatile uint32_t * label;
+  const uint32_t value;
+
+  rsxgl_wait_label_reached(volatile uint32_t * _label,const uint32_t _value) : label(_label), value(_value) {}
+
+  // Wrap-around safe, for labels that count upwards:
+  bool operator()() const {
+    return (int32_t)(*label - value) >= 0;
+  }
+};
+
 // Insert a command to set the RSX's reference register to something:
 static inline void
 rsxgl_emit_set_ref(gcmContextData * context,const uint32_t value)
@@ -113,30 +248,15 @@ rsxgl_emit_sync_gpu_signal_write(gcmContextData * context,const rsxgl_sync_objec
   gcm_finish_n_commands(context,4);
 }
 
-// Block the CPU for a specified interval until the sync object is set to a specific value by the GPU.
-// Timing will be inaccurate - instead of actually measuring how long the operation's taken, just
-// divides desired timeout by timeout_interval, and run for that many iterations. Given that reading
-// back the sync value is probably pretty slow, this function may run for longer than timeout.
-// timeout_interval must therefore be some positive number - the function asserts that this is so.
-//
-// Returns 1 if the sync object was set to value while this function ran, 0 if it "timed out".
+// Block the CPU for up to timeout microseconds until the sync object is set to a specific value
+// by the GPU. Returns 1 if the sync object was set to value, 0 if it timed out.
 static inline int
-rsxgl_sync_cpu_wait(const rsxgl_sync_object_index_type index,const uint32_t value,const useconds_t timeout,const useconds_t timeout_interval)
+rsxgl_sync_cpu_wait(const rsxgl_sync_object_index_type index,const uint32_t value,const useconds_t timeout,const rsxgl_stall_site site)
 {
-  rsxgl_assert(timeout_interval > 0);
-
   volatile uint32_t * object = gcmGetLabelAddress(index);
   rsxgl_assert(object != 0);
 
-  uint32_t current_value = *object;
-  useconds_t i = 0;
-  const useconds_t n = timeout / timeout_interval;
-
-  for(;current_value != value && i < n;current_value = *object,++i) {
-    usleep(timeout_interval);
-  }
-
-  return (current_value == value);
+  return rsxgl_wait(site,rsxgl_wait_label_equal(object,value),rsxgl_wait_ticks(timeout));
 }
   
 // Tell the GPU to wait until a sync object is set to some value:
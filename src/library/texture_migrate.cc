@@ -22,6 +22,7 @@ static uint32_t rsxgl_texture_migrate_size = RSXGL_CONFIG_texture_migrate_buffer
 static void * _rsxgl_texture_migrate_buffer = 0;
 static uint32_t rsxgl_texture_migrate_buffer_offset = 0;
 static mspace rsxgl_texture_migrate_buffer_space = 0;
+static rsxgl_memory_stats_t rsxgl_texture_migrate_buffer_stats;
 
 void *
 rsxgl_texture_migrate_buffer_new(const rsx_size_t align,const rsx_size_t size, uint32_t *offset)
@@ -89,7 +90,9 @@ rsxgl_texture_migrate_memalign(const rsx_size_t align,const rsx_size_t size)
 
   rsxgl_assert(buffer != 0);
 
-  return mspace_memalign(rsxgl_texture_migrate_buffer_space,align,size);
+  void * ptr = mspace_memalign(rsxgl_texture_migrate_buffer_space,align,size);
+  if(ptr != 0) rsxgl_memory_stats_allocate(&rsxgl_texture_migrate_buffer_stats,mspace_usable_size(ptr));
+  return ptr;
 }
 
 void
@@ -97,6 +100,7 @@ rsxgl_texture_migrate_free(void * ptr)
 {
   rsxgl_assert(_rsxgl_texture_migrate_buffer != 0);
 
+  rsxgl_memory_stats_free(&rsxgl_texture_migrate_buffer_stats,mspace_usable_size(ptr));
   mspace_free(rsxgl_texture_migrate_buffer_space,ptr);
 }
 
@@ -105,6 +109,19 @@ rsxgl_texture_migrate_reset()
 {
 }
 
+void
+rsxgl_texture_migrate_stats(rsxgl_memory_stats_t & stats)
+{
+  stats = rsxgl_texture_migrate_buffer_stats;
+  stats.size = rsxgl_texture_migrate_size;
+  if(rsxgl_texture_migrate_buffer_space != 0) {
+    rsxgl_mspace_memory_stats(rsxgl_texture_migrate_buffer_space,&stats);
+  }
+  else {
+    stats.free = stats.largest_free = rsxgl_texture_migrate_size;
+  }
+}
+
 void *
 rsxgl_texture_migrate_address(const uint32_t offset)
 {
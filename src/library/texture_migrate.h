@@ -18,6 +18,7 @@ void rsxgl_texture_migrate_buffer_free(void * ptr);
 void * rsxgl_texture_migrate_memalign(const rsx_size_t,const rsx_size_t);
 void rsxgl_texture_migrate_free(void *);
 void rsxgl_texture_migrate_reset();
+void rsxgl_texture_migrate_stats(rsxgl_memory_stats_t &);
 void * rsxgl_texture_migrate_address(const uint32_t);
 uint32_t rsxgl_texture_migrate_offset(const void *);
 void * rsxgl_texture_migrate_base();
@@ -613,7 +613,7 @@ texture_t::texture_t()
   : deleted(0), timestamp(0), ref_count(0),
     invalid(0), invalid_complete(0),
     complete(0), immutable(0),
-    cube(0), rect(0), num_levels(0), dims(0), pformat(PIPE_FORMAT_NONE), format(0), pitch(0), remap(0)
+    cube(0), rect(0), num_levels(0), dims(0), pinned(0), pformat(PIPE_FORMAT_NONE), format(0), pitch(0), remap(0)
 {
   swizzle.r = RSXGL_TEXTURE_SWIZZLE_FROM_R;
   swizzle.g = RSXGL_TEXTURE_SWIZZLE_FROM_G;
@@ -679,7 +679,7 @@ glDeleteTextures (GLsizei n, const GLuint *textures)
       // TODO: orphan it, instead of doing this:
       texture_t & texture = texture_t::storage().at(texture_name);
       if(texture.timestamp > 0) {
-	rsxgl_timestamp_wait(ctx,texture.timestamp);
+	rsxgl_timestamp_wait(ctx,texture.timestamp,RSXGL_STALL_TEXTURE_DELETE);
 	texture.timestamp = 0;
       }
 
@@ -1314,18 +1314,18 @@ glTexParameteriv (GLenum target, GLenum pname, const GLint *params)
   rsxgl_tex_parameteri(ctx,ctx -> texture_binding.names[ctx -> active_texture],pname,*params);
 }
 
-static inline void
-rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
+// pitch is aligned to 64 bytes so it can be attached to a framebuffer:
+static inline uint32_t
+rsxgl_texture_storage_pitch(const texture_t & texture)
 {
-  rsxgl_assert(!texture.memory);
-  rsxgl_assert(texture.complete);
-  rsxgl_assert(texture.dims != 0);
-  rsxgl_assert(texture.pformat != PIPE_FORMAT_NONE);
-
-  // pitch is aligned to 64 bytes so it can be attached to a framebuffer:
-  const uint32_t pitch_tmp = util_format_get_stride(texture.pformat,texture.size[0]);
-  const uint32_t pitch = texture.dims > 1 ? align_pot< uint32_t, 64 >(pitch_tmp) : pitch_tmp;
+  const uint32_t pitch = util_format_get_stride(texture.pformat,texture.size[0]);
+  return texture.dims > 1 ? align_pot< uint32_t, 64 >(pitch) : pitch;
+}
 
+// Size of the storage for every mipmap level:
+static inline uint32_t
+rsxgl_texture_storage_size(const texture_t & texture,const uint32_t pitch)
+{
   uint32_t nbytes = 0;
   texture_t::dimension_size_type size[3] = { texture.size[0], texture.size[1], texture.size[2] };
   for(texture_t::level_size_type i = 0,n = texture.num_levels;i < n;++i) {
@@ -1335,6 +1335,19 @@ rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
       size[j] = std::max(size[j] >> 1,1);
     }
   }
+  return nbytes;
+}
+
+static inline void
+rsxgl_texture_validate_storage(rsxgl_context_t * ctx,texture_t & texture)
+{
+  rsxgl_assert(!texture.memory);
+  rsxgl_assert(texture.complete);
+  rsxgl_assert(texture.dims != 0);
+  rsxgl_assert(texture.pformat != PIPE_FORMAT_NONE);
+
+  const uint32_t pitch = rsxgl_texture_storage_pitch(texture);
+  const uint32_t nbytes = rsxgl_texture_storage_size(texture,pitch);
 
   texture.memory = rsxgl_arena_allocate(memory_arena_t::storage().at(texture.arena),128,nbytes,0);
   texture.memory.owner = true;
@@ -1450,7 +1463,7 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
   rsxgl_assert(height > 0);
   rsxgl_assert(depth > 0);
 
-  if(texture.immutable) {
+  if(texture.immutable || texture.pinned != 0) {
     RSXGL_ERROR_(GL_INVALID_OPERATION);
   }
 
@@ -1473,7 +1486,7 @@ rsxgl_tex_storage(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cu
   }
 #else
   if(texture.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,texture.timestamp);
+    rsxgl_timestamp_wait(ctx,texture.timestamp,RSXGL_STALL_TEXTURE_STORAGE);
     texture.timestamp = 0;
   }
 #endif
@@ -1538,8 +1551,8 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
   rsxgl_assert(height > 0);
   rsxgl_assert(depth > 0);
 
-  // report an error if it were immutable
-  if(texture.immutable) {
+  // report an error if it were immutable, or if command lists refer to its storage:
+  if(texture.immutable || texture.pinned != 0) {
     RSXGL_ERROR(GL_INVALID_OPERATION,false);
   }
 
@@ -1574,7 +1587,7 @@ rsxgl_tex_image_format(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bo
   }
 #else
   if(texture.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,texture.timestamp);
+    rsxgl_timestamp_wait(ctx,texture.timestamp,RSXGL_STALL_TEXTURE_STORAGE);
     texture.timestamp = 0;
   }
 #endif
@@ -1617,7 +1630,7 @@ rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
 
   // TODO: Asynchronous updating:
   if(texture.timestamp > 0) {
-    rsxgl_timestamp_wait(ctx,texture.timestamp);
+    rsxgl_timestamp_wait(ctx,texture.timestamp,RSXGL_STALL_TEXTURE_SUBIMAGE);
     texture.timestamp = 0;
   }
 
@@ -1671,23 +1684,6 @@ rsxgl_tex_subimage_init(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
   RSXGL_NOERROR(true);
 }
 
-static inline uint32_t
-rsxgl_pixel_store_aligned(const pixel_store_t & store,uint32_t value)
-{
-  switch(store.alignment) {
-  case RSXGL_PIXEL_STORE_ALIGNMENT_1:
-    return value;
-  case RSXGL_PIXEL_STORE_ALIGNMENT_2:
-    return align_pot< uint32_t, 2 >(value);
-  case RSXGL_PIXEL_STORE_ALIGNMENT_4:
-    return align_pot< uint32_t, 4 >(value);
-  case RSXGL_PIXEL_STORE_ALIGNMENT_8:
-    return align_pot< uint32_t, 8 >(value);
-  default:
-    return value;
-  }
-}
-
 static inline void
 rsxgl_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool cube,bool rect,GLint _level,GLint glinternalformat,GLsizei width,GLsizei height,GLsizei depth,
 		GLenum format,GLenum type,const GLvoid * data)
@@ -1793,7 +1789,7 @@ rsxgl_copy_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool
   const bool result = rsxgl_tex_image_format(ctx,texture,dims,cube,rect,_level,glinternalformat,width,height,1);
 
   if(result) {
-    const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+    const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
     
     framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
     rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
@@ -1818,7 +1814,7 @@ rsxgl_copy_tex_image(rsxgl_context_t * ctx,texture_t & texture,uint8_t dims,bool
 				      std::min((unsigned)width,(unsigned)framebuffer.size[0] - x),std::min((unsigned)height,(unsigned)framebuffer.size[1] - y));
     }
 
-    rsxgl_timestamp_post(ctx,timestamp);
+    rsxgl_timestamp_batch_post(ctx,1);
   }
 }
 
@@ -1832,7 +1828,7 @@ rsxgl_copy_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
   const bool result = rsxgl_tex_subimage_init(ctx,texture,_level,xoffset,yoffset,zoffset,width,height,1,&pdstformat,&dstpitch,&dstaddress,&dstmem);
 
   if(result) {
-    const uint32_t timestamp = rsxgl_timestamp_create(ctx,1);
+    const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
     
     framebuffer_t & framebuffer = ctx -> framebuffer_binding[RSXGL_READ_FRAMEBUFFER];
     rsxgl_framebuffer_validate(ctx,framebuffer,timestamp);
@@ -1850,7 +1846,7 @@ rsxgl_copy_tex_subimage(rsxgl_context_t * ctx,texture_t & texture,GLint _level,G
 				      std::min((unsigned)width,(unsigned)framebuffer.size[0] - x),std::min((unsigned)height,(unsigned)framebuffer.size[1] - y));
     }
     
-    rsxgl_timestamp_post(ctx,timestamp);
+    rsxgl_timestamp_batch_post(ctx,1);
   }
 }
 
@@ -2151,7 +2147,7 @@ glTexBuffer (GLenum target, GLenum internalformat, GLuint buffer)
 }
 
 void
-rsxgl_texture_validate(rsxgl_context_t * ctx,texture_t & texture,uint32_t timestamp)
+rsxgl_texture_validate(rsxgl_context_t * ctx,texture_t & texture,uint64_t timestamp)
 {
   rsxgl_assert(timestamp >= texture.timestamp);
   texture.timestamp = timestamp;
@@ -2232,15 +2228,107 @@ rsxgl_texture_validate(rsxgl_context_t * ctx,texture_t & texture,uint32_t timest
   }
 }
 
+uint32_t
+rsxgl_texture_size(const texture_t & texture)
+{
+  return rsxgl_texture_storage_size(texture,texture.pitch);
+}
+
+// Move a texture's storage to memory allocated from its arena (see rsxgl_arena_compact). The
+// RSX copies it, and the old storage is freed once it's done:
+void
+rsxgl_texture_move(rsxgl_context_t * ctx,const texture_t::name_type name,texture_t & texture,const memory_t & memory)
+{
+  const uint64_t timestamp = rsxgl_timestamp_batch(ctx);
+  rsxgl_memory_copy(ctx -> gcm_context(),memory,texture.memory,rsxgl_texture_size(texture));
+  rsxgl_timestamp_batch_post(ctx,1);
+
+  rsxgl_arena_free_deferred(ctx,texture.arena,texture.memory,timestamp);
+
+  texture.memory = memory;
+  texture.memory.owner = true;
+  texture.timestamp = timestamp;
+
+  // Texture units, and framebuffers, that point at the old storage:
+  ctx -> invalid_textures |= texture.binding_bitfield;
+
+  framebuffer_t::storage_type & framebuffers = framebuffer_t::storage();
+  for(framebuffer_t::name_type i = 1,n = framebuffers.contents_size();i < n;++i) {
+    if(!framebuffers.is_object(i)) continue;
+
+    framebuffer_t & framebuffer = framebuffers.at(i);
+    for(framebuffer_t::attachment_types_t::const_iterator it = framebuffer.attachment_types.begin();!it.done();it.next(framebuffer.attachment_types)) {
+      if(it.value() == RSXGL_ATTACHMENT_TYPE_TEXTURE && framebuffer.attachments[it.index()] == name) {
+	framebuffer.invalid = 1;
+
+	if(ctx -> framebuffer_binding.is_bound(RSXGL_DRAW_FRAMEBUFFER,i)) {
+	  ctx -> invalid.parts.draw_framebuffer = 1;
+	}
+	if(ctx -> framebuffer_binding.is_bound(RSXGL_READ_FRAMEBUFFER,i)) {
+	  ctx -> invalid.parts.read_framebuffer = 1;
+	}
+	break;
+      }
+    }
+  }
+}
+
+// Validate the storage of each texture that the program uses, and mark them as being in use
+// until timestamp. This can upload texture data, so it's done before the space required by
+// rsxgl_textures_validate is reserved:
 void
-rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t timestamp)
+rsxgl_textures_validate_storage(rsxgl_context_t * ctx,program_t & program,uint64_t timestamp)
+{
+  const program_t::textures_bitfield_type
+    textures_enabled = program.textures_enabled,
+    invalid_texture_assignments = ctx -> invalid_texture_assignments;
+  const program_t::texture_assignments_type
+    texture_assignments = program.texture_assignments;
+
+  program_t::textures_bitfield_type::const_iterator
+    enabled_it = textures_enabled.begin(),
+    invalid_it = invalid_texture_assignments.begin();
+  program_t::texture_assignments_type::const_iterator
+    assignment_it = texture_assignments.begin();
+
+  const bit_set< RSXGL_MAX_COMBINED_TEXTURE_IMAGE_UNITS >
+    invalid_textures = ctx -> invalid_textures;
+
+  for(program_t::texture_size_type index = 0;index < (RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS + RSXGL_MAX_TEXTURE_IMAGE_UNITS);++index,enabled_it.next(textures_enabled),invalid_it.next(invalid_texture_assignments),assignment_it.next(texture_assignments)) {
+    if(!enabled_it.test()) continue;
+
+    const texture_t::binding_type::size_type api_index = assignment_it.value();
+
+    if(ctx -> texture_binding.names[api_index] != 0) {
+      texture_t & texture = ctx -> texture_binding[api_index];
+      rsxgl_assert(timestamp >= texture.timestamp);
+      texture.timestamp = timestamp;
+    }
+
+    if(invalid_it.test() || invalid_textures.test(api_index)) {
+      rsxgl_texture_validate(ctx,ctx -> texture_binding[api_index],timestamp);
+    }
+  }
+}
+
+// Upper bound on the number of words emitted by rsxgl_textures_validate, which doesn't check for
+// space in the command buffer itself:
+uint32_t
+rsxgl_textures_validate_words(rsxgl_context_t * ctx,program_t & program)
+{
+  const bool invalid = ctx -> invalid_textures.any() || ctx -> invalid_samplers.any() || ctx -> invalid_texture_assignments.any();
+  return 4 + (invalid ? ((9 * RSXGL_MAX_VERTEX_TEXTURE_IMAGE_UNITS) + ((4 + 11) * RSXGL_MAX_TEXTURE_IMAGE_UNITS)) : 0);
+}
+
+void
+rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint64_t timestamp)
 {
   gcmContextData * context = ctx -> base.gcm_context;
 
   // Invalidate the texture cache.
   // TODO: determine when this is necessary to do, and only do it then.
   {
-    uint32_t * buffer = gcm_reserve(context,4);
+    uint32_t * buffer = gcm_reserve_unchecked(context,4);
 
     // Fragment program textures:
     gcm_emit_method_at(buffer,0,NV40_3D_TEX_CACHE_CTL,1);
@@ -2278,22 +2366,14 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 
     const texture_t::binding_type::size_type api_index = assignment_it.value();
 
-    if(ctx -> texture_binding.names[api_index] != 0) {
-      texture_t & texture = ctx -> texture_binding[api_index];
-      rsxgl_assert(timestamp >= texture.timestamp);
-      texture.timestamp = timestamp;
-    }
-
     if(invalid_it.test() || invalid_samplers.test(api_index)) {
       validated.set(api_index);
 
       // TODO: Set LOD min, max, bias:
     }
     if(invalid_it.test() || invalid_textures.test(api_index)) {
-      texture_t & texture = ctx -> texture_binding[api_index];
+      const texture_t & texture = ctx -> texture_binding[api_index];
 
-      rsxgl_texture_validate(ctx,texture,timestamp);
-      
       if(texture.memory) {
 	const uint32_t format = texture.format & (0x3 | NV30_3D_TEX_FORMAT_DIMS__MASK | NV30_3D_TEX_FORMAT_FORMAT__MASK | NV40_3D_TEX_FORMAT_MIPMAP_COUNT__MASK);
 	const uint32_t format_format = (format & NV30_3D_TEX_FORMAT_FORMAT__MASK);
@@ -2304,32 +2384,26 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 
 	if(format_format == RGBA32F_format || format_format == R32F_format) {
 	  // activate the texture:
-	  uint32_t * buffer = gcm_reserve(context,9);
+	  uint32_t * buffer = gcm_reserve_unchecked(context,9);
 
 #define NVFX_VERTEX_TEX_OFFSET(INDEX) (0x00000900 + 0x20 * (INDEX))
-	  gcm_emit_method(&buffer,NVFX_VERTEX_TEX_OFFSET(index),2);
-	  gcm_emit(&buffer,texture.memory.offset);
-	  gcm_emit(&buffer,format);
+	  gcm_emit_shadowed2(&buffer,NVFX_VERTEX_TEX_OFFSET(index),texture.memory.offset,format);
 	  
 #define NVFX_VERTEX_TEX_ENABLE(INDEX) (0x0000090c + 0x20 * (INDEX))
-	  gcm_emit_method(&buffer,NVFX_VERTEX_TEX_ENABLE(index),1);
-	  gcm_emit(&buffer,NV40_3D_TEX_ENABLE_ENABLE);
+	  gcm_emit_shadowed1(&buffer,NVFX_VERTEX_TEX_ENABLE(index),NV40_3D_TEX_ENABLE_ENABLE);
 	  
 #define NVFX_VERTEX_TEX_NPOT_SIZE(INDEX) (0x00000918 + 0x20 * (INDEX))
-	  gcm_emit_method(&buffer,NVFX_VERTEX_TEX_NPOT_SIZE(index),1);
-	  gcm_emit(&buffer,((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1]);
+	  gcm_emit_shadowed1(&buffer,NVFX_VERTEX_TEX_NPOT_SIZE(index),((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1]);
 	
 #define NVFX_VERTEX_TEX_SIZE1(INDEX) (0x00000910 + 0x20 * (INDEX))
-	  gcm_emit_method(&buffer,NVFX_VERTEX_TEX_SIZE1(index),1);
-	  gcm_emit(&buffer,(uint32_t)texture.pitch);
+	  gcm_emit_shadowed1(&buffer,NVFX_VERTEX_TEX_SIZE1(index),(uint32_t)texture.pitch);
 	  
 	  gcm_finish_commands(context,&buffer);
 	}
 	else {
-	  uint32_t * buffer = gcm_reserve(context,2);
+	  uint32_t * buffer = gcm_reserve_unchecked(context,2);
 
-	  gcm_emit_method(&buffer,NVFX_VERTEX_TEX_ENABLE(index),1);
-	  gcm_emit(&buffer,0);
+	  gcm_emit_shadowed1(&buffer,NVFX_VERTEX_TEX_ENABLE(index),0);
 
 	  gcm_finish_commands(context,&buffer);
 	}
@@ -2345,12 +2419,6 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 
     const texture_t::binding_type::size_type api_index = assignment_it.value();
 
-    if(ctx -> texture_binding.names[api_index] != 0) {
-      texture_t & texture = ctx -> texture_binding[api_index];
-      rsxgl_assert(timestamp >= texture.timestamp);
-      texture.timestamp = timestamp;
-    }
-
     if(invalid_it.test() || invalid_samplers.test(api_index)) {
       const sampler_t & sampler = (ctx -> sampler_binding.names[api_index] != 0) ? ctx -> sampler_binding[api_index] : ctx -> texture_binding[api_index].sampler;
       
@@ -2372,13 +2440,10 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 	;
       
       //
-      uint32_t * buffer = gcm_reserve(context,4);
-      
-      gcm_emit_method(&buffer,NV30_3D_TEX_FILTER(index),1);
-      gcm_emit(&buffer,filter);
+      uint32_t * buffer = gcm_reserve_unchecked(context,4);
       
-      gcm_emit_method(&buffer,NV30_3D_TEX_WRAP(index),1);
-      gcm_emit(&buffer,wrap | compare);
+      gcm_emit_shadowed1(&buffer,NV30_3D_TEX_FILTER(index),filter);
+      gcm_emit_shadowed1(&buffer,NV30_3D_TEX_WRAP(index),wrap | compare);
 
       // TODO: Set LOD min, max, bias:
       
@@ -2387,10 +2452,8 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
       validated.set(api_index);
     }
     if(invalid_it.test() || invalid_textures.test(api_index)) {
-      texture_t & texture = ctx -> texture_binding[api_index];
+      const texture_t & texture = ctx -> texture_binding[api_index];
 
-      rsxgl_texture_validate(ctx,texture,timestamp);
-      
       if(texture.memory) {
 #if 0
 	rsxgl_debug_printf("texture: %u (%u) %lx memory: %u %u pformat: %u format:%x size:%ux%u pitch:%u remap:%x\n",
@@ -2404,23 +2467,13 @@ rsxgl_textures_validate(rsxgl_context_t * ctx,program_t & program,uint32_t times
 #endif
 
 	// activate the texture:
-	uint32_t * buffer = gcm_reserve(context,11);
-	
-	gcm_emit_method(&buffer,NV30_3D_TEX_OFFSET(index),2);
-	gcm_emit(&buffer,texture.memory.offset);
-	gcm_emit(&buffer,texture.format);
+	uint32_t * buffer = gcm_reserve_unchecked(context,11);
 	
-	gcm_emit_method(&buffer,NV30_3D_TEX_ENABLE(index),1);
-	gcm_emit(&buffer,NV40_3D_TEX_ENABLE_ENABLE);
-	
-	gcm_emit_method(&buffer,NV30_3D_TEX_NPOT_SIZE(index),1);
-	gcm_emit(&buffer,((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1]);
-	
-	gcm_emit_method(&buffer,NV40_3D_TEX_SIZE1(index),1);
-	gcm_emit(&buffer,((uint32_t)texture.size[2] << NV40_3D_TEX_SIZE1_DEPTH__SHIFT) | (uint32_t)texture.pitch);
-
-	gcm_emit_method(&buffer,NV30_3D_TEX_SWIZZLE(index),1);
-	gcm_emit(&buffer,texture.remap);
+	gcm_emit_shadowed2(&buffer,NV30_3D_TEX_OFFSET(index),texture.memory.offset,texture.format);
+	gcm_emit_shadowed1(&buffer,NV30_3D_TEX_ENABLE(index),NV40_3D_TEX_ENABLE_ENABLE);
+	gcm_emit_shadowed1(&buffer,NV30_3D_TEX_NPOT_SIZE(index),((uint32_t)texture.size[0] << NV30_3D_TEX_NPOT_SIZE_W__SHIFT) | (uint32_t)texture.size[1]);
+	gcm_emit_shadowed1(&buffer,NV40_3D_TEX_SIZE1(index),((uint32_t)texture.size[2] << NV40_3D_TEX_SIZE1_DEPTH__SHIFT) | (uint32_t)texture.pitch);
+	gcm_emit_shadowed1(&buffer,NV30_3D_TEX_SWIZZLE(index),texture.remap);
 	
 	gcm_finish_commands(context,&buffer);
       }
@@ -89,7 +89,8 @@ struct texture_t {
 
   binding_bitfield_type binding_bitfield;
 
-  uint32_t deleted:1, timestamp:31;
+  uint32_t deleted:1;
+  uint64_t timestamp;
   uint32_t ref_count;
 
   texture_t();
@@ -118,6 +119,9 @@ struct texture_t {
     dims:2, cube:1, rect:1,
     num_levels:4;
 
+  // Number of recorded command lists that have the texture's storage address baked into them:
+  uint16_t pinned;
+
   struct {
     uint16_t r:3, g:3, b:3, a:3;
   } swizzle;
@@ -139,7 +143,11 @@ struct texture_t {
 struct rsxgl_context_t;
 
 bool rsxgl_texture_validate_complete(rsxgl_context_t *,texture_t &);
-void rsxgl_texture_validate(rsxgl_context_t *,texture_t &,uint32_t);
-void rsxgl_textures_validate(rsxgl_context_t *,program_t &,uint32_t);
+void rsxgl_texture_validate(rsxgl_context_t *,texture_t &,uint64_t);
+void rsxgl_textures_validate_storage(rsxgl_context_t *,program_t &,uint64_t);
+uint32_t rsxgl_textures_validate_words(rsxgl_context_t *,program_t &);
+void rsxgl_textures_validate(rsxgl_context_t *,program_t &,uint64_t);
+uint32_t rsxgl_texture_size(const texture_t &);
+void rsxgl_texture_move(rsxgl_context_t *,const texture_t::name_type,texture_t &,const memory_t &);
 
 #endif
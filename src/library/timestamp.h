@@ -18,19 +18,30 @@
 
 #include "sync.h"
 
-// max_timestamp + 1 should be a power-of-two value.
-// Should not return 0, because this is reserved for indicating that an object is not waiting
-// on a GPU operation.
+// Timestamps are 64-bit values that start at 1 and only ever go up. 0 is reserved for
+// indicating that an object is not waiting on a GPU operation.
+//
+// The sync object that the RSX writes timestamps to only holds their low 32 bits. The high
+// bits - the epoch - are tracked on the CPU, by extending each value read from the sync object
+// relative to the cached timestamp, which the GPU's value is never behind. This works for as
+// long as fewer than RSXGL_MAX_TIMESTAMP_DISTANCE timestamps are ever outstanding, which
+// rsxgl_timestamp_create ensures.
+
+// Combine the low 32 bits of a timestamp read from the GPU with the epoch of the cached one:
+static inline uint64_t
+rsxgl_timestamp_extend(const uint64_t cached_timestamp,const uint32_t value)
+{
+  return cached_timestamp + (uint32_t)(value - (uint32_t)cached_timestamp);
+}
 
-// Add the previously allocated timestamp to the command stream.
 // See if a timestamp has been passed by the GPU:
 static inline bool
-rsxgl_timestamp_passed(uint32_t & cached_timestamp,const uint8_t index,const uint32_t compare)
+rsxgl_timestamp_passed(uint64_t & cached_timestamp,const uint8_t index,const uint64_t compare)
 {
   rsxgl_assert(index != 0);
 
   if(cached_timestamp < compare) {
-    const uint32_t timestamp = rsxgl_sync_value(index);
+    const uint64_t timestamp = rsxgl_timestamp_extend(cached_timestamp,rsxgl_sync_value(index));
     cached_timestamp = timestamp;
     return timestamp >= compare;
   }
@@ -41,39 +52,27 @@ rsxgl_timestamp_passed(uint32_t & cached_timestamp,const uint8_t index,const uin
 
 // Conservative timestamp checking - only checks the "cached" timestamp, does not consult the GPU:
 static inline bool
-rsxgl_timestamp_passed_conservative(const uint32_t cached_timestamp,const uint32_t compare)
+rsxgl_timestamp_passed_conservative(const uint64_t cached_timestamp,const uint64_t compare)
 {
   return (cached_timestamp >= compare);
 }
 
-// Wait for the GPU to reach some timestamp. Returns true if the function did indeed need to wait,
-// false otherwise.
+// Wait, for up to timeout time base ticks, for the GPU to reach some timestamp. Returns true if
+// the timestamp was reached, false if the wait timed out.
 static inline bool
-rsxgl_timestamp_wait(uint32_t & cached_timestamp,const uint8_t index,const uint32_t compare,const useconds_t timeout_interval)
+rsxgl_timestamp_wait(uint64_t & cached_timestamp,const uint8_t index,const uint64_t compare,const rsxgl_stall_site site,const uint64_t timeout = rsxgl_wait_forever)
 {
   if(cached_timestamp < compare) {
     volatile uint32_t * object = gcmGetLabelAddress(index);
     rsxgl_assert(object != 0);
-    
-    uint32_t timestamp = *object;
 
-    if(timeout_interval) {
-      for(;timestamp < compare;timestamp = *object) {
-	usleep(timeout_interval);
-      }
-    }
-    else {
-      while(timestamp < compare) {
-	timestamp = *object;
-      }
-    }
+    const bool result = rsxgl_wait(site,rsxgl_wait_label_reached(object,(uint32_t)compare),timeout);
+    cached_timestamp = rsxgl_timestamp_extend(cached_timestamp,*object);
 
-    cached_timestamp = timestamp;
-
-    return true;
+    return result;
   }
   else {
-    return false;
+    return true;
   }
 }
 
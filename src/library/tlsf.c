@@ -0,0 +1,414 @@
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// tlsf.c - Two-level segregated fit allocator for RSX memory.
+
+#include "tlsf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static inline uint32_t
+rsxgl_tlsf_fls(const uint32_t x)
+{
+  return 31 - __builtin_clz(x);
+}
+
+static inline uint32_t
+rsxgl_tlsf_ffs(const uint32_t x)
+{
+  return __builtin_ctz(x);
+}
+
+static inline uint32_t
+rsxgl_tlsf_align_up(const uint32_t x,const uint32_t align)
+{
+  return (x + (align - 1)) & ~(align - 1);
+}
+
+// Free lists that a block of the given size goes into:
+static inline void
+rsxgl_tlsf_mapping_insert(const uint32_t size,uint32_t * fl,uint32_t * sl)
+{
+  if(size < RSXGL_TLSF_SMALL_BLOCK) {
+    *fl = 0;
+    *sl = size >> RSXGL_TLSF_ALIGN_LOG2;
+  }
+  else {
+    const uint32_t f = rsxgl_tlsf_fls(size);
+    *sl = (size >> (f - RSXGL_TLSF_SL_LOG2)) ^ RSXGL_TLSF_SL_COUNT;
+    *fl = f - RSXGL_TLSF_FL_SHIFT + 1;
+  }
+}
+
+// Free lists whose every block is at least the given size:
+static inline void
+rsxgl_tlsf_mapping_search(uint32_t size,uint32_t * fl,uint32_t * sl)
+{
+  if(size >= RSXGL_TLSF_SMALL_BLOCK) {
+    const uint32_t round = (1 << (rsxgl_tlsf_fls(size) - RSXGL_TLSF_SL_LOG2)) - 1;
+    size = (size > (RSXGL_TLSF_NONE - round)) ? RSXGL_TLSF_NONE : (size + round);
+  }
+  rsxgl_tlsf_mapping_insert(size,fl,sl);
+}
+
+static void
+rsxgl_tlsf_insert_free(struct rsxgl_tlsf_t * tlsf,const uint32_t i)
+{
+  struct rsxgl_tlsf_block_t * block = tlsf -> blocks + i;
+
+  uint32_t fl = 0, sl = 0;
+  rsxgl_tlsf_mapping_insert(block -> size,&fl,&sl);
+
+  const uint32_t head = tlsf -> free_lists[fl][sl];
+  block -> used = 0;
+  block -> prev_free = RSXGL_TLSF_NONE;
+  block -> next_free = head;
+  if(head != RSXGL_TLSF_NONE) tlsf -> blocks[head].prev_free = i;
+
+  tlsf -> free_lists[fl][sl] = i;
+  tlsf -> fl_bitmap |= (1U << fl);
+  tlsf -> sl_bitmap[fl] |= (1U << sl);
+}
+
+static void
+rsxgl_tlsf_remove_free(struct rsxgl_tlsf_t * tlsf,const uint32_t i)
+{
+  struct rsxgl_tlsf_block_t * block = tlsf -> blocks + i;
+
+  uint32_t fl = 0, sl = 0;
+  rsxgl_tlsf_mapping_insert(block -> size,&fl,&sl);
+
+  if(block -> prev_free != RSXGL_TLSF_NONE) tlsf -> blocks[block -> prev_free].next_free = block -> next_free;
+  if(block -> next_free != RSXGL_TLSF_NONE) tlsf -> blocks[block -> next_free].prev_free = block -> prev_free;
+
+  if(tlsf -> free_lists[fl][sl] == i) {
+    tlsf -> free_lists[fl][sl] = block -> next_free;
+
+    if(block -> next_free == RSXGL_TLSF_NONE) {
+      tlsf -> sl_bitmap[fl] &= ~(1U << sl);
+      if(tlsf -> sl_bitmap[fl] == 0) tlsf -> fl_bitmap &= ~(1U << fl);
+    }
+  }
+
+  block -> prev_free = RSXGL_TLSF_NONE;
+  block -> next_free = RSXGL_TLSF_NONE;
+}
+
+// First free block at least as big as the lists (fl, sl) hold:
+static uint32_t
+rsxgl_tlsf_find_suitable(const struct rsxgl_tlsf_t * tlsf,uint32_t fl,uint32_t sl)
+{
+  if(fl >= RSXGL_TLSF_FL_COUNT) return RSXGL_TLSF_NONE;
+
+  uint32_t sl_map = tlsf -> sl_bitmap[fl] & (~0U << sl);
+  if(sl_map == 0) {
+    const uint32_t fl_map = (fl + 1 < 32) ? (tlsf -> fl_bitmap & (~0U << (fl + 1))) : 0;
+    if(fl_map == 0) return RSXGL_TLSF_NONE;
+
+    fl = rsxgl_tlsf_ffs(fl_map);
+    sl_map = tlsf -> sl_bitmap[fl];
+  }
+
+  return tlsf -> free_lists[fl][rsxgl_tlsf_ffs(sl_map)];
+}
+
+// Block metadata. The array grows when it runs out, so blocks are always referred to by
+// index rather than by pointer:
+static int
+rsxgl_tlsf_reserve_blocks(struct rsxgl_tlsf_t * tlsf,uint32_t n)
+{
+  uint32_t i = tlsf -> unused_blocks;
+  while(n > 0 && i != RSXGL_TLSF_NONE) {
+    i = tlsf -> blocks[i].next_free;
+    --n;
+  }
+  if(n == 0) return 1;
+
+  const uint32_t capacity = tlsf -> blocks_capacity, new_capacity = (capacity == 0) ? 64 : (capacity * 2);
+  struct rsxgl_tlsf_block_t * blocks = (struct rsxgl_tlsf_block_t *)realloc(tlsf -> blocks,sizeof(struct rsxgl_tlsf_block_t) * new_capacity);
+  if(blocks == 0) return 0;
+
+  for(uint32_t j = new_capacity;j > capacity;--j) {
+    blocks[j - 1].next_free = tlsf -> unused_blocks;
+    tlsf -> unused_blocks = j - 1;
+  }
+
+  tlsf -> blocks = blocks;
+  tlsf -> blocks_capacity = new_capacity;
+
+  return rsxgl_tlsf_reserve_blocks(tlsf,n);
+}
+
+static uint32_t
+rsxgl_tlsf_new_block(struct rsxgl_tlsf_t * tlsf,const uint32_t offset,const uint32_t size)
+{
+  const uint32_t i = tlsf -> unused_blocks;
+  struct rsxgl_tlsf_block_t * block = tlsf -> blocks + i;
+  tlsf -> unused_blocks = block -> next_free;
+
+  block -> offset = offset;
+  block -> size = size;
+  block -> prev_phys = RSXGL_TLSF_NONE;
+  block -> next_phys = RSXGL_TLSF_NONE;
+  block -> prev_free = RSXGL_TLSF_NONE;
+  block -> next_free = RSXGL_TLSF_NONE;
+  block -> used = 0;
+
+  return i;
+}
+
+static void
+rsxgl_tlsf_release_block(struct rsxgl_tlsf_t * tlsf,const uint32_t i)
+{
+  tlsf -> blocks[i].next_free = tlsf -> unused_blocks;
+  tlsf -> unused_blocks = i;
+}
+
+// Used blocks, by offset:
+static inline uint32_t
+rsxgl_tlsf_hash(const struct rsxgl_tlsf_t * tlsf,const uint32_t offset)
+{
+  return ((offset >> RSXGL_TLSF_ALIGN_LOG2) * 2654435761U) & (tlsf -> table_capacity - 1);
+}
+
+static void
+rsxgl_tlsf_table_put(uint32_t * table,const uint32_t mask,const uint32_t slot,const uint32_t offset,const uint32_t i)
+{
+  uint32_t j = slot;
+  while(table[j * 2] != RSXGL_TLSF_NONE) j = (j + 1) & mask;
+  table[j * 2] = offset;
+  table[j * 2 + 1] = i;
+}
+
+static int
+rsxgl_tlsf_reserve_table(struct rsxgl_tlsf_t * tlsf)
+{
+  // Keep the table at most three quarters full:
+  if((tlsf -> table_count + 1) * 4 <= tlsf -> table_capacity * 3) return 1;
+
+  const uint32_t capacity = tlsf -> table_capacity, new_capacity = (capacity == 0) ? 64 : (capacity * 2);
+  uint32_t * table = (uint32_t *)malloc(sizeof(uint32_t) * 2 * new_capacity);
+  if(table == 0) return 0;
+
+  memset(table,0xff,sizeof(uint32_t) * 2 * new_capacity);
+
+  uint32_t * old_table = tlsf -> table;
+  tlsf -> table = table;
+  tlsf -> table_capacity = new_capacity;
+
+  for(uint32_t j = 0;j < capacity;++j) {
+    if(old_table[j * 2] != RSXGL_TLSF_NONE) {
+      rsxgl_tlsf_table_put(table,new_capacity - 1,rsxgl_tlsf_hash(tlsf,old_table[j * 2]),old_table[j * 2],old_table[j * 2 + 1]);
+    }
+  }
+
+  free(old_table);
+  return 1;
+}
+
+static uint32_t
+rsxgl_tlsf_table_find(const struct rsxgl_tlsf_t * tlsf,const uint32_t offset)
+{
+  if(tlsf -> table_capacity == 0) return RSXGL_TLSF_NONE;
+
+  const uint32_t mask = tlsf -> table_capacity - 1;
+  uint32_t j = rsxgl_tlsf_hash(tlsf,offset);
+  while(tlsf -> table[j * 2] != RSXGL_TLSF_NONE) {
+    if(tlsf -> table[j * 2] == offset) return j;
+    j = (j + 1) & mask;
+  }
+  return RSXGL_TLSF_NONE;
+}
+
+// Remove the entry in slot i, and move later entries of the same run back to fill the gap:
+static void
+rsxgl_tlsf_table_remove(struct rsxgl_tlsf_t * tlsf,uint32_t i)
+{
+  uint32_t * table = tlsf -> table;
+  const uint32_t mask = tlsf -> table_capacity - 1;
+
+  uint32_t j = i;
+  for(;;) {
+    j = (j + 1) & mask;
+    if(table[j * 2] == RSXGL_TLSF_NONE) break;
+
+    const uint32_t k = rsxgl_tlsf_hash(tlsf,table[j * 2]);
+    if((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+      table[i * 2] = table[j * 2];
+      table[i * 2 + 1] = table[j * 2 + 1];
+      i = j;
+    }
+  }
+
+  table[i * 2] = RSXGL_TLSF_NONE;
+  table[i * 2 + 1] = RSXGL_TLSF_NONE;
+  --tlsf -> table_count;
+}
+
+struct rsxgl_tlsf_t *
+rsxgl_tlsf_create(uint32_t size)
+{
+  size &= ~(uint32_t)(RSXGL_TLSF_ALIGN - 1);
+  if(size == 0) return 0;
+
+  struct rsxgl_tlsf_t * tlsf = (struct rsxgl_tlsf_t *)malloc(sizeof(struct rsxgl_tlsf_t));
+  if(tlsf == 0) return 0;
+
+  memset(tlsf,0,sizeof(struct rsxgl_tlsf_t));
+  memset(tlsf -> free_lists,0xff,sizeof(tlsf -> free_lists));
+  tlsf -> size = size;
+  tlsf -> unused_blocks = RSXGL_TLSF_NONE;
+
+  if(!rsxgl_tlsf_reserve_blocks(tlsf,1) || !rsxgl_tlsf_reserve_table(tlsf)) {
+    rsxgl_tlsf_destroy(tlsf);
+    return 0;
+  }
+
+  rsxgl_tlsf_insert_free(tlsf,rsxgl_tlsf_new_block(tlsf,0,size));
+
+  return tlsf;
+}
+
+void
+rsxgl_tlsf_destroy(struct rsxgl_tlsf_t * tlsf)
+{
+  if(tlsf == 0) return;
+
+  free(tlsf -> blocks);
+  free(tlsf -> table);
+  free(tlsf);
+}
+
+uint32_t
+rsxgl_tlsf_memalign(struct rsxgl_tlsf_t * tlsf,uint32_t alignment,uint32_t size)
+{
+  if(size == 0) size = 1;
+  if(alignment < RSXGL_TLSF_ALIGN) alignment = RSXGL_TLSF_ALIGN;
+  if(size > tlsf -> size || alignment > tlsf -> size) return RSXGL_TLSF_NONE;
+
+  size = rsxgl_tlsf_align_up(size,RSXGL_TLSF_ALIGN);
+
+  // Splitting a block uses up to two more; and the table needs room for the new entry. Get
+  // these first, so that nothing has to be undone if main memory runs out:
+  if(!rsxgl_tlsf_reserve_blocks(tlsf,2) || !rsxgl_tlsf_reserve_table(tlsf)) return RSXGL_TLSF_NONE;
+
+  // Any block from these lists is big enough, however it's aligned:
+  const uint32_t search_size = size + (alignment - RSXGL_TLSF_ALIGN);
+  if(search_size < size) return RSXGL_TLSF_NONE;
+
+  uint32_t fl = 0, sl = 0;
+  rsxgl_tlsf_mapping_search(search_size,&fl,&sl);
+
+  const uint32_t i = rsxgl_tlsf_find_suitable(tlsf,fl,sl);
+  if(i == RSXGL_TLSF_NONE) return RSXGL_TLSF_NONE;
+
+  rsxgl_tlsf_remove_free(tlsf,i);
+
+  // Free blocks are always merged with their free neighbours, so the padding in front, and
+  // whatever's left over at the end, become free blocks of their own:
+  const uint32_t padding = rsxgl_tlsf_align_up(tlsf -> blocks[i].offset,alignment) - tlsf -> blocks[i].offset;
+  if(padding > 0) {
+    const uint32_t j = rsxgl_tlsf_new_block(tlsf,tlsf -> blocks[i].offset,padding);
+    struct rsxgl_tlsf_block_t * front = tlsf -> blocks + j, * block = tlsf -> blocks + i;
+
+    front -> prev_phys = block -> prev_phys;
+    front -> next_phys = i;
+    if(block -> prev_phys != RSXGL_TLSF_NONE) tlsf -> blocks[block -> prev_phys].next_phys = j;
+    block -> prev_phys = j;
+    block -> offset += padding;
+    block -> size -= padding;
+
+    rsxgl_tlsf_insert_free(tlsf,j);
+  }
+
+  if(tlsf -> blocks[i].size - size >= RSXGL_TLSF_ALIGN) {
+    const uint32_t j = rsxgl_tlsf_new_block(tlsf,tlsf -> blocks[i].offset + size,tlsf -> blocks[i].size - size);
+    struct rsxgl_tlsf_block_t * back = tlsf -> blocks + j, * block = tlsf -> blocks + i;
+
+    back -> prev_phys = i;
+    back -> next_phys = block -> next_phys;
+    if(block -> next_phys != RSXGL_TLSF_NONE) tlsf -> blocks[block -> next_phys].prev_phys = j;
+    block -> next_phys = j;
+    block -> size = size;
+
+    rsxgl_tlsf_insert_free(tlsf,j);
+  }
+
+  struct rsxgl_tlsf_block_t * block = tlsf -> blocks + i;
+  block -> used = 1;
+
+  rsxgl_tlsf_table_put(tlsf -> table,tlsf -> table_capacity - 1,rsxgl_tlsf_hash(tlsf,block -> offset),block -> offset,i);
+  ++tlsf -> table_count;
+
+  tlsf -> used_size += block -> size;
+  ++tlsf -> used_count;
+  if(tlsf -> used_size > tlsf -> high_water) tlsf -> high_water = tlsf -> used_size;
+
+  return block -> offset;
+}
+
+void
+rsxgl_tlsf_free(struct rsxgl_tlsf_t * tlsf,const uint32_t offset)
+{
+  const uint32_t slot = rsxgl_tlsf_table_find(tlsf,offset);
+  if(slot == RSXGL_TLSF_NONE) return;
+
+  uint32_t i = tlsf -> table[slot * 2 + 1];
+  rsxgl_tlsf_table_remove(tlsf,slot);
+
+  tlsf -> used_size -= tlsf -> blocks[i].size;
+  --tlsf -> used_count;
+
+  // Merge with free neighbours:
+  const uint32_t prev = tlsf -> blocks[i].prev_phys;
+  if(prev != RSXGL_TLSF_NONE && !tlsf -> blocks[prev].used) {
+    rsxgl_tlsf_remove_free(tlsf,prev);
+
+    struct rsxgl_tlsf_block_t * block = tlsf -> blocks + i, * prev_block = tlsf -> blocks + prev;
+    prev_block -> size += block -> size;
+    prev_block -> next_phys = block -> next_phys;
+    if(block -> next_phys != RSXGL_TLSF_NONE) tlsf -> blocks[block -> next_phys].prev_phys = prev;
+
+    rsxgl_tlsf_release_block(tlsf,i);
+    i = prev;
+  }
+
+  const uint32_t next = tlsf -> blocks[i].next_phys;
+  if(next != RSXGL_TLSF_NONE && !tlsf -> blocks[next].used) {
+    rsxgl_tlsf_remove_free(tlsf,next);
+
+    struct rsxgl_tlsf_block_t * block = tlsf -> blocks + i, * next_block = tlsf -> blocks + next;
+    block -> size += next_block -> size;
+    block -> next_phys = next_block -> next_phys;
+    if(next_block -> next_phys != RSXGL_TLSF_NONE) tlsf -> blocks[next_block -> next_phys].prev_phys = i;
+
+    rsxgl_tlsf_release_block(tlsf,next);
+  }
+
+  rsxgl_tlsf_insert_free(tlsf,i);
+}
+
+uint32_t
+rsxgl_tlsf_block_size(const struct rsxgl_tlsf_t * tlsf,const uint32_t offset)
+{
+  const uint32_t slot = rsxgl_tlsf_table_find(tlsf,offset);
+  return (slot == RSXGL_TLSF_NONE) ? 0 : tlsf -> blocks[tlsf -> table[slot * 2 + 1]].size;
+}
+
+uint32_t
+rsxgl_tlsf_largest_free(const struct rsxgl_tlsf_t * tlsf)
+{
+  if(tlsf -> fl_bitmap == 0) return 0;
+
+  // The largest block is in the last non-empty list; only that list needs to be searched:
+  const uint32_t fl = rsxgl_tlsf_fls(tlsf -> fl_bitmap);
+  const uint32_t sl = rsxgl_tlsf_fls(tlsf -> sl_bitmap[fl]);
+
+  uint32_t largest = 0;
+  for(uint32_t i = tlsf -> free_lists[fl][sl];i != RSXGL_TLSF_NONE;i = tlsf -> blocks[i].next_free) {
+    if(tlsf -> blocks[i].size > largest) largest = tlsf -> blocks[i].size;
+  }
+  return largest;
+}
@@ -0,0 +1,86 @@
+//-*-C-*-
+// RSXGL - Graphics library for the PS3 GPU.
+//
+// Copyright (c) 2011 Alexander Betts (alex.betts@gmail.com)
+//
+// tlsf.h - Two-level segregated fit allocator for RSX memory.
+//
+// dlmalloc keeps its boundary tags next to the memory that it hands out, so every allocation
+// and free from RSX local memory does uncached reads and writes across the bus. This allocator
+// keeps all of its bookkeeping in main memory instead, and never touches the memory that it
+// manages - it deals only in offsets from the start of a region, [0,size). Allocating and
+// freeing take constant time; free blocks are kept in lists segregated by size, so that
+// fragmentation stays bounded.
+
+#ifndef rsxgl_tlsf_H
+#define rsxgl_tlsf_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returned by rsxgl_tlsf_memalign when there isn't enough room:
+#define RSXGL_TLSF_NONE (~(uint32_t)0)
+
+// Block sizes and offsets are multiples of this:
+#define RSXGL_TLSF_ALIGN_LOG2 4
+#define RSXGL_TLSF_ALIGN (1 << RSXGL_TLSF_ALIGN_LOG2)
+
+// Each power of two is divided into this many free lists:
+#define RSXGL_TLSF_SL_LOG2 5
+#define RSXGL_TLSF_SL_COUNT (1 << RSXGL_TLSF_SL_LOG2)
+
+// Blocks smaller than this all go into the first level's lists:
+#define RSXGL_TLSF_FL_SHIFT (RSXGL_TLSF_SL_LOG2 + RSXGL_TLSF_ALIGN_LOG2)
+#define RSXGL_TLSF_SMALL_BLOCK (1 << RSXGL_TLSF_FL_SHIFT)
+#define RSXGL_TLSF_FL_COUNT (32 - RSXGL_TLSF_FL_SHIFT + 1)
+
+// Blocks, free or not, tile the whole region. They refer to each other by their index in
+// rsxgl_tlsf_t::blocks; unused entries in that array are chained through next_free:
+struct rsxgl_tlsf_block_t {
+  uint32_t offset, size;
+  uint32_t prev_phys, next_phys;
+  uint32_t prev_free, next_free;
+  uint32_t used;
+};
+
+struct rsxgl_tlsf_t {
+  uint32_t size;
+
+  uint32_t fl_bitmap;
+  uint32_t sl_bitmap[RSXGL_TLSF_FL_COUNT];
+  uint32_t free_lists[RSXGL_TLSF_FL_COUNT][RSXGL_TLSF_SL_COUNT];
+
+  struct rsxgl_tlsf_block_t * blocks;
+  uint32_t blocks_capacity, unused_blocks;
+
+  // Finds a used block from its offset; open addressing, with RSXGL_TLSF_NONE marking empty
+  // slots. Entries are (offset, block index) pairs:
+  uint32_t * table;
+  uint32_t table_capacity, table_count;
+
+  // Bytes, and blocks, handed out; high_water is the most that used_size has ever been:
+  uint32_t used_size, used_count, high_water;
+};
+
+struct rsxgl_tlsf_t * rsxgl_tlsf_create(uint32_t size);
+void rsxgl_tlsf_destroy(struct rsxgl_tlsf_t *);
+
+// alignment must be a power of two. Returns an offset, or RSXGL_TLSF_NONE:
+uint32_t rsxgl_tlsf_memalign(struct rsxgl_tlsf_t *,uint32_t alignment,uint32_t size);
+void rsxgl_tlsf_free(struct rsxgl_tlsf_t *,uint32_t offset);
+
+// Size of the block at offset, which may be larger than the size that was asked for; 0 if
+// there isn't one:
+uint32_t rsxgl_tlsf_block_size(const struct rsxgl_tlsf_t *,uint32_t offset);
+
+// Size of the largest free block:
+uint32_t rsxgl_tlsf_largest_free(const struct rsxgl_tlsf_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+// "Unit testing" for the TLSF allocator. Builds and runs on the host, with "make check" in the
+// library's build directory, or by hand:
+//
+//   gcc -std=gnu99 -c tlsf.c && g++ tlsf_unit_tests.cc tlsf.o -o tlsf_unit_tests
+//
+// Allocations are checked against a shadow copy of the region, so that overlaps, misalignment,
+// and blocks that are lost or never merged back together are all caught.
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <cstdlib>
+#include <vector>
+
+struct assertion : public std::runtime_error {
+  assertion(const std::string & info)
+    : std::runtime_error(info) {
+  }
+};
+
+#define cxx_assert(__e) ((__e) ? (void)0 : throw assertion(std::string(#__e)));
+#define assert cxx_assert
+
+#include "tlsf.h"
+
+struct allocation {
+  uint32_t offset, size;
+
+  allocation(uint32_t _offset,uint32_t _size)
+    : offset(_offset), size(_size) {
+  }
+};
+
+// Which allocation owns each granule of the region:
+static std::vector< int > owners;
+
+static void
+claim(const allocation & a,const int owner)
+{
+  for(uint32_t i = a.offset / RSXGL_TLSF_ALIGN,n = (a.offset + a.size + RSXGL_TLSF_ALIGN - 1) / RSXGL_TLSF_ALIGN;i < n;++i) {
+    assert(owners[i] == (owner < 0 ? ~owner : -1));
+    owners[i] = (owner < 0) ? -1 : owner;
+  }
+}
+
+static void
+basic_tests()
+{
+  const uint32_t size = 1024 * 1024;
+  rsxgl_tlsf_t * tlsf = rsxgl_tlsf_create(size);
+  assert(tlsf != 0);
+  assert(rsxgl_tlsf_largest_free(tlsf) == size);
+
+  // The whole region can be had in one go, and then nothing else can:
+  const uint32_t all = rsxgl_tlsf_memalign(tlsf,16,size);
+  assert(all == 0);
+  assert(rsxgl_tlsf_memalign(tlsf,16,16) == RSXGL_TLSF_NONE);
+  rsxgl_tlsf_free(tlsf,all);
+  assert(rsxgl_tlsf_largest_free(tlsf) == size);
+
+  // Alignment:
+  const uint32_t a = rsxgl_tlsf_memalign(tlsf,16,48);
+  const uint32_t b = rsxgl_tlsf_memalign(tlsf,4096,100);
+  assert(a != RSXGL_TLSF_NONE && b != RSXGL_TLSF_NONE);
+  assert((b % 4096) == 0);
+  assert(rsxgl_tlsf_block_size(tlsf,a) == 48);
+  assert(rsxgl_tlsf_block_size(tlsf,b) == 112);
+  assert(tlsf -> used_size == 160 && tlsf -> used_count == 2);
+
+  // Freeing everything leaves one block again, but the high-water mark stays put:
+  rsxgl_tlsf_free(tlsf,a);
+  rsxgl_tlsf_free(tlsf,b);
+  assert(tlsf -> used_size == 0 && tlsf -> used_count == 0);
+  assert(tlsf -> high_water == size);
+  assert(rsxgl_tlsf_largest_free(tlsf) == size);
+
+  // Freeing something that wasn't allocated does nothing:
+  rsxgl_tlsf_free(tlsf,12345 * 16);
+  assert(rsxgl_tlsf_largest_free(tlsf) == size);
+
+  rsxgl_tlsf_destroy(tlsf);
+  std::cout << "basic tests done" << std::endl;
+}
+
+static void
+random_tests()
+{
+  const uint32_t size = 16 * 1024 * 1024;
+  rsxgl_tlsf_t * tlsf = rsxgl_tlsf_create(size);
+  assert(tlsf != 0);
+
+  owners.assign(size / RSXGL_TLSF_ALIGN,-1);
+
+  std::vector< allocation > allocations;
+  srand(1);
+
+  size_t failures = 0;
+  for(size_t iteration = 0;iteration < 200000;++iteration) {
+    if(allocations.empty() || (rand() % 3) != 0) {
+      const uint32_t align = 1 << (4 + (rand() % 9));
+      const uint32_t n = (rand() % 4 == 0) ? (1 + rand() % (256 * 1024)) : (1 + rand() % 1024);
+
+      const uint32_t offset = rsxgl_tlsf_memalign(tlsf,align,n);
+      if(offset == RSXGL_TLSF_NONE) {
+	++failures;
+	continue;
+      }
+
+      assert((offset % align) == 0);
+      assert(offset + n <= size);
+      assert(rsxgl_tlsf_block_size(tlsf,offset) >= n);
+
+      assert(tlsf -> high_water >= tlsf -> used_size);
+
+      allocations.push_back(allocation(offset,n));
+      claim(allocations.back(),allocations.size() - 1);
+    }
+    else {
+      const size_t i = rand() % allocations.size();
+      claim(allocations[i],~(int)i);
+      rsxgl_tlsf_free(tlsf,allocations[i].offset);
+
+      // Keep owners consistent with the allocation being moved into slot i:
+      if(i != allocations.size() - 1) {
+	claim(allocations.back(),~(int)(allocations.size() - 1));
+	allocations[i] = allocations.back();
+	claim(allocations[i],i);
+      }
+      allocations.pop_back();
+    }
+  }
+
+  for(size_t i = 0;i < allocations.size();++i) {
+    rsxgl_tlsf_free(tlsf,allocations[i].offset);
+  }
+  assert(tlsf -> used_size == 0 && tlsf -> used_count == 0 && tlsf -> table_count == 0);
+  assert(rsxgl_tlsf_largest_free(tlsf) == size);
+
+  rsxgl_tlsf_destroy(tlsf);
+  std::cout << "random tests done (" << failures << " allocations didn't fit)" << std::endl;
+}
+
+int
+main(int argc, char ** argv)
+{
+  try {
+    basic_tests();
+    random_tests();
+  }
+  catch (const assertion & a) {
+    std::cout << "assertion: " << a.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
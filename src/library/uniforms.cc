@@ -513,7 +513,7 @@ rsxgl_inline_transfer(gcmContextData * context,const uint32_t offset,const uint3
   //rsxgl_debug_printf("\toffset: %u offset_aligned:%u shift:%u width_pad:%u\n",offset,offset_aligned,shift,width_pad);
   
   //
-  uint32_t * buffer = gcm_reserve(context,12 + width_pad);
+  uint32_t * buffer = gcm_reserve_unchecked(context,12 + width_pad);
   
   gcm_emit_method(&buffer,NV3062TCL_SET_CONTEXT_DMA_IMAGE_DEST,1);
   gcm_emit(&buffer,0xFEED0000);
@@ -547,6 +547,15 @@ rsxgl_inline_transfer(gcmContextData * context,const uint32_t offset,const uint3
   gcm_finish_commands(context,&buffer);
 }
 
+// Upper bound on the number of words emitted by rsxgl_uniforms_validate, which doesn't check for
+// space in the command buffer itself. The worst case, where every uniform variable is invalid, is
+// computed when the program is linked:
+uint32_t
+rsxgl_uniforms_validate_words(rsxgl_context_t * ctx,program_t & program)
+{
+  return program.invalid_uniforms ? program.uniforms_validate_words : 0;
+}
+
 void
 rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program)
 {
@@ -602,7 +611,7 @@ rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program)
 	  const ieee32_t * pvalues = values + uniform.values_index;
 
 	  program_t::uniform_size_type index = uniform.vp_index;
-	  uint32_t * buffer = gcm_reserve(context,6 * count);
+	  uint32_t * buffer = gcm_reserve_unchecked(context,6 * count);
 
 	  //rsxgl_debug_printf("vp constant %u (count:%u width:%u)\n",index,count,width);
 	    
@@ -655,7 +664,7 @@ rsxgl_uniforms_validate(rsxgl_context_t * ctx,program_t & program)
     }
 
     if(n_validated_fp_uniforms > 0) {
-      uint32_t * buffer = gcm_reserve(context,2);
+      uint32_t * buffer = gcm_reserve_unchecked(context,2);
 
       gcm_emit_method(&buffer,NV30_3D_FP_ACTIVE_PROGRAM,1);
       gcm_emit(&buffer,rsxgl_rsx_ucode_offset(program.fp_ucode_offset) | NV30_3D_FP_ACTIVE_PROGRAM_DMA0);
@@ -14,6 +14,7 @@
 
 struct rsxgl_context_t;
 
+uint32_t rsxgl_uniforms_validate_words(rsxgl_context_t *,program_t &);
 void rsxgl_uniforms_validate(rsxgl_context_t *,program_t &);
 
 #endif